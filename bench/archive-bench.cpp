@@ -0,0 +1,102 @@
+#include "archive.hpp"
+#include "plan.hpp"
+#include "scalar.hpp"
+#include <benchmark/benchmark.h>
+#include <fmt/format.h>
+#include <vector>
+using namespace ScalarNS;
+
+// a model of two fully connected layers of n neurons over n inputs: built
+// from code and captured each time, or mapped from a saved file.
+// loading a file only reads the header, so the first pass pays for the
+// pages it touches; BM_archive_first_pass times load plus one forward.
+
+static Scalar<float> build_model(std::int64_t n) {
+  std::vector<Scalar<float>> layer;
+  for (std::int64_t i = 0; i < n; ++i) {
+    layer.push_back(make_scalar<float>(0.01f * static_cast<float>(i % 7), fmt::format("x{}", i)));
+  }
+  for (int l = 0; l < 2; ++l) {
+    std::vector<Scalar<float>> next;
+    for (std::int64_t j = 0; j < n; ++j) {
+      auto acc = make_scalar<float>(0.0f, fmt::format("l{}.b{}", l, j));
+      for (std::int64_t i = 0; i < n; ++i) {
+        acc = acc + layer[i] * make_scalar<float>(0.01f * static_cast<float>((i + j) % 5),
+                                                  fmt::format("l{}.w{}_{}", l, j, i));
+      }
+      next.push_back(tanh(acc));
+    }
+    layer = std::move(next);
+  }
+  auto total = layer[0];
+  for (std::int64_t j = 1; j < n; ++j) {
+    total = total + layer[j];
+  }
+  return total;
+}
+
+static std::string model_file(std::int64_t n) {
+  const auto path = fmt::format("/tmp/hugegrad-bench-{}.hg", n);
+  ArchiveNS::save(path, PlanNS::capture({build_model(n)}));
+  return path;
+}
+
+static void nodes_counter(benchmark::State &state, std::size_t nodes) {
+  state.counters["nodes"] = static_cast<double>(nodes);
+}
+
+static void BM_archive_rebuild(benchmark::State &state) {
+  std::size_t nodes = 0;
+  for (auto _ : state) {
+    auto plan = PlanNS::capture({build_model(state.range(0))});
+    nodes = plan.size();
+    benchmark::DoNotOptimize(plan.output()->data);
+  }
+  nodes_counter(state, nodes);
+}
+
+static void BM_archive_save(benchmark::State &state) {
+  auto plan = PlanNS::capture({build_model(state.range(0))});
+  const auto path = fmt::format("/tmp/hugegrad-bench-save-{}.hg", state.range(0));
+  for (auto _ : state) {
+    ArchiveNS::save(path, plan);
+  }
+  nodes_counter(state, plan.size());
+}
+
+static void BM_archive_load(benchmark::State &state) {
+  const auto path = model_file(state.range(0));
+  std::size_t nodes = 0;
+  for (auto _ : state) {
+    ArchiveNS::Mapped<float> model(path);
+    nodes = model.size();
+    benchmark::DoNotOptimize(model.values.data());
+  }
+  nodes_counter(state, nodes);
+}
+
+static void BM_archive_first_pass(benchmark::State &state) {
+  const auto path = model_file(state.range(0));
+  std::size_t nodes = 0;
+  for (auto _ : state) {
+    ArchiveNS::Mapped<float> model(path);
+    model.forward();
+    nodes = model.size();
+    benchmark::DoNotOptimize(model.output());
+  }
+  nodes_counter(state, nodes);
+}
+
+static void BM_archive_verify(benchmark::State &state) {
+  ArchiveNS::Mapped<float> model(model_file(state.range(0)));
+  for (auto _ : state) {
+    model.verify();
+  }
+  nodes_counter(state, model.size());
+}
+
+BENCHMARK(BM_archive_rebuild)->Arg(64)->Arg(256)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_archive_save)->Arg(64)->Arg(256)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_archive_load)->Arg(64)->Arg(256)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_archive_first_pass)->Arg(64)->Arg(256)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_archive_verify)->Arg(64)->Arg(256)->Unit(benchmark::kMillisecond);
@@ -0,0 +1,51 @@
+#include "scalar.hpp"
+#include <benchmark/benchmark.h>
+using namespace ScalarNS;
+
+// three ops (and no constant leaves) per step
+template <typename T>
+Scalar<T> build_chain(Scalar<T> x, Scalar<T> w, Scalar<T> b, std::int64_t depth) {
+  for (std::int64_t i = 0; i < depth; ++i) {
+    x = tanh(x * w + b);
+  }
+  return x;
+}
+
+template <typename T>
+static void BM_build_heap(benchmark::State &state) {
+  for (auto _ : state) {
+    auto x = make_scalar<T>(0.5);
+    auto w = make_scalar<T>(0.9);
+    auto b = make_scalar<T>(0.1);
+    auto out = build_chain(x, w, b, state.range(0));
+    benchmark::DoNotOptimize(out->data);
+    // teardown is part of the cost of a step
+  }
+  state.counters["nodes/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * (3 * state.range(0) + 3)),
+      benchmark::Counter::kIsRate);
+}
+
+template <typename T>
+static void BM_build_arena(benchmark::State &state) {
+  GraphContext<T> ctx;
+  for (auto _ : state) {
+    {
+      GraphScope<T> scope(ctx);
+      auto x = make_scalar<T>(0.5);
+      auto w = make_scalar<T>(0.9);
+      auto b = make_scalar<T>(0.1);
+      auto out = build_chain(x, w, b, state.range(0));
+      benchmark::DoNotOptimize(out->data);
+    }
+    ctx.reset();
+  }
+  state.counters["nodes/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * (3 * state.range(0) + 3)),
+      benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(BM_build_heap<float>)->RangeMultiplier(4)->Range(64, 4096);
+BENCHMARK(BM_build_arena<float>)->RangeMultiplier(4)->Range(64, 4096);
+BENCHMARK(BM_build_heap<double>)->RangeMultiplier(4)->Range(64, 4096);
+BENCHMARK(BM_build_arena<double>)->RangeMultiplier(4)->Range(64, 4096);
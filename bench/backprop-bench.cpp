@@ -0,0 +1,45 @@
+#include "scalar.hpp"
+#include "thread-pool.hpp"
+#include "topo.hpp"
+#include <benchmark/benchmark.h>
+using namespace ScalarNS;
+
+// width independent neurons over 16 shared inputs, summed at the end
+template <typename T>
+static Scalar<T> build_layer(std::vector<Scalar<T>> &keep, std::int64_t width) {
+  constexpr int inputs = 16;
+  for (int i = 0; i < inputs; ++i) {
+    keep.push_back(make_scalar<T>(T(0.1) * i));
+  }
+  Scalar<T> total;
+  for (std::int64_t j = 0; j < width; ++j) {
+    auto w = make_scalar<T>(T(0.5));
+    auto acc = keep[0] * w;
+    for (int i = 1; i < inputs; ++i) {
+      acc = acc + keep[i] * w;
+    }
+    total = j == 0 ? tanh(acc) : total + tanh(acc);
+  }
+  return total;
+}
+
+static void BM_backprop_serial(benchmark::State &state) {
+  std::vector<Scalar<double>> keep;
+  auto out = build_layer<double>(keep, state.range(0));
+  for (auto _ : state) {
+    backpropagate({out});
+  }
+}
+
+// args: width, threads. the speedup needs as many cores as threads
+static void BM_backprop_parallel(benchmark::State &state) {
+  std::vector<Scalar<double>> keep;
+  auto out = build_layer<double>(keep, state.range(0));
+  ThreadPool pool(state.range(1));
+  for (auto _ : state) {
+    backpropagate({out}, pool);
+  }
+}
+
+BENCHMARK(BM_backprop_serial)->Arg(1024)->Arg(8192);
+BENCHMARK(BM_backprop_parallel)->ArgsProduct({{1024, 8192}, {1, 2, 4, 8}});
@@ -0,0 +1,67 @@
+#include "batch.hpp"
+#include "plan.hpp"
+#include "scalar.hpp"
+#include <benchmark/benchmark.h>
+using namespace ScalarNS;
+
+// a two input net of 8 tanh neurons
+template <typename T>
+struct Net {
+  Scalar<T> x0 = make_scalar<T>(0);
+  Scalar<T> x1 = make_scalar<T>(0);
+  Scalar<T> out;
+  Net() {
+    for (int j = 0; j < 8; ++j) {
+      auto h = tanh(x0 * T(0.1 * j) + x1 * T(0.3 - 0.05 * j) + T(0.1));
+      out = j == 0 ? h * T(0.5) : out + h * T(0.5);
+    }
+  }
+};
+
+// the plan replayed once per sample
+template <typename T>
+static void BM_samples_replay(benchmark::State &state) {
+  Net<T> net;
+  auto plan = PlanNS::capture({net.out});
+  auto x0 = plan.var(net.x0);
+  auto x1 = plan.var(net.x1);
+  const auto samples = state.range(0);
+  for (auto _ : state) {
+    for (std::int64_t i = 0; i < samples; ++i) {
+      x0->data = T(i) / T(samples);
+      x1->data = T(1) - T(i) / T(samples);
+      plan.forward();
+      plan.backward();
+      benchmark::DoNotOptimize(x0->grad);
+    }
+  }
+  state.counters["samples/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * samples), benchmark::Counter::kIsRate);
+}
+
+// all samples at once, one lane each
+template <typename T>
+static void BM_samples_batch(benchmark::State &state) {
+  Net<T> net;
+  auto plan = PlanNS::capture({net.out});
+  const auto samples = state.range(0);
+  PlanNS::Batch<T> batch(plan, samples);
+  for (auto _ : state) {
+    auto x0 = batch.value(net.x0);
+    auto x1 = batch.value(net.x1);
+    for (std::int64_t i = 0; i < samples; ++i) {
+      x0[i] = T(i) / T(samples);
+      x1[i] = T(1) - T(i) / T(samples);
+    }
+    batch.forward();
+    batch.backward();
+    benchmark::DoNotOptimize(batch.grads.data());
+  }
+  state.counters["samples/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * samples), benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(BM_samples_replay<float>)->Arg(1024);
+BENCHMARK(BM_samples_batch<float>)->RangeMultiplier(4)->Range(64, 4096);
+BENCHMARK(BM_samples_replay<double>)->Arg(1024);
+BENCHMARK(BM_samples_batch<double>)->RangeMultiplier(4)->Range(64, 4096);
@@ -0,0 +1,34 @@
+#include "checkpoint.hpp"
+#include "scalar.hpp"
+#include "topo.hpp"
+#include <benchmark/benchmark.h>
+using namespace ScalarNS;
+
+// a 4096 step recurrence, args: checkpoint every n steps (0: plain graph)
+template <typename T>
+static void BM_recurrence(benchmark::State &state) {
+  constexpr std::size_t steps = 4096;
+  const auto every = static_cast<std::size_t>(state.range(0));
+  auto x = make_scalar<T>(0.3);
+  auto w = make_scalar<T>(0.8);
+  auto b = make_scalar<T>(0.1);
+  auto step = [&](Scalar<T> y) { return tanh(y * w + b); };
+  std::size_t kept = 0;
+  for (auto _ : state) {
+    Scalar<T> y = x;
+    if (every == 0) {
+      for (std::size_t i = 0; i < steps; ++i) {
+        y = step(y);
+      }
+    } else {
+      y = checkpoint_sequence(x, steps, every, step);
+    }
+    backpropagate({y});
+    kept = topological_sort({y}).size();
+  }
+  // nodes alive between forward and backward
+  state.counters["nodes"] = static_cast<double>(kept);
+  state.counters["bytes"] = static_cast<double>(kept * sizeof(ScalarValue<T>));
+}
+
+BENCHMARK(BM_recurrence<double>)->Arg(0)->Arg(16)->Arg(64)->Arg(256);
@@ -0,0 +1,75 @@
+#!/usr/bin/env python3
+"""Compare two hugegrad-bench JSON runs and flag regressions.
+
+    hugegrad-bench --benchmark_out=base.json --benchmark_out_format=json
+    ...change things...
+    hugegrad-bench --benchmark_out=new.json --benchmark_out_format=json
+    bench/compare.py base.json new.json
+
+Benchmarks are matched by name. A benchmark regresses when its real time
+grows by more than --threshold, or its bytes/node counter grows at all.
+Exits with 1 if anything regressed. Only uses the standard library.
+"""
+import argparse
+import json
+import sys
+
+NS = {"ns": 1.0, "us": 1e3, "ms": 1e6, "s": 1e9}
+
+
+def load(path):
+    with open(path) as f:
+        runs = json.load(f)["benchmarks"]
+    # repetitions report a mean aggregate, prefer it over single runs
+    out = {}
+    for run in runs:
+        if run.get("run_type") == "aggregate" and run.get("aggregate_name") != "mean":
+            continue
+        name = run.get("run_name", run["name"])
+        if name in out and run.get("run_type") != "aggregate":
+            continue
+        out[name] = run
+    return out
+
+
+def real_ns(run):
+    return run["real_time"] * NS[run.get("time_unit", "ns")]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline")
+    parser.add_argument("current")
+    parser.add_argument("--threshold", type=float, default=0.10,
+                        help="allowed relative slowdown, default 0.10")
+    args = parser.parse_args()
+
+    base = load(args.baseline)
+    cur = load(args.current)
+    regressions = 0
+    width = max((len(n) for n in cur if n in base), default=4)
+    print(f"{'name':<{width}}  {'base':>12}  {'current':>12}  {'change':>8}")
+    for name, run in cur.items():
+        if name not in base:
+            continue
+        old = real_ns(base[name])
+        new = real_ns(run)
+        change = new / old - 1 if old > 0 else 0.0
+        flags = []
+        if change > args.threshold:
+            flags.append("SLOWER")
+        old_bytes = base[name].get("bytes/node")
+        new_bytes = run.get("bytes/node")
+        if old_bytes is not None and new_bytes is not None and new_bytes > old_bytes:
+            flags.append(f"bytes/node {old_bytes:.1f} -> {new_bytes:.1f}")
+        regressions += bool(flags)
+        print(f"{name:<{width}}  {old:>10.0f}ns  {new:>10.0f}ns  {change:>+7.1%}  {' '.join(flags)}")
+    missing = [n for n in base if n not in cur]
+    for name in missing:
+        print(f"{name}: missing from {args.current}")
+    print(f"{regressions} regression(s)")
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,36 @@
+#include "scalar.hpp"
+#include "topo.hpp"
+#include <benchmark/benchmark.h>
+using namespace ScalarNS;
+
+// every layer recomputes the same features of x before using them
+template <typename T>
+static Scalar<T> repetitive(Scalar<T> x, Scalar<T> w, std::int64_t layers) {
+  auto y = x;
+  for (std::int64_t i = 0; i < layers; ++i) {
+    y = y * tanh(x * w + 1.0) + exp(x * -0.5) * pow(w, T(2));
+  }
+  return y;
+}
+
+// build and backpropagate, arg: 1 under a CseScope
+template <typename T>
+static void BM_repetitive_step(benchmark::State &state) {
+  auto x = make_scalar<T>(0.5);
+  auto w = make_scalar<T>(0.9);
+  std::size_t nodes = 0;
+  for (auto _ : state) {
+    CseTable<T> table;
+    std::optional<CseScope<T>> scope;
+    if (state.range(1)) {
+      scope.emplace(table);
+    }
+    auto y = repetitive(x, w, state.range(0));
+    backpropagate({y});
+    nodes = topological_sort({y}).size();
+  }
+  state.counters["nodes"] = static_cast<double>(nodes);
+  state.counters["bytes"] = static_cast<double>(nodes * sizeof(ScalarValue<T>));
+}
+
+BENCHMARK(BM_repetitive_step<double>)->ArgsProduct({{256, 4096}, {0, 1}});
@@ -0,0 +1,32 @@
+#include "scalar.hpp"
+#include "topo.hpp"
+#include <benchmark/benchmark.h>
+using namespace ScalarNS;
+
+// the reverse sweep of backpropagate on its own, over a sorted graph that
+// mixes every op, so the cost is mostly the per-node op dispatch
+template <typename T>
+static void BM_backward_sweep(benchmark::State &state) {
+  GraphContext<T> ctx;
+  GraphScope<T> scope(ctx);
+  auto x = make_scalar<T>(0.5);
+  auto w = make_scalar<T>(0.9);
+  auto b = make_scalar<T>(0.1);
+  for (std::int64_t i = 0; i < state.range(0); ++i) {
+    x = tanh(pow(x * w + b, T(2))) + exp(x * T(-0.5));
+  }
+  auto sorted = topological_sort({x});
+  for (auto _ : state) {
+    x->grad = 1;
+    for (auto i = sorted.rbegin(); i != sorted.rend(); ++i) {
+      (*i)->propagate_gradient();
+    }
+    benchmark::DoNotOptimize(w->grad);
+  }
+  state.counters["nodes/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * sorted.size()),
+      benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(BM_backward_sweep<float>)->Arg(1024)->Arg(16384);
+BENCHMARK(BM_backward_sweep<double>)->Arg(1024)->Arg(16384);
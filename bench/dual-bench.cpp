@@ -0,0 +1,45 @@
+#include "derivative.hpp"
+#include "dual.hpp"
+#include "scalar.hpp"
+#include "topo.hpp"
+#include <benchmark/benchmark.h>
+#include <functional>
+
+// a narrow function, one input and one output
+template <typename V>
+static V narrow(const V &x) {
+  return tanh(x * 0.8 + 0.1) * x + pow(x, 3.0) * 0.25 + exp(x * -0.5);
+}
+
+static void BM_narrow_finite_difference(benchmark::State &state) {
+  std::function<double(double)> f = [](double x) { return narrow(x); };
+  auto f_p = derivative<double>(f);
+  double x = 0.1;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(f_p(x));
+    x += 1e-9;
+  }
+}
+
+static void BM_narrow_dual(benchmark::State &state) {
+  auto f_p = DualNS::derivative<double>([](const auto &x) { return narrow(x); });
+  double x = 0.1;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(f_p(x));
+    x += 1e-9;
+  }
+}
+
+static void BM_narrow_reverse(benchmark::State &state) {
+  double x = 0.1;
+  for (auto _ : state) {
+    auto in = ScalarNS::make_scalar<double>(x);
+    backpropagate({narrow(in)});
+    benchmark::DoNotOptimize(in->grad);
+    x += 1e-9;
+  }
+}
+
+BENCHMARK(BM_narrow_finite_difference);
+BENCHMARK(BM_narrow_dual);
+BENCHMARK(BM_narrow_reverse);
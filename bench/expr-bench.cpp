@@ -0,0 +1,33 @@
+#include "expr.hpp"
+#include "scalar.hpp"
+#include "topo.hpp"
+#include <benchmark/benchmark.h>
+
+// value and gradient of tanh_exp(x), one formula per iteration
+template <typename T>
+static void BM_tanh_exp_graph(benchmark::State &state) {
+  using namespace ScalarNS;
+  T x0 = 0.1;
+  for (auto _ : state) {
+    auto x = make_scalar<T>(x0);
+    auto y = tanh_exp(x);
+    backpropagate({y});
+    benchmark::DoNotOptimize(x->grad);
+    x0 += T(1e-6);
+  }
+}
+
+template <typename T>
+static void BM_tanh_exp_expr(benchmark::State &state) {
+  T x0 = 0.1;
+  for (auto _ : state) {
+    auto r = ExprNS::eval(ExprNS::tanh_exp(ExprNS::var<0>(x0)));
+    benchmark::DoNotOptimize(r);
+    x0 += T(1e-6);
+  }
+}
+
+BENCHMARK(BM_tanh_exp_graph<float>);
+BENCHMARK(BM_tanh_exp_expr<float>);
+BENCHMARK(BM_tanh_exp_graph<double>);
+BENCHMARK(BM_tanh_exp_expr<double>);
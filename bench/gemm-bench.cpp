@@ -0,0 +1,36 @@
+#include "fcl.hpp"
+#include "gemm.hpp"
+#include <benchmark/benchmark.h>
+#include <vector>
+
+template <typename T>
+static void BM_gemm(benchmark::State &state) {
+  const std::size_t n = state.range(0);
+  std::vector<T> a(n * n, T(0.5)), b(n * n, T(0.25)), c(n * n);
+  for (auto _ : state) {
+    Gemm::gemm(n, n, n, Gemm::row_major(a.data(), n), Gemm::row_major(b.data(), n),
+               c.data(), n);
+    benchmark::DoNotOptimize(c.data());
+  }
+  state.counters["FLOPS"] = benchmark::Counter(
+      2.0 * n * n * n * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+template <typename T>
+static void BM_dense_step(benchmark::State &state) {
+  const std::size_t n = state.range(0);
+  Dense<T> layer(n, n, Operation::tanh_ptr<T>);
+  auto x = TensorNS::make_tensor(TensorNS::Tensor<T>({64, n}, T(0.1)));
+  for (auto _ : state) {
+    auto y = layer(x);
+    TensorNS::backpropagate({y});
+    benchmark::DoNotOptimize(layer.weight->grad.data());
+  }
+  // forward gemm plus two backward gemms
+  state.counters["FLOPS"] = benchmark::Counter(
+      3 * 2.0 * 64 * n * n * state.iterations(), benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(BM_gemm<float>)->RangeMultiplier(2)->Range(64, 1024);
+BENCHMARK(BM_gemm<double>)->RangeMultiplier(2)->Range(64, 1024);
+BENCHMARK(BM_dense_step<float>)->RangeMultiplier(4)->Range(64, 1024);
@@ -0,0 +1,64 @@
+#include "gradcheck.hpp"
+#include "scalar.hpp"
+#include "thread-pool.hpp"
+#include <benchmark/benchmark.h>
+#include <vector>
+using namespace ScalarNS;
+
+// 8 inputs, a layer of tanh neurons and a linear output, 10 parameters
+// per neuron
+struct Net {
+  std::vector<Scalar<double>> params;
+  Scalar<double> loss;
+
+  explicit Net(std::size_t hidden) {
+    std::vector<Scalar<double>> x;
+    for (int i = 0; i < 8; ++i) x.push_back(make_scalar<double>(0.1 * i - 0.4));
+    Scalar<double> out;
+    for (std::size_t j = 0; j < hidden; ++j) {
+      auto b = make_scalar<double>(0.01 * double(j % 3));
+      params.push_back(b);
+      Scalar<double> sum = b;
+      for (int i = 0; i < 8; ++i) {
+        auto w = make_scalar<double>(0.05 * double((i + j) % 9) - 0.2);
+        params.push_back(w);
+        sum = sum + x[i] * w;
+      }
+      auto v = make_scalar<double>(j % 2 ? 0.3 : -0.3);
+      params.push_back(v);
+      out = j == 0 ? tanh(sum) * v : out + tanh(sum) * v;
+    }
+    loss = pow(out - 0.5, 2.0);
+  }
+};
+
+// the check by hand: rebuild the graph twice per parameter
+static void BM_gradcheck_rebuild(benchmark::State &state) {
+  const std::size_t hidden = state.range(0);
+  for (auto _ : state) {
+    Net net(hidden);
+    for (std::size_t k = 0; k < net.params.size(); ++k) {
+      const double x = net.params[k]->data;
+      net.params[k]->data = x + 1e-3;
+      const double up = Net(hidden).loss->data;
+      net.params[k]->data = x - 1e-3;
+      const double down = Net(hidden).loss->data;
+      net.params[k]->data = x;
+      benchmark::DoNotOptimize(up - down);
+    }
+  }
+  state.counters["params"] = double(hidden * 10);
+}
+
+static void BM_gradcheck(benchmark::State &state) {
+  Net net(state.range(0));
+  ThreadPool pool(state.range(1));
+  for (auto _ : state) {
+    auto check = gradcheck(net.loss, net.params, {.pool = &pool});
+    benchmark::DoNotOptimize(check.max_rel_error);
+  }
+  state.counters["params"] = double(net.params.size());
+}
+
+BENCHMARK(BM_gradcheck_rebuild)->Arg(25)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_gradcheck)->ArgsProduct({{25, 400}, {1, 4}})->Unit(benchmark::kMillisecond)->UseRealTime();
@@ -0,0 +1,151 @@
+#include "scalar.hpp"
+#include "topo.hpp"
+#include <benchmark/benchmark.h>
+#include <concepts>
+#include <vector>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+using namespace ScalarNS;
+
+// the core scalar graph over a few shapes and element types: building it
+// with make_scalar and the operators, sorting it, and backpropagating.
+// every benchmark reports nodes/s and the heap bytes one node costs.
+//
+// tanh is left out for int, where it would round everything to 0
+
+template <typename T>
+static Scalar<T> activate(const Scalar<T> &x) {
+  if constexpr (std::floating_point<T>) {
+    return tanh(x);
+  } else {
+    return x;
+  }
+}
+
+// y = act(y * w + x), n times: one long dependency chain
+struct Chain {
+  template <typename T>
+  static Scalar<T> build(std::int64_t n) {
+    auto x = make_scalar<T>(T(1));
+    auto w = make_scalar<T>(T(1));
+    auto y = x;
+    for (std::int64_t i = 0; i < n; ++i) {
+      y = activate(y * w + x);
+    }
+    return y;
+  }
+};
+
+// n independent products of one shared input, summed: one node with a
+// fan-out of n
+struct Fan {
+  template <typename T>
+  static Scalar<T> build(std::int64_t n) {
+    auto x = make_scalar<T>(T(1));
+    auto total = activate(x * make_scalar<T>(T(1)));
+    for (std::int64_t i = 1; i < n; ++i) {
+      total = total + activate(x * make_scalar<T>(T(i % 3)));
+    }
+    return total;
+  }
+};
+
+// three fully connected layers of n neurons each over n inputs, summed
+struct Mlp {
+  template <typename T>
+  static Scalar<T> build(std::int64_t n) {
+    std::vector<Scalar<T>> layer;
+    for (std::int64_t i = 0; i < n; ++i) {
+      layer.push_back(make_scalar<T>(T(i % 2)));
+    }
+    for (int l = 0; l < 3; ++l) {
+      std::vector<Scalar<T>> next;
+      for (std::int64_t j = 0; j < n; ++j) {
+        auto acc = layer[0] * make_scalar<T>(T(1));
+        for (std::int64_t i = 1; i < n; ++i) {
+          acc = acc + layer[i] * make_scalar<T>(T((i + j) % 3 - 1));
+        }
+        next.push_back(activate(acc));
+      }
+      layer = std::move(next);
+    }
+    auto total = layer[0];
+    for (std::int64_t j = 1; j < n; ++j) {
+      total = total + layer[j];
+    }
+    return total;
+  }
+};
+
+static std::size_t heap_in_use() {
+#if defined(__GLIBC__)
+  return mallinfo2().uordblks;
+#else
+  return 0;
+#endif
+}
+
+// nodes in one graph of the shape and the heap they take, labels included
+template <typename T, typename Shape>
+static void graph_counters(benchmark::State &state) {
+  const auto before = heap_in_use();
+  auto out = Shape::template build<T>(state.range(0));
+  const auto bytes = heap_in_use() - before;
+  const auto nodes = topological_sort({out}).size();
+  state.counters["nodes/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * nodes), benchmark::Counter::kIsRate);
+  state.counters["bytes/node"] = static_cast<double>(bytes) / static_cast<double>(nodes);
+}
+
+template <typename T, typename Shape>
+static void BM_graph_build(benchmark::State &state) {
+  for (auto _ : state) {
+    auto out = Shape::template build<T>(state.range(0));
+    benchmark::DoNotOptimize(out->data);
+    state.PauseTiming();
+    out.reset();
+    state.ResumeTiming();
+  }
+  graph_counters<T, Shape>(state);
+}
+
+// one untimed pass first: the first big allocation after the previous
+// benchmark freed its graph pays for malloc consolidating its free lists
+template <typename T, typename Shape>
+static void BM_graph_topo(benchmark::State &state) {
+  auto out = Shape::template build<T>(state.range(0));
+  topological_sort({out});
+  for (auto _ : state) {
+    auto sorted = topological_sort({out});
+    benchmark::DoNotOptimize(sorted.data());
+  }
+  graph_counters<T, Shape>(state);
+}
+
+template <typename T, typename Shape>
+static void BM_graph_backprop(benchmark::State &state) {
+  auto out = Shape::template build<T>(state.range(0));
+  backpropagate({out});
+  for (auto _ : state) {
+    backpropagate({out});
+    benchmark::DoNotOptimize(out->grad);
+  }
+  graph_counters<T, Shape>(state);
+}
+
+#define HUGEGRAD_GRAPH_BENCH(NAME, T)                                          \
+  BENCHMARK_TEMPLATE(NAME, T, Chain)->Arg(1 << 10)->Arg(1 << 14)->Arg(1 << 20); \
+  BENCHMARK_TEMPLATE(NAME, T, Fan)->Arg(1 << 10)->Arg(1 << 16);                \
+  BENCHMARK_TEMPLATE(NAME, T, Mlp)->Arg(16)->Arg(64);
+
+HUGEGRAD_GRAPH_BENCH(BM_graph_build, float)
+HUGEGRAD_GRAPH_BENCH(BM_graph_build, double)
+HUGEGRAD_GRAPH_BENCH(BM_graph_build, int)
+HUGEGRAD_GRAPH_BENCH(BM_graph_topo, float)
+HUGEGRAD_GRAPH_BENCH(BM_graph_topo, double)
+HUGEGRAD_GRAPH_BENCH(BM_graph_topo, int)
+HUGEGRAD_GRAPH_BENCH(BM_graph_backprop, float)
+HUGEGRAD_GRAPH_BENCH(BM_graph_backprop, double)
+HUGEGRAD_GRAPH_BENCH(BM_graph_backprop, int)
+#undef HUGEGRAD_GRAPH_BENCH
@@ -0,0 +1,48 @@
+#include "initialization.hpp"
+#include "thread-pool.hpp"
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+
+// the draw initializers used before, engine and distribution per value
+static void BM_init_std_uniform(benchmark::State &state) {
+  std::vector<float> w(state.range(0));
+  std::default_random_engine engine;
+  std::uniform_real_distribution<float> dist(-1, 1);
+  for (auto _ : state) {
+    for (auto &v : w) v = dist(engine);
+    benchmark::ClobberMemory();
+  }
+  state.counters["values/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * state.range(0)), benchmark::Counter::kIsRate);
+}
+
+template <typename Init>
+static void BM_init_range(benchmark::State &state, Init init) {
+  using T = decltype(init());
+  std::vector<T> w(state.range(0));
+  for (auto _ : state) {
+    init.init_range(w.data(), w.size());
+    benchmark::ClobberMemory();
+  }
+  state.counters["values/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * state.range(0)), benchmark::Counter::kIsRate);
+}
+
+static void BM_init_parallel(benchmark::State &state) {
+  std::vector<float> w(state.range(0));
+  ThreadPool pool(state.range(1));
+  auto init = kaiming_normal<float>(256);
+  for (auto _ : state) {
+    parallel_init_range(pool, init, w.data(), w.size());
+    benchmark::ClobberMemory();
+  }
+  state.counters["values/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * state.range(0)), benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(BM_init_std_uniform)->Arg(1 << 20);
+BENCHMARK_CAPTURE(BM_init_range, uniform_float, UniformFloatInit<float>(-1, 1))->Arg(1 << 20);
+BENCHMARK_CAPTURE(BM_init_range, uniform_double, UniformFloatInit<double>(-1, 1))->Arg(1 << 20);
+BENCHMARK_CAPTURE(BM_init_range, normal_float, kaiming_normal<float>(256))->Arg(1 << 20);
+BENCHMARK(BM_init_parallel)->ArgsProduct({{1 << 22}, {1, 4}});
@@ -0,0 +1,61 @@
+#include "operation.hpp"
+#include <benchmark/benchmark.h>
+#include <vector>
+
+// per element virtual calls, the way ScalarValue drives an op
+template <typename T>
+static void BM_forward_per_element(benchmark::State &state, Operation::Operation<T> *op) {
+  const std::size_t n = state.range(0);
+  std::vector<T> a(n, T(1.5)), b(n, T(0.25)), out(n);
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < n; ++i) {
+      out[i] = op->forward(a[i], b[i]);
+    }
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+template <typename T>
+static void BM_forward_n(benchmark::State &state, Operation::Operation<T> *op) {
+  const std::size_t n = state.range(0);
+  std::vector<T> a(n, T(1.5)), b(n, T(0.25)), out(n);
+  for (auto _ : state) {
+    op->forward_n(a, b, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+template <typename T>
+static void BM_backward_per_element(benchmark::State &state, Operation::Operation<T> *op) {
+  const std::size_t n = state.range(0);
+  std::vector<T> g(n, T(1.5)), a(n, T(0.5)), b(n, T(0.25)), out(n);
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < n; ++i) {
+      out[i] += op->backward(g[i], a[i], b[i]);
+    }
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+template <typename T>
+static void BM_backward_n(benchmark::State &state, Operation::Operation<T> *op) {
+  const std::size_t n = state.range(0);
+  std::vector<T> g(n, T(1.5)), a(n, T(0.5)), b(n, T(0.25)), out(n);
+  for (auto _ : state) {
+    op->backward_n(g, a, b, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+
+BENCHMARK_CAPTURE(BM_forward_per_element, add_float, Operation::add_ptr<float>)->Range(1 << 10, 1 << 20);
+BENCHMARK_CAPTURE(BM_forward_n, add_float, Operation::add_ptr<float>)->Range(1 << 10, 1 << 20);
+BENCHMARK_CAPTURE(BM_backward_per_element, mul_float, Operation::mul_ptr<float>)->Range(1 << 10, 1 << 20);
+BENCHMARK_CAPTURE(BM_backward_n, mul_float, Operation::mul_ptr<float>)->Range(1 << 10, 1 << 20);
+BENCHMARK_CAPTURE(BM_forward_per_element, mul_double, Operation::mul_ptr<double>)->Range(1 << 10, 1 << 20);
+BENCHMARK_CAPTURE(BM_forward_n, mul_double, Operation::mul_ptr<double>)->Range(1 << 10, 1 << 20);
+BENCHMARK_CAPTURE(BM_forward_per_element, tanh_float, Operation::tanh_ptr<float>)->Range(1 << 10, 1 << 16);
+BENCHMARK_CAPTURE(BM_forward_n, tanh_float, Operation::tanh_ptr<float>)->Range(1 << 10, 1 << 16);
@@ -0,0 +1,66 @@
+#include "memory-plan.hpp"
+#include "plan.hpp"
+#include "scalar.hpp"
+#include <benchmark/benchmark.h>
+#include <vector>
+using namespace ScalarNS;
+
+// dense tanh layers of width `width` over `width` inputs, summed up
+template <typename T>
+static Scalar<T> build_mlp(std::vector<Scalar<T>> &params, std::size_t width,
+                           std::size_t depth) {
+  std::vector<Scalar<T>> act;
+  for (std::size_t i = 0; i < width; ++i) {
+    act.push_back(make_scalar<T>(T(0.01) * T(i)));
+    params.push_back(act.back());
+  }
+  for (std::size_t d = 0; d < depth; ++d) {
+    std::vector<Scalar<T>> next;
+    for (std::size_t j = 0; j < width; ++j) {
+      auto b = make_scalar<T>(T(0.1));
+      params.push_back(b);
+      Scalar<T> sum = b;
+      for (std::size_t i = 0; i < width; ++i) {
+        auto w = make_scalar<T>(T((i * 7 + j * 3) % 11) / T(11) - T(0.5));
+        params.push_back(w);
+        sum = sum + w * act[i];
+      }
+      next.push_back(tanh(sum));
+    }
+    act = std::move(next);
+  }
+  auto out = act[0];
+  for (std::size_t i = 1; i < width; ++i) {
+    out = out + act[i];
+  }
+  return out;
+}
+
+// the same forward and backward on the plain plan (arg 0) and inside the
+// planned buffer (arg 1)
+template <typename T>
+static void BM_replay_memory(benchmark::State &state) {
+  std::vector<Scalar<T>> params;
+  auto out = build_mlp<T>(params, state.range(1), 3);
+  auto plan = PlanNS::capture({out});
+  const double nodes = static_cast<double>(plan.size());
+  if (state.range(0)) {
+    auto mem = PlanNS::plan_memory(std::move(plan), params);
+    for (auto _ : state) {
+      mem.forward();
+      mem.backward();
+    }
+    state.counters["bytes"] = static_cast<double>(mem.planned_bytes());
+  } else {
+    for (auto _ : state) {
+      plan.forward();
+      plan.backward();
+    }
+    state.counters["bytes"] = nodes * 2 * sizeof(T);
+  }
+  state.counters["nodes/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations()) * nodes, benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(BM_replay_memory<float>)->ArgsProduct({{0, 1}, {32, 128}});
+BENCHMARK(BM_replay_memory<double>)->ArgsProduct({{0, 1}, {32, 128}});
@@ -0,0 +1,106 @@
+#include "batch.hpp"
+#include "mixed.hpp"
+#include "plan.hpp"
+#include "scalar.hpp"
+#include <benchmark/benchmark.h>
+#include <vector>
+using namespace ScalarNS;
+
+// 16 bit storage against the fp32 batch: the array conversions alone, and
+// a training step of a 16 input net with two tanh layers of 16 neurons
+// over a growing batch. bytes/lane counts the value and gradient rows; the
+// larger batches don't fit in cache, where the halved traffic shows.
+
+template <typename H>
+static void BM_half_widen(benchmark::State &state) {
+  std::vector<H> in(state.range(0), H(0.75f));
+  std::vector<float> out(in.size());
+  for (auto _ : state) {
+    HalfNS::widen<H>(in, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <typename H>
+static void BM_half_narrow(benchmark::State &state) {
+  std::vector<float> in(state.range(0));
+  for (std::size_t i = 0; i < in.size(); ++i) {
+    in[i] = 0.001f * float(i) - 3.0f;
+  }
+  std::vector<H> out(in.size());
+  for (auto _ : state) {
+    HalfNS::narrow<H>(in, out);
+    benchmark::DoNotOptimize(out.data());
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+struct Net {
+  std::vector<Scalar<float>> x;
+  Scalar<float> out;
+  Net() {
+    for (int i = 0; i < 16; ++i) {
+      x.push_back(make_scalar<float>(0.0f));
+    }
+    auto layer = x;
+    for (int l = 0; l < 2; ++l) {
+      std::vector<Scalar<float>> next;
+      for (int j = 0; j < 16; ++j) {
+        auto acc = layer[0] * make_scalar<float>(0.1f);
+        for (int i = 1; i < 16; ++i) {
+          acc = acc + layer[i] * make_scalar<float>(0.01f * float((i * 7 + j) % 13) - 0.06f);
+        }
+        next.push_back(tanh(acc));
+      }
+      layer = std::move(next);
+    }
+    out = layer[0];
+    for (int j = 1; j < 16; ++j) {
+      out = out + layer[j];
+    }
+  }
+};
+
+template <typename B>
+static void batch_step(benchmark::State &state, B &batch, const Net &net) {
+  for (std::size_t k = 0; k < net.x.size(); ++k) {
+    auto row = batch.value(net.x[k]);
+    for (std::size_t i = 0; i < row.size(); ++i) {
+      row[i] = 0.01f * float((i + k) % 97) - 0.5f;
+    }
+  }
+  for (auto _ : state) {
+    batch.forward();
+    batch.backward();
+    benchmark::DoNotOptimize(batch.grads.data());
+  }
+  state.counters["lanes/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * state.range(0)), benchmark::Counter::kIsRate);
+  state.counters["bytes/lane"] = static_cast<double>(
+      (batch.values.size() + batch.grads.size()) * sizeof(batch.values[0])) /
+      static_cast<double>(state.range(0));
+}
+
+static void BM_float_batch_step(benchmark::State &state) {
+  Net net;
+  auto plan = PlanNS::capture({net.out});
+  PlanNS::Batch<float> batch(plan, state.range(0));
+  batch_step(state, batch, net);
+}
+
+template <typename H>
+static void BM_mixed_batch_step(benchmark::State &state) {
+  Net net;
+  auto plan = PlanNS::capture({net.out});
+  PlanNS::MixedBatch<H> batch(plan, state.range(0));
+  batch_step(state, batch, net);
+}
+
+BENCHMARK(BM_half_widen<bf16>)->Arg(1 << 16);
+BENCHMARK(BM_half_widen<fp16>)->Arg(1 << 16);
+BENCHMARK(BM_half_narrow<bf16>)->Arg(1 << 16);
+BENCHMARK(BM_half_narrow<fp16>)->Arg(1 << 16);
+BENCHMARK(BM_float_batch_step)->RangeMultiplier(8)->Range(64, 4096)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_mixed_batch_step<bf16>)->RangeMultiplier(8)->Range(64, 4096)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_mixed_batch_step<fp16>)->RangeMultiplier(8)->Range(64, 4096)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,61 @@
+#include "optimizer.hpp"
+#include "parameters.hpp"
+#include "scalar.hpp"
+#include "thread-pool.hpp"
+#include <benchmark/benchmark.h>
+#include <vector>
+using namespace ScalarNS;
+
+// the update by hand over heap leaves, what training loops did before
+template <typename T>
+static void BM_sgd_by_hand(benchmark::State &state) {
+  std::vector<Scalar<T>> leaves;
+  for (std::int64_t i = 0; i < state.range(0); ++i) {
+    leaves.push_back(make_scalar<T>(T(0.5)));
+    leaves.back()->grad = T(0.1);
+  }
+  for (auto _ : state) {
+    for (auto &w : leaves) {
+      w->data -= T(1e-3) * w->grad;
+    }
+    benchmark::ClobberMemory();
+  }
+  state.counters["params/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * state.range(0)), benchmark::Counter::kIsRate);
+}
+
+// fused passes over flat arrays, arg 1 is the thread count
+template <typename T, typename Opt>
+static void BM_flat_step(benchmark::State &state) {
+  const auto n = static_cast<std::size_t>(state.range(0));
+  std::vector<T> p(n, T(0.5)), g(n, T(0.1));
+  ThreadPool pool(state.range(1));
+  Opt opt(n, {});
+  opt.pool = &pool;
+  for (auto _ : state) {
+    opt.step(p, g);
+    benchmark::ClobberMemory();
+  }
+  state.counters["params/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * state.range(0)), benchmark::Counter::kIsRate);
+}
+
+// gather, adam, scatter through a registry
+template <typename T>
+static void BM_registry_adam(benchmark::State &state) {
+  ParameterRegistry<T> params;
+  params.add_n(state.range(0), [] { return T(0.5); });
+  OptimNS::Adam<T> adam(params.size(), {});
+  for (auto _ : state) {
+    adam.step(params);
+  }
+  state.counters["params/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * state.range(0)), benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(BM_sgd_by_hand<float>)->Arg(1 << 16)->Arg(1 << 20);
+BENCHMARK(BM_flat_step<float, OptimNS::Sgd<float>>)->ArgsProduct({{1 << 16, 1 << 20}, {1}});
+BENCHMARK(BM_flat_step<float, OptimNS::Adam<float>>)
+    ->ArgsProduct({{1 << 16, 1 << 20}, {1, 4}});
+BENCHMARK(BM_flat_step<double, OptimNS::Adam<double>>)->ArgsProduct({{1 << 20}, {1}});
+BENCHMARK(BM_registry_adam<float>)->Arg(1 << 16);
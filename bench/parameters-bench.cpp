@@ -0,0 +1,61 @@
+#include "parameters.hpp"
+#include "scalar.hpp"
+#include <benchmark/benchmark.h>
+using namespace ScalarNS;
+
+// a dot product of range(0) parameters with as many inputs
+template <typename T>
+static Scalar<T> build_dot(ParameterRegistry<T> &params, std::int64_t n) {
+  auto w = params.add_n(n, [] { return T(0.5); });
+  Scalar<T> out = make_scalar<T>(0);
+  for (std::int64_t i = 0; i < n; ++i) {
+    out = out + w[i] * make_scalar<T>(T(i));
+  }
+  return out;
+}
+
+// resetting the gradients by walking the graph from the loss
+template <typename T>
+static void BM_zero_grad_walk(benchmark::State &state) {
+  ParameterRegistry<T> params;
+  auto loss = build_dot(params, state.range(0));
+  for (auto _ : state) {
+    loss->clear_gradient();
+    benchmark::ClobberMemory();
+  }
+  state.counters["params/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * state.range(0)), benchmark::Counter::kIsRate);
+}
+
+// resetting them through the registry
+template <typename T>
+static void BM_zero_grad_registry(benchmark::State &state) {
+  ParameterRegistry<T> params;
+  auto loss = build_dot(params, state.range(0));
+  for (auto _ : state) {
+    params.zero_grad();
+    benchmark::ClobberMemory();
+  }
+  state.counters["params/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * state.range(0)), benchmark::Counter::kIsRate);
+}
+
+// gather, sgd on the flat arrays, scatter
+template <typename T>
+static void BM_registry_sgd(benchmark::State &state) {
+  ParameterRegistry<T> params;
+  auto loss = build_dot(params, state.range(0));
+  for (auto _ : state) {
+    auto g = params.gather_grads();
+    for (std::size_t i = 0; i < g.size(); ++i) {
+      params.values[i] -= T(1e-3) * g[i];
+    }
+    params.scatter_values();
+  }
+  state.counters["params/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * state.range(0)), benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(BM_zero_grad_walk<float>)->RangeMultiplier(16)->Range(256, 65536);
+BENCHMARK(BM_zero_grad_registry<float>)->RangeMultiplier(16)->Range(256, 65536);
+BENCHMARK(BM_registry_sgd<float>)->RangeMultiplier(16)->Range(256, 65536);
@@ -0,0 +1,83 @@
+#include "fusion.hpp"
+#include "plan.hpp"
+#include "scalar.hpp"
+#include "topo.hpp"
+#include <benchmark/benchmark.h>
+using namespace ScalarNS;
+
+template <typename T>
+static Scalar<T> build_step(Scalar<T> x, Scalar<T> w, Scalar<T> b, std::int64_t depth) {
+  for (std::int64_t i = 0; i < depth; ++i) {
+    x = tanh(x * w + b);
+  }
+  return x;
+}
+
+// rebuild, sort and backpropagate every step
+template <typename T>
+static void BM_step_rebuild(benchmark::State &state) {
+  GraphContext<T> ctx;
+  T wv = 0.9;
+  for (auto _ : state) {
+    {
+      GraphScope<T> scope(ctx);
+      auto w = make_scalar<T>(wv);
+      auto out = build_step(make_scalar<T>(0.5), w, make_scalar<T>(0.1), state.range(0));
+      backpropagate({out});
+      wv -= T(1e-3) * w->grad;
+    }
+    ctx.reset();
+  }
+  state.counters["nodes/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * (3 * state.range(0) + 3)),
+      benchmark::Counter::kIsRate);
+}
+
+// capture once, rebind w and replay
+template <typename T>
+static void BM_step_replay(benchmark::State &state) {
+  auto w = make_scalar<T>(0.9);
+  auto plan = PlanNS::capture(
+      {build_step(make_scalar<T>(0.5), w, make_scalar<T>(0.1), state.range(0))});
+  auto wv = plan.var(w);
+  for (auto _ : state) {
+    plan.forward();
+    plan.backward();
+    wv->data -= T(1e-3) * wv->grad;
+  }
+  state.counters["nodes/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * plan.size()),
+      benchmark::Counter::kIsRate);
+}
+
+// a chain of tanh_exp(x * w + b) / w, replayed with and without fusion
+template <typename T>
+static void BM_replay_fusion(benchmark::State &state) {
+  auto x = make_scalar<T>(0.5);
+  auto w = make_scalar<T>(0.9);
+  auto b = make_scalar<T>(0.1);
+  auto y = x;
+  for (int i = 0; i < 256; ++i) {
+    y = tanh_exp(y * w + b) / w;
+  }
+  auto plan = PlanNS::capture({y});
+  const auto captured = plan.size();
+  if (state.range(0)) {
+    PlanNS::fuse(plan, {x, w, b});
+  }
+  for (auto _ : state) {
+    plan.forward();
+    plan.backward();
+  }
+  state.counters["nodes"] = static_cast<double>(plan.size());
+  state.counters["steps/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations()), benchmark::Counter::kIsRate);
+  state.counters["captured"] = static_cast<double>(captured);
+}
+
+BENCHMARK(BM_replay_fusion<float>)->Arg(0)->Arg(1);
+BENCHMARK(BM_replay_fusion<double>)->Arg(0)->Arg(1);
+BENCHMARK(BM_step_rebuild<float>)->RangeMultiplier(8)->Range(64, 4096);
+BENCHMARK(BM_step_replay<float>)->RangeMultiplier(8)->Range(64, 4096);
+BENCHMARK(BM_step_rebuild<double>)->RangeMultiplier(8)->Range(64, 4096);
+BENCHMARK(BM_step_replay<double>)->RangeMultiplier(8)->Range(64, 4096);
@@ -0,0 +1,57 @@
+#include "scalar.hpp"
+#include "tape.hpp"
+#include "topo.hpp"
+#include <benchmark/benchmark.h>
+
+// a small recurrence: three ops per step
+template <typename V>
+V recurrence(V x, V w, V b, std::int64_t depth) {
+  for (std::int64_t i = 0; i < depth; ++i) {
+    x = tanh(x * w + b);
+  }
+  return x;
+}
+
+template <typename T>
+static void BM_graph_step(benchmark::State &state) {
+  using namespace ScalarNS;
+  GraphContext<T> ctx;
+  for (auto _ : state) {
+    {
+      GraphScope<T> scope(ctx);
+      auto x = make_scalar<T>(0.5);
+      auto w = make_scalar<T>(0.9);
+      auto b = make_scalar<T>(0.1);
+      auto out = recurrence(x, w, b, state.range(0));
+      backpropagate({out});
+      benchmark::DoNotOptimize(w->grad);
+    }
+    ctx.reset();
+  }
+  state.counters["nodes/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * (3 * state.range(0) + 3)),
+      benchmark::Counter::kIsRate);
+}
+
+template <typename T>
+static void BM_tape_step(benchmark::State &state) {
+  using namespace TapeNS;
+  Tape<T> tape;
+  for (auto _ : state) {
+    tape.clear();
+    auto x = make_scalar<T>(tape, 0.5);
+    auto w = make_scalar<T>(tape, 0.9);
+    auto b = make_scalar<T>(tape, 0.1);
+    auto out = recurrence(x, w, b, state.range(0));
+    backpropagate({out});
+    benchmark::DoNotOptimize(w->grad);
+  }
+  state.counters["nodes/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * (3 * state.range(0) + 3)),
+      benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(BM_graph_step<float>)->RangeMultiplier(8)->Range(64, 32768);
+BENCHMARK(BM_tape_step<float>)->RangeMultiplier(8)->Range(64, 32768);
+BENCHMARK(BM_graph_step<double>)->RangeMultiplier(8)->Range(64, 32768);
+BENCHMARK(BM_tape_step<double>)->RangeMultiplier(8)->Range(64, 32768);
@@ -0,0 +1,41 @@
+#include "gen-vis.hpp"
+#include "scalar.hpp"
+#include <benchmark/benchmark.h>
+#include <ostream>
+#include <streambuf>
+using namespace ScalarNS;
+
+// drops everything, so only the export is timed
+struct NullBuffer : std::streambuf {
+  int overflow(int c) override { return c; }
+  std::streamsize xsputn(const char *, std::streamsize n) override { return n; }
+};
+
+// width neurons over 16 shared inputs, summed
+static Scalar<double> build_layer(std::int64_t width) {
+  std::vector<Scalar<double>> x;
+  for (int i = 0; i < 16; ++i) x.push_back(make_scalar<double>(0.1 * i, fmt::format("x.{}", i)));
+  Scalar<double> total;
+  for (std::int64_t j = 0; j < width; ++j) {
+    auto acc = x[0] * make_scalar<double>(0.5, "w.0");
+    for (int i = 1; i < 16; ++i) {
+      acc = acc + x[i] * make_scalar<double>(0.5, "w.1");
+    }
+    total = j == 0 ? tanh(acc) : total + tanh(acc);
+  }
+  return total;
+}
+
+static void BM_write_dot(benchmark::State &state) {
+  auto out = build_layer(state.range(0));
+  NullBuffer buffer;
+  std::ostream null(&buffer);
+  std::size_t nodes = 0;
+  for (auto _ : state) {
+    nodes = write_dot(null, out, {.collapse = state.range(1) != 0, .cluster_separator = '.'});
+  }
+  state.counters["nodes/s"] = benchmark::Counter(
+      static_cast<double>(state.iterations() * nodes), benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(BM_write_dot)->ArgsProduct({{64, 4096}, {0, 1}})->Unit(benchmark::kMillisecond);
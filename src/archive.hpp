@@ -0,0 +1,337 @@
+#pragma once
+#include "plan.hpp"
+#include "tape.hpp"
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <fmt/format.h>
+#include <fstream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <vector>
+
+// binary model files: the tape of a captured plan (op codes, operand
+// indices, pow immediates, values) and optionally the node labels, each in
+// its own 64 byte aligned section so a mapped file can be used as is.
+//
+//   ArchiveNS::save("model.hg", PlanNS::capture({loss}));
+//   ...
+//   ArchiveNS::Mapped<float> model("model.hg");
+//   model.value("w1") = 0.5f;   // parameters live in the mapping
+//   model.forward();
+//   model.backward();           // model.grads
+//
+// save writes the tape's arrays straight to the stream. loading maps the
+// file copy-on-write and checks only the header and section bounds, so it
+// takes the same time for any model size and pages are read as the passes
+// touch them; values written afterwards stay in memory and never reach the
+// file. verify() checks every operand index when a file isn't trusted.
+// sections are in native byte order and a file only loads for the element
+// type it was saved with.
+namespace ArchiveNS {
+
+constexpr std::array<char, 8> magic = {'H', 'U', 'G', 'E', 'G', 'R', 'A', 'D'};
+constexpr std::uint32_t version = 1;
+constexpr std::uint32_t byte_order = 0x01020304;
+constexpr std::size_t alignment = 64;
+
+struct Section {
+  std::uint64_t offset = 0;
+  std::uint64_t bytes = 0;
+};
+
+struct Header {
+  std::array<char, 8> magic;
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  // sizeof(T) and 0 for floating point, 1 for signed, 2 for unsigned
+  std::uint32_t value_size;
+  std::uint32_t value_kind;
+  std::uint64_t entries;
+  std::uint64_t outputs;
+  Section code, lhs, rhs, aux, imm, value, output;
+  // entries + 1 offsets into label_chars, both empty without labels
+  Section label_offsets, label_chars;
+};
+static_assert(std::is_trivially_copyable_v<Header>);
+
+template <typename T>
+constexpr std::uint32_t value_kind =
+    std::is_floating_point_v<T> ? 0 : (std::is_signed_v<T> ? 1 : 2);
+
+inline std::uint64_t align_up(std::uint64_t n) {
+  return (n + alignment - 1) / alignment * alignment;
+}
+
+// writes a plan, with the labels of its captured nodes when labels is set
+template <typename T>
+void save(std::ostream &out, const PlanNS::Plan<T> &plan, bool labels = true) {
+  const auto &tape = plan.tape;
+  const std::uint64_t n = tape.size();
+  // entry -> label of its node, pointers into the graph
+  std::vector<const std::string *> names;
+  std::uint64_t chars = 0;
+  if (labels) {
+    names.assign(n, nullptr);
+    for (const auto &[node, entry] : plan.slots) {
+      if (!node->label.empty()) {
+        names[entry] = &node->label;
+        chars += node->label.size();
+      }
+    }
+  }
+
+  Header header{};
+  header.magic = magic;
+  header.version = version;
+  header.byte_order = byte_order;
+  header.value_size = sizeof(T);
+  header.value_kind = value_kind<T>;
+  header.entries = n;
+  header.outputs = plan.outputs.size();
+  std::uint64_t end = align_up(sizeof(Header));
+  auto place = [&end](Section &s, std::uint64_t bytes) {
+    s = {end, bytes};
+    end = align_up(end + bytes);
+  };
+  place(header.code, n * sizeof(Operation::OpCode));
+  place(header.lhs, n * sizeof(std::uint32_t));
+  place(header.rhs, n * sizeof(std::uint32_t));
+  place(header.aux, n * sizeof(std::uint32_t));
+  place(header.imm, n * sizeof(T));
+  place(header.value, n * sizeof(T));
+  place(header.output, plan.outputs.size() * sizeof(std::uint32_t));
+  if (labels) {
+    place(header.label_offsets, (n + 1) * sizeof(std::uint64_t));
+    place(header.label_chars, chars);
+  }
+
+  std::uint64_t at = 0;
+  auto write = [&](const void *data, std::uint64_t bytes) {
+    out.write(static_cast<const char *>(data), static_cast<std::streamsize>(bytes));
+    at += bytes;
+  };
+  auto pad_to = [&](std::uint64_t offset) {
+    static constexpr std::array<char, alignment> zeros{};
+    write(zeros.data(), offset - at);
+  };
+  write(&header, sizeof(Header));
+  pad_to(header.code.offset);
+  write(tape.code.data(), header.code.bytes);
+  pad_to(header.lhs.offset);
+  write(tape.lhs.data(), header.lhs.bytes);
+  pad_to(header.rhs.offset);
+  write(tape.rhs.data(), header.rhs.bytes);
+  pad_to(header.aux.offset);
+  write(tape.aux.data(), header.aux.bytes);
+  pad_to(header.imm.offset);
+  write(tape.imm.data(), header.imm.bytes);
+  pad_to(header.value.offset);
+  write(tape.value.data(), header.value.bytes);
+  pad_to(header.output.offset);
+  write(plan.outputs.data(), header.output.bytes);
+  if (labels) {
+    pad_to(header.label_offsets.offset);
+    std::uint64_t offset = 0;
+    write(&offset, sizeof offset);
+    for (auto name : names) {
+      offset += name ? name->size() : 0;
+      write(&offset, sizeof offset);
+    }
+    pad_to(header.label_chars.offset);
+    for (auto name : names) {
+      if (name) {
+        write(name->data(), name->size());
+      }
+    }
+  }
+  if (!out) {
+    throw new std::runtime_error("failed to write the model");
+  }
+}
+
+template <typename T>
+void save(const std::string &path, const PlanNS::Plan<T> &plan, bool labels = true) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) {
+    throw new std::runtime_error(fmt::format("unable to open {}", path));
+  }
+  save(out, plan, labels);
+}
+
+// a saved plan mapped into memory, run in place
+template <typename T>
+struct Mapped {
+  std::span<const Operation::OpCode> code;
+  std::span<const std::uint32_t> lhs;
+  std::span<const std::uint32_t> rhs;
+  std::span<const std::uint32_t> aux;
+  std::span<const T> imm;
+  // the mapping itself, copy-on-write
+  std::span<T> values;
+  std::span<const std::uint32_t> outputs;
+  // allocated by the first backward
+  std::vector<T> grads;
+
+  explicit Mapped(const std::string &path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw new std::runtime_error(fmt::format("unable to open {}", path));
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<std::uint64_t>(st.st_size) < sizeof(Header)) {
+      ::close(fd);
+      throw new std::runtime_error(fmt::format("{} is not a model file", path));
+    }
+    length = static_cast<std::size_t>(st.st_size);
+    void *p = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+      throw new std::runtime_error(fmt::format("unable to map {}", path));
+    }
+    base = static_cast<char *>(p);
+    try {
+      attach(path);
+    } catch (...) {
+      ::munmap(base, length);
+      throw;
+    }
+  }
+  Mapped(const Mapped &) = delete;
+  Mapped &operator=(const Mapped &) = delete;
+  ~Mapped() { ::munmap(base, length); }
+
+  std::size_t size() const { return code.size(); }
+
+  // "" for unlabelled nodes or files saved without labels
+  std::string_view label(std::size_t entry) const {
+    if (label_offsets.empty()) {
+      return {};
+    }
+    return label_chars.substr(label_offsets[entry], label_offsets[entry + 1] - label_offsets[entry]);
+  }
+  // first entry with the label
+  std::uint32_t find(std::string_view name) const {
+    for (std::size_t e = 0; !label_offsets.empty() && e < size(); ++e) {
+      if (label(e) == name) {
+        return static_cast<std::uint32_t>(e);
+      }
+    }
+    throw new std::runtime_error(fmt::format("no node labelled {}", name));
+  }
+  T &value(std::string_view name) { return values[find(name)]; }
+  T &grad(std::string_view name) { return grads.at(find(name)); }
+  T &output(std::size_t i = 0) { return values[outputs[i]]; }
+
+  TapeNS::View<T> view() {
+    return {size(), code.data(), lhs.data(), rhs.data(), aux.data(),
+            imm.data(), values.data(), grads.data()};
+  }
+
+  void forward() { TapeNS::forward(view()); }
+
+  // gradients of this pass only, like Plan::backward
+  void backward() {
+    if (size() == 0 || outputs.empty()) {
+      return;
+    }
+    if (grads.size() != size()) {
+      grads.assign(size(), T(0));
+    } else {
+      std::fill(grads.begin(), grads.end(), T(0));
+    }
+    std::uint32_t last = 0;
+    for (auto o : outputs) {
+      grads[o] = 1;
+      last = std::max(last, o);
+    }
+    TapeNS::backward_from(view(), last);
+  }
+
+  // every op code known, every operand recorded before its use and the
+  // labels in order
+  void verify() const {
+    for (std::size_t n = 0; n < size(); ++n) {
+      // checkpoints can't be captured, so can't be saved either
+      if (code[n] >= Operation::OpCode::CHECKPOINT) {
+        throw new std::runtime_error(fmt::format("entry {} has an unknown op", n));
+      }
+      const auto type = Operation::op_type(code[n]);
+      const bool bad = (type != Operation::OpType::NONE && lhs[n] >= n) ||
+                       ((type == Operation::OpType::BINARY ||
+                         type == Operation::OpType::TERNARY) && rhs[n] >= n) ||
+                       (type == Operation::OpType::TERNARY && aux[n] >= n);
+      if (bad) {
+        throw new std::runtime_error(fmt::format("entry {} reads an operand out of order", n));
+      }
+    }
+    for (auto o : outputs) {
+      if (o >= size()) {
+        throw new std::runtime_error("an output is out of range");
+      }
+    }
+    for (std::size_t n = 0; n < label_offsets.size(); ++n) {
+      if (label_offsets[n] > label_chars.size() || (n > 0 && label_offsets[n] < label_offsets[n - 1])) {
+        throw new std::runtime_error("the labels are damaged");
+      }
+    }
+  }
+
+private:
+  char *base = nullptr;
+  std::size_t length = 0;
+  std::span<const std::uint64_t> label_offsets;
+  std::string_view label_chars;
+
+  template <typename U>
+  std::span<U> section(const Section &s, std::uint64_t count, const std::string &path) {
+    // count comes from the header: bound it before multiplying so a damaged
+    // one can't wrap around to a size that fits
+    if (count > length / sizeof(U) || s.offset % alignment != 0 ||
+        s.bytes != count * sizeof(U) || s.offset > length || s.bytes > length - s.offset) {
+      throw new std::runtime_error(fmt::format("{} has a damaged section", path));
+    }
+    return {reinterpret_cast<U *>(base + s.offset), static_cast<std::size_t>(count)};
+  }
+
+  void attach(const std::string &path) {
+    Header h;
+    std::memcpy(&h, base, sizeof h);
+    if (h.magic != magic) {
+      throw new std::runtime_error(fmt::format("{} is not a model file", path));
+    }
+    if (h.version != version || h.byte_order != byte_order) {
+      throw new std::runtime_error(
+          fmt::format("{} is version {} in another byte order or format", path, h.version));
+    }
+    if (h.value_size != sizeof(T) || h.value_kind != value_kind<T>) {
+      throw new std::runtime_error(fmt::format("{} holds a different element type", path));
+    }
+    const auto n = h.entries;
+    code = section<const Operation::OpCode>(h.code, n, path);
+    lhs = section<const std::uint32_t>(h.lhs, n, path);
+    rhs = section<const std::uint32_t>(h.rhs, n, path);
+    aux = section<const std::uint32_t>(h.aux, n, path);
+    imm = section<const T>(h.imm, n, path);
+    values = section<T>(h.value, n, path);
+    outputs = section<const std::uint32_t>(h.output, h.outputs, path);
+    if (h.label_offsets.bytes != 0) {
+      label_offsets = section<const std::uint64_t>(h.label_offsets, n + 1, path);
+      auto chars = section<const char>(h.label_chars, h.label_chars.bytes, path);
+      if (label_offsets.back() != chars.size()) {
+        throw new std::runtime_error(fmt::format("{} has a damaged section", path));
+      }
+      label_chars = std::string_view(chars.data(), chars.size());
+    }
+  }
+};
+
+} // namespace ArchiveNS
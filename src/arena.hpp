@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// region allocator for graph nodes.
+// nodes are constructed back to back inside large chunks, so a graph built
+// in one pass sits contiguously in memory. nothing is freed per node:
+// reset() tears the whole region down in one linear sweep and keeps the
+// chunks around so the next graph reuses the same memory.
+template <typename Node>
+struct Arena {
+private:
+  struct Chunk {
+    Node *nodes;
+    std::size_t capacity;
+    std::size_t used;
+  };
+  std::vector<Chunk> chunks;
+  // index of the chunk currently being filled
+  std::size_t current = 0;
+  std::size_t chunk_nodes;
+
+  void add_chunk() {
+    Node *mem = std::allocator<Node>().allocate(chunk_nodes);
+    chunks.push_back({mem, chunk_nodes, 0});
+  }
+
+public:
+  static constexpr std::size_t default_chunk_nodes = 4096;
+
+  explicit Arena(std::size_t chunk_nodes = default_chunk_nodes)
+      : chunk_nodes(chunk_nodes == 0 ? 1 : chunk_nodes) {}
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+  ~Arena() { release(); }
+
+  template <typename... Args>
+  Node *create(Args &&...args) {
+    if (chunks.empty()) {
+      add_chunk();
+    }
+    if (chunks[current].used == chunks[current].capacity) {
+      if (++current == chunks.size()) {
+        add_chunk();
+      }
+    }
+    Chunk &c = chunks[current];
+    Node *node = ::new (static_cast<void *>(c.nodes + c.used))
+        Node(std::forward<Args>(args)...);
+    ++c.used;
+    return node;
+  }
+
+  // destroys every node but keeps the chunks for reuse
+  void reset() {
+    for (auto &c : chunks) {
+      if constexpr (!std::is_trivially_destructible_v<Node>) {
+        for (std::size_t i = 0; i < c.used; ++i) {
+          c.nodes[i].~Node();
+        }
+      }
+      c.used = 0;
+    }
+    current = 0;
+  }
+
+  // destroys every node and gives the chunks back to the system
+  void release() {
+    reset();
+    for (auto &c : chunks) {
+      std::allocator<Node>().deallocate(c.nodes, c.capacity);
+    }
+    chunks.clear();
+  }
+
+  // visits every live node in allocation order, a linear sweep per chunk
+  template <typename F>
+  void for_each(F f) {
+    for (auto &c : chunks) {
+      for (std::size_t i = 0; i < c.used; ++i) {
+        f(c.nodes[i]);
+      }
+    }
+  }
+
+  std::size_t size() const {
+    std::size_t n = 0;
+    for (const auto &c : chunks) {
+      n += c.used;
+    }
+    return n;
+  }
+
+  std::size_t bytes_reserved() const {
+    return chunks.size() * chunk_nodes * sizeof(Node);
+  }
+};
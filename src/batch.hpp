@@ -0,0 +1,141 @@
+#pragma once
+#include "plan.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+// one captured graph over a batch of samples.
+// every tape entry gets a row of `lanes` contiguous values and gradients,
+// one per sample, and each op runs over the whole row through the array
+// kernels (Operation::forward_n / backward_operand_n), so a model written
+// with Scalar<T> is traced once and evaluated for many inputs with
+// vectorized inner loops instead of being rebuilt per sample.
+//
+//   auto plan = PlanNS::capture({loss});
+//   PlanNS::Batch<double> batch(plan, 1024);
+//   std::copy(xs.begin(), xs.end(), batch.value(x).begin());
+//   batch.forward();
+//   batch.backward();
+//   batch.grad_sum(w);  // d sum of losses / d w
+//
+// leaves start with their captured value in every lane. lane i computes
+// exactly what the plan computes for sample i, bit for bit.
+// the batch reads the plan's tape, so the plan has to outlive it.
+namespace PlanNS {
+
+template <typename T>
+struct Batch {
+  const Plan<T> &plan;
+  std::size_t lanes;
+  // entry-major, row e holds the lanes of tape entry e
+  std::vector<T> values;
+  // empty for INFERENCE
+  std::vector<T> grads;
+  Mode mode;
+
+  Batch(const Plan<T> &plan, std::size_t lanes, Mode mode = Mode::TRAINING)
+      : plan(plan), lanes(lanes), values(plan.size() * lanes),
+        grads(mode == Mode::TRAINING ? plan.size() * lanes : 0), mode(mode) {
+    if (lanes == 0) {
+      throw new std::runtime_error("a batch needs at least one lane");
+    }
+    for (std::size_t e = 0; e < plan.size(); ++e) {
+      std::fill_n(values.begin() + e * lanes, lanes, plan.tape.value[e]);
+    }
+  }
+  Batch(const Batch &) = delete;
+  Batch &operator=(const Batch &) = delete;
+
+  std::size_t size() const { return plan.size(); }
+
+  std::span<T> value_row(std::uint32_t e) { return {values.data() + e * lanes, lanes}; }
+  std::span<T> grad_row(std::uint32_t e) {
+    if (mode != Mode::TRAINING) {
+      throw new std::runtime_error("an inference batch keeps no gradients");
+    }
+    return {grads.data() + e * lanes, lanes};
+  }
+
+  std::uint32_t entry(const ScalarNS::Scalar<T> &node) const {
+    auto it = plan.slots.find(node.get());
+    if (it == plan.slots.end()) {
+      throw new std::runtime_error("node is not part of the captured graph");
+    }
+    return it->second;
+  }
+  // per sample values and gradients of a captured node
+  std::span<T> value(const ScalarNS::Scalar<T> &node) { return value_row(entry(node)); }
+  std::span<T> grad(const ScalarNS::Scalar<T> &node) { return grad_row(entry(node)); }
+  std::span<T> output(std::size_t i = 0) { return value_row(plan.outputs.at(i)); }
+
+  // gradient of the summed outputs, reduced across the batch in lane order
+  T grad_sum(const ScalarNS::Scalar<T> &node) {
+    T sum = 0;
+    for (T g : grad(node)) {
+      sum += g;
+    }
+    return sum;
+  }
+
+  void forward() {
+    const auto &tape = plan.tape;
+    for (std::uint32_t n = 0; n < size(); ++n) {
+      const auto type = Operation::op_type(tape.code[n]);
+      if (type == Operation::OpType::NONE) {
+        continue;
+      }
+      std::span<const T> third;
+      if (type == Operation::OpType::TERNARY) {
+        third = value_row(tape.aux[n]);
+      }
+      Operation::forward_n<T>(tape.code[n], tape.imm[n], value_row(tape.lhs[n]),
+                              value_row(tape.rhs[n]), third, value_row(n));
+    }
+  }
+
+  // per lane gradients of this pass only, the sweep of Plan::backward
+  void backward() {
+    if (mode != Mode::TRAINING) {
+      throw new std::runtime_error("an inference batch can't run backward");
+    }
+    const auto &tape = plan.tape;
+    std::fill(grads.begin(), grads.end(), T(0));
+    if (size() == 0 || plan.outputs.empty()) {
+      return;
+    }
+    std::uint32_t last = 0;
+    for (auto o : plan.outputs) {
+      std::fill_n(grads.begin() + o * lanes, lanes, T(1));
+      last = std::max(last, o);
+    }
+    for (std::size_t n = last + 1; n-- > 0;) {
+      const auto code = tape.code[n];
+      const auto type = Operation::op_type(code);
+      if (type == Operation::OpType::NONE) {
+        continue;
+      }
+      std::span<const T> g = grad_row(n);
+      std::span<const T> l = value_row(tape.lhs[n]);
+      std::span<const T> r = value_row(tape.rhs[n]);
+      std::span<const T> a;
+      if (type == Operation::OpType::TERNARY) {
+        a = value_row(tape.aux[n]);
+      }
+      Operation::backward_operand_n<T>(code, tape.imm[n], g, 0, l, r, a,
+                                       grad_row(tape.lhs[n]));
+      if (type == Operation::OpType::UNARY) {
+        continue;
+      }
+      Operation::backward_operand_n<T>(code, tape.imm[n], g, 1, l, r, a,
+                                       grad_row(tape.rhs[n]));
+      if (type == Operation::OpType::TERNARY) {
+        Operation::backward_operand_n<T>(code, tape.imm[n], g, 2, l, r, a,
+                                         grad_row(tape.aux[n]));
+      }
+    }
+  }
+};
+
+} // namespace PlanNS
@@ -0,0 +1,86 @@
+#pragma once
+#include "scalar.hpp"
+#include "topo.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+// gradient checkpointing.
+// checkpoint(x, f) evaluates f(x) on a private copy of x, keeps only the
+// result as one CHECKPOINT node and frees the segment's nodes. when
+// backpropagate reaches the node, the segment is built again from x's
+// value and differentiated on the spot. long chains then hold one node per
+// segment instead of every activation, for about one extra forward pass.
+//
+// f may read its argument and leaves such as parameters, which receive
+// their gradients during the recompute. it must not read other interior
+// nodes of the outer graph, pass those through the argument instead.
+// segments are built on the heap even under a GraphScope or CseScope,
+// otherwise their nodes would outlive the segment. so are the checkpoint
+// nodes, which own their segment (see CheckpointValue).
+namespace ScalarNS {
+
+// turns off arena allocation and hash consing for its lifetime
+template <typename T>
+struct Detached {
+  GraphContext<T> *graph = active_graph<T>;
+  CseTable<T> *cse = active_cse<T>;
+  Detached() {
+    active_graph<T> = nullptr;
+    active_cse<T> = nullptr;
+  }
+  Detached(const Detached &) = delete;
+  Detached &operator=(const Detached &) = delete;
+  ~Detached() {
+    active_graph<T> = graph;
+    active_cse<T> = cse;
+  }
+};
+
+template <typename T, typename F>
+struct FunctionSegment : Segment<T> {
+  F f;
+  explicit FunctionSegment(F f) : f(std::move(f)) {}
+
+  T forward(T input) {
+    Detached<T> detached;
+    return f(make_scalar<T>(input))->data;
+  }
+  T backward(T grad, T input) override {
+    Detached<T> detached;
+    auto in = make_scalar<T>(input);
+    auto out = f(in);
+    backpropagate(out, grad);
+    return in->grad;
+  }
+};
+
+// f: Scalar<T> -> Scalar<T>
+template <typename T, typename F>
+Scalar<T> checkpoint(Scalar<T> input, F f) {
+  auto segment = std::make_unique<FunctionSegment<T, F>>(std::move(f));
+  const T value = segment->forward(input->data);
+  return std::make_shared<CheckpointValue<T>>(value, std::move(input), std::move(segment));
+}
+
+// applies step to x steps times, checkpointing every `every` steps. memory
+// goes as steps / every nodes plus one segment of every steps during
+// backward, so every near sqrt(steps) keeps both small.
+template <typename T, typename F>
+Scalar<T> checkpoint_sequence(Scalar<T> x, std::size_t steps, std::size_t every,
+                              F step) {
+  every = std::max<std::size_t>(every, 1);
+  for (std::size_t done = 0; done < steps; done += every) {
+    const std::size_t n = std::min(every, steps - done);
+    x = checkpoint(x, [step, n](Scalar<T> y) {
+      for (std::size_t i = 0; i < n; ++i) {
+        y = step(y);
+      }
+      return y;
+    });
+  }
+  return x;
+}
+
+} // namespace ScalarNS
@@ -0,0 +1,158 @@
+#pragma once
+#include "operation.hpp"
+#include <array>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <functional>
+
+// forward mode autodiff with dual numbers.
+// a Dual carries a value and its derivatives with respect to N inputs
+// through +, *, pow, tanh and exp, with no graph: one evaluation of f gives
+// the derivative of every output, which beats a graph and a backward sweep
+// when there are fewer inputs than outputs.
+//
+//   auto cube_p = DualNS::derivative<float>([](auto x) { return x * x * x; });
+//   cube_p(2.0f);  // 12, a std::function<float(float)> like ::derivative
+//
+// values are the ones the scalar ops compute; tangents follow the same
+// formulas as their backward, so they agree with reverse mode to rounding.
+namespace DualNS {
+
+template <typename T>
+concept arithmetic = std::integral<T> || std::floating_point<T>;
+
+template <typename T, std::size_t N = 1>
+struct Dual {
+  T value = 0;
+  // d value / d input i
+  std::array<T, N> tangent{};
+
+  constexpr Dual() = default;
+  // a constant, all tangents 0
+  constexpr Dual(T value) : value(value) {}
+  constexpr Dual(T value, std::array<T, N> tangent) : value(value), tangent(tangent) {}
+
+  // input number i of N
+  static constexpr Dual input(T value, std::size_t i = 0) {
+    Dual d(value);
+    d.tangent[i] = 1;
+    return d;
+  }
+};
+
+// tangent of op(x) is scale * x.tangent
+template <typename T, std::size_t N>
+constexpr Dual<T, N> chain(T value, T scale, const Dual<T, N> &x) {
+  Dual<T, N> out(value);
+  for (std::size_t i = 0; i < N; ++i) {
+    out.tangent[i] = scale * x.tangent[i];
+  }
+  return out;
+}
+
+template <typename T, std::size_t N>
+constexpr Dual<T, N> operator+(const Dual<T, N> &left, const Dual<T, N> &right) {
+  Dual<T, N> out(left.value + right.value);
+  for (std::size_t i = 0; i < N; ++i) {
+    out.tangent[i] = left.tangent[i] + right.tangent[i];
+  }
+  return out;
+}
+template <typename T, std::size_t N, arithmetic K>
+constexpr Dual<T, N> operator+(K left, const Dual<T, N> &right) {
+  return Dual<T, N>(static_cast<T>(left)) + right;
+}
+template <typename T, std::size_t N, arithmetic K>
+constexpr Dual<T, N> operator+(const Dual<T, N> &left, K right) {
+  return left + Dual<T, N>(static_cast<T>(right));
+}
+
+template <typename T, std::size_t N>
+constexpr Dual<T, N> operator*(const Dual<T, N> &left, const Dual<T, N> &right) {
+  Dual<T, N> out(left.value * right.value);
+  for (std::size_t i = 0; i < N; ++i) {
+    out.tangent[i] = left.tangent[i] * right.value + right.tangent[i] * left.value;
+  }
+  return out;
+}
+template <typename T, std::size_t N, arithmetic K>
+constexpr Dual<T, N> operator*(K left, const Dual<T, N> &right) {
+  return chain(static_cast<T>(left) * right.value, static_cast<T>(left), right);
+}
+template <typename T, std::size_t N, arithmetic K>
+constexpr Dual<T, N> operator*(const Dual<T, N> &left, K right) {
+  return chain(left.value * static_cast<T>(right), static_cast<T>(right), left);
+}
+
+template <typename T, std::size_t N>
+constexpr Dual<T, N> operator-(const Dual<T, N> &arg) {
+  return arg * -1;
+}
+template <typename T, std::size_t N>
+constexpr Dual<T, N> operator-(const Dual<T, N> &left, const Dual<T, N> &right) {
+  return left + -right;
+}
+template <typename T, std::size_t N, arithmetic K>
+constexpr Dual<T, N> operator-(K left, const Dual<T, N> &right) {
+  return left + -right;
+}
+template <typename T, std::size_t N, arithmetic K>
+constexpr Dual<T, N> operator-(const Dual<T, N> &left, K right) {
+  return left + -static_cast<T>(right);
+}
+
+template <typename T, std::size_t N>
+Dual<T, N> pow(const Dual<T, N> &arg, T power) {
+  return chain(std::pow(arg.value, power), power * std::pow(arg.value, power - 1), arg);
+}
+
+template <std::floating_point T, std::size_t N>
+Dual<T, N> operator/(const Dual<T, N> &num, const Dual<T, N> &den) {
+  return num * pow(den, static_cast<T>(-1.0));
+}
+template <std::floating_point T, std::size_t N, arithmetic K>
+Dual<T, N> operator/(const Dual<T, N> &num, K den) {
+  return num * pow(Dual<T, N>(static_cast<T>(den)), static_cast<T>(-1.0));
+}
+template <std::floating_point T, std::size_t N, arithmetic K>
+Dual<T, N> operator/(K num, const Dual<T, N> &den) {
+  return static_cast<T>(num) * pow(den, static_cast<T>(-1.0));
+}
+
+template <typename T, std::size_t N>
+Dual<T, N> tanh(const Dual<T, N> &arg) {
+  const T t = Operation::my_tanh(arg.value);
+  return chain(t, 1 - std::pow(t, 2), arg);
+}
+
+template <typename T, std::size_t N>
+Dual<T, N> exp(const Dual<T, N> &arg) {
+  const T e = Operation::my_exp(arg.value);
+  return chain(e, e, arg);
+}
+
+template <std::floating_point T, std::size_t N>
+Dual<T, N> tanh_exp(const Dual<T, N> &val) {
+  return (exp(static_cast<T>(2.0) * val) - static_cast<T>(1.0)) /
+         (exp(static_cast<T>(2.0) * val) + static_cast<T>(1.0));
+}
+
+// f' as a std::function<T(T)>, the exact counterpart of ::derivative.
+// f takes and returns Dual<T>, a generic lambda does.
+template <typename T, typename F>
+std::function<T(T)> derivative(F f) {
+  return [f](T x) { return f(Dual<T>::input(x)).tangent[0]; };
+}
+
+// value and gradient of f: R^N -> R in one evaluation
+template <typename T, std::size_t N, typename F>
+Dual<T, N> gradient(F f, const std::array<T, N> &x) {
+  std::array<Dual<T, N>, N> inputs;
+  for (std::size_t i = 0; i < N; ++i) {
+    inputs[i] = Dual<T, N>::input(x[i], i);
+  }
+  return f(inputs);
+}
+
+} // namespace DualNS
@@ -0,0 +1,283 @@
+#pragma once
+#include "scalar.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+
+// expression templates for formulas whose shape is known at compile time.
+// the operators build a nested value type instead of graph nodes: every
+// subexpression keeps its value, computed when it is built, and backward
+// walks the type applying the chain rule, so value and gradient come out
+// of one inlined function with no allocation.
+//
+//   auto x = ExprNS::var<0>(1.5);
+//   auto r = ExprNS::eval(tanh_exp(x));  // r.value, r.grad[0]
+//
+// leaves are numbered at compile time, eval returns one gradient per
+// index. each op does the same arithmetic as its ScalarValue counterpart, so
+// values match the graph exactly; gradients of an input used more than once
+// may be summed in a different order.
+namespace ExprNS {
+
+template <typename E>
+concept Expression = requires { typename E::is_expression; };
+
+template <typename T>
+concept arithmetic = std::integral<T> || std::floating_point<T>;
+
+// input number I
+template <std::size_t I, typename T>
+struct Var {
+  using is_expression = void;
+  using value_type = T;
+  static constexpr std::size_t arity = I + 1;
+  T value;
+  constexpr explicit Var(T value) : value(value) {}
+  template <std::size_t N>
+  constexpr void backward(T grad, std::array<T, N> &out) const {
+    out[I] += grad;
+  }
+};
+
+template <typename T>
+struct Const {
+  using is_expression = void;
+  using value_type = T;
+  static constexpr std::size_t arity = 0;
+  T value;
+  constexpr explicit Const(T value) : value(value) {}
+  template <std::size_t N>
+  constexpr void backward(T, std::array<T, N> &) const {}
+};
+
+template <Expression L, Expression R>
+struct Add {
+  using is_expression = void;
+  using value_type = typename L::value_type;
+  using T = value_type;
+  static constexpr std::size_t arity = std::max(L::arity, R::arity);
+  L left;
+  R right;
+  T value;
+  constexpr Add(L left, R right)
+      : left(left), right(right), value(left.value + right.value) {}
+  template <std::size_t N>
+  constexpr void backward(T grad, std::array<T, N> &out) const {
+    left.backward(grad, out);
+    right.backward(grad, out);
+  }
+};
+
+template <Expression L, Expression R>
+struct Mul {
+  using is_expression = void;
+  using value_type = typename L::value_type;
+  using T = value_type;
+  static constexpr std::size_t arity = std::max(L::arity, R::arity);
+  L left;
+  R right;
+  T value;
+  constexpr Mul(L left, R right)
+      : left(left), right(right), value(left.value * right.value) {}
+  template <std::size_t N>
+  constexpr void backward(T grad, std::array<T, N> &out) const {
+    left.backward(grad * right.value, out);
+    right.backward(grad * left.value, out);
+  }
+};
+
+template <Expression E>
+struct Pow {
+  using is_expression = void;
+  using value_type = typename E::value_type;
+  using T = value_type;
+  static constexpr std::size_t arity = E::arity;
+  E arg;
+  T power;
+  T value;
+  constexpr Pow(E arg, T power)
+      : arg(arg), power(power), value(std::pow(arg.value, power)) {}
+  template <std::size_t N>
+  constexpr void backward(T grad, std::array<T, N> &out) const {
+    arg.backward(power * grad * std::pow(arg.value, power - 1), out);
+  }
+};
+
+template <Expression E>
+struct Tanh {
+  using is_expression = void;
+  using value_type = typename E::value_type;
+  using T = value_type;
+  static constexpr std::size_t arity = E::arity;
+  E arg;
+  T value;
+  constexpr explicit Tanh(E arg)
+      : arg(arg), value(Operation::my_tanh(arg.value)) {}
+  template <std::size_t N>
+  constexpr void backward(T grad, std::array<T, N> &out) const {
+    arg.backward((1 - std::pow(value, 2)) * grad, out);
+  }
+};
+
+template <Expression E>
+struct Exp {
+  using is_expression = void;
+  using value_type = typename E::value_type;
+  using T = value_type;
+  static constexpr std::size_t arity = E::arity;
+  E arg;
+  T value;
+  constexpr explicit Exp(E arg) : arg(arg), value(Operation::my_exp(arg.value)) {}
+  template <std::size_t N>
+  constexpr void backward(T grad, std::array<T, N> &out) const {
+    arg.backward(value * grad, out);
+  }
+};
+
+template <std::size_t I, typename T>
+constexpr Var<I, T> var(T value) {
+  return Var<I, T>(value);
+}
+
+// input number I, taking the current value of a graph node
+template <std::size_t I, typename T>
+Var<I, T> var(const ScalarNS::Scalar<T> &node) {
+  return Var<I, T>(node->data);
+}
+
+template <Expression L, Expression R>
+constexpr auto operator+(L left, R right) {
+  return Add<L, R>(left, right);
+}
+template <Expression E, arithmetic K>
+constexpr auto operator+(K left, E right) {
+  using T = typename E::value_type;
+  return Const<T>(static_cast<T>(left)) + right;
+}
+template <Expression E, arithmetic K>
+constexpr auto operator+(E left, K right) {
+  using T = typename E::value_type;
+  return left + Const<T>(static_cast<T>(right));
+}
+
+template <Expression L, Expression R>
+constexpr auto operator*(L left, R right) {
+  return Mul<L, R>(left, right);
+}
+template <Expression E, arithmetic K>
+constexpr auto operator*(K left, E right) {
+  using T = typename E::value_type;
+  return Const<T>(static_cast<T>(left)) * right;
+}
+template <Expression E, arithmetic K>
+constexpr auto operator*(E left, K right) {
+  using T = typename E::value_type;
+  return left * Const<T>(static_cast<T>(right));
+}
+
+template <Expression E>
+constexpr auto operator-(E arg) {
+  return arg * -1;
+}
+template <Expression L, Expression R>
+constexpr auto operator-(L left, R right) {
+  return left + -right;
+}
+template <Expression E, arithmetic K>
+constexpr auto operator-(K left, E right) {
+  return left + -right;
+}
+template <Expression E, arithmetic K>
+constexpr auto operator-(E left, K right) {
+  return left + -right;
+}
+
+template <Expression E>
+constexpr auto pow(E arg, typename E::value_type power) {
+  return Pow<E>(arg, power);
+}
+
+template <Expression L, Expression R>
+  requires std::floating_point<typename R::value_type>
+constexpr auto operator/(L num, R den) {
+  using T = typename R::value_type;
+  return num * pow(den, static_cast<T>(-1.0));
+}
+
+template <Expression E>
+constexpr auto tanh(E arg) {
+  return Tanh<E>(arg);
+}
+
+template <Expression E>
+constexpr auto exp(E arg) {
+  return Exp<E>(arg);
+}
+
+template <Expression E>
+  requires std::floating_point<typename E::value_type>
+constexpr auto tanh_exp(E val) {
+  using T = typename E::value_type;
+  return (exp(static_cast<T>(2.0) * val) - static_cast<T>(1.0)) /
+         (exp(static_cast<T>(2.0) * val) + static_cast<T>(1.0));
+}
+
+template <typename T, std::size_t N>
+struct Result {
+  T value;
+  // d value / d input i
+  std::array<T, N> grad;
+};
+
+template <Expression E>
+constexpr auto eval(const E &expr) {
+  using T = typename E::value_type;
+  Result<T, E::arity> result{expr.value, {}};
+  expr.backward(T(1), result.grad);
+  return result;
+}
+
+// puts a fused expression into the dynamic graph, with inputs[i] as input
+// number i. each input goes through a LINEAR node holding its local
+// derivative g_i at the current values, and the terms are summed, so
+// gradients flowing into the result reach the inputs. the last node holds
+// the expression's exact value: a one input expression is a single LINEAR
+// node, N inputs take N LINEAR nodes and N - 1 adds.
+// the nodes don't follow later changes to the inputs' data: build them
+// again after they change. PlanNS::capture (and everything replayed from
+// it) rejects graphs with these nodes, a replay would only give the
+// linearization f(x0) + g . (x - x0), not f.
+template <Expression E, typename T, std::size_t N>
+ScalarNS::Scalar<T> materialize(const E &expr,
+                                std::array<ScalarNS::Scalar<T>, N> inputs) {
+  static_assert(N == E::arity, "one graph node per expression input");
+  static_assert(N > 0, "a constant expression has nothing to attach to");
+  const auto result = eval(expr);
+  ScalarNS::Scalar<T> none;
+  if constexpr (N == 1) {
+    return ScalarNS::make_scalar(result.value, inputs[0], none, Operation::OpCode::LINEAR,
+                                 result.grad[0]);
+  } else {
+    auto sum = ScalarNS::apply(Operation::OpCode::LINEAR, inputs[0], none, result.grad[0]);
+    for (std::size_t i = 1; i + 1 < N; ++i) {
+      auto term = ScalarNS::apply(Operation::OpCode::LINEAR, inputs[i], none,
+                                  result.grad[i]);
+      sum = ScalarNS::apply(Operation::OpCode::ADD, sum, term);
+    }
+    auto last = ScalarNS::apply(Operation::OpCode::LINEAR, inputs[N - 1], none,
+                                result.grad[N - 1]);
+    // made outside any CseScope's table, its value isn't the sum's
+    return ScalarNS::make_scalar(result.value, sum, last, Operation::OpCode::ADD);
+  }
+}
+
+template <Expression E, typename T, typename... Rest>
+ScalarNS::Scalar<T> materialize(const E &expr, ScalarNS::Scalar<T> first,
+                                Rest... rest) {
+  return materialize(expr,
+                     std::array<ScalarNS::Scalar<T>, 1 + sizeof...(Rest)>{first, rest...});
+}
+
+} // namespace ExprNS
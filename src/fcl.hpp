@@ -1,13 +1,114 @@
 #pragma once
-#include "scalar.hpp"
+#include "gemm.hpp"
 #include "initialization.hpp"
+#include "operation.hpp"
+#include "tensor.hpp"
+#include <cmath>
+#include <fmt/format.h>
+#include <span>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
-// TODO naive Scalar version
-// TODO optimized CPU version
+// fully connected layer, y = act(x W + b) for a batch of rows x.
+// the whole layer is a single TensorValue whose backward produces dX, dW
+// and db with two GEMMs and a column sum, instead of O(in * out) scalar
+// nodes.
 // TODO optimized GPU version
 template <typename T>
-struct Neuron
-{
-  std::vector<Scalar<T>>
+struct Dense {
+  std::size_t in_features;
+  std::size_t out_features;
+  // [in_features, out_features]
+  TensorNS::TensorPtr<T> weight;
+  // [out_features]
+  TensorNS::TensorPtr<T> bias;
+  // unary op applied to every output, nullptr for a linear layer
+  Operation::Operation<T> *activation;
+
+  template <typename Init>
+    requires requires(Init &init, T *p, std::size_t n) { init.init_range(p, n); }
+  Dense(std::size_t in_features, std::size_t out_features, Init &&init,
+        Operation::Operation<T> *activation = nullptr)
+      : in_features(in_features), out_features(out_features),
+        activation(activation) {
+    TensorNS::Tensor<T> w({in_features, out_features});
+    init.init_range(w.data(), w.size());
+    weight = TensorNS::make_tensor(w, "weight");
+    bias = TensorNS::make_tensor(TensorNS::Tensor<T>({out_features}), "bias");
+  }
+
+  // uniform in +-1/sqrt(in_features)
+  Dense(std::size_t in_features, std::size_t out_features,
+        Operation::Operation<T> *activation = nullptr)
+      : Dense(in_features, out_features,
+              UniformFloatInit<T>(-1 / std::sqrt(static_cast<T>(in_features)),
+                                  1 / std::sqrt(static_cast<T>(in_features))),
+              activation) {}
+
+  // x: [batch, in_features] -> [batch, out_features]
+  TensorNS::TensorPtr<T> operator()(TensorNS::TensorPtr<T> x) const {
+    const auto &xd = x->data;
+    if (xd.ndim() != 2 || xd.shape[1] != in_features) {
+      throw new std::runtime_error(
+          fmt::format("Dense expects [batch, {}] input", in_features));
+    }
+    const std::size_t batch = xd.shape[0];
+    // pre-activation, kept for the backward pass when there is an activation
+    TensorNS::Tensor<T> pre({batch, out_features});
+    const T *b = bias->data.data();
+    for (std::size_t r = 0; r < batch; ++r) {
+      std::copy(b, b + out_features, pre.data() + r * out_features);
+    }
+    Gemm::gemm(batch, out_features, in_features, view(xd),
+               Gemm::row_major(weight->data.data(), out_features), pre.data(),
+               out_features);
+    TensorNS::Tensor<T> out = pre;
+    if (activation) {
+      out = TensorNS::Tensor<T>(pre.shape);
+      const std::size_t n = pre.size();
+      activation->forward_n({pre.data(), n}, {}, {out.data(), n});
+    }
+    auto act = activation;
+    auto node = std::make_shared<TensorNS::TensorValue<T>>(
+        out, std::vector<TensorNS::TensorPtr<T>>{x, weight, bias},
+        Operation::none_ptr<T>,
+        [pre, act, batch, in = in_features, outf = out_features](
+            TensorNS::TensorValue<T> &node) {
+          auto &x = *node.children[0];
+          auto &w = *node.children[1];
+          auto &b = *node.children[2];
+          const std::size_t n = batch * outf;
+          // gradient with respect to the pre-activation
+          TensorNS::Tensor<T> dpre = node.grad;
+          if (act) {
+            dpre = TensorNS::Tensor<T>(pre.shape);
+            act->backward_n({node.grad.data(), n}, {pre.data(), n}, {},
+                            {dpre.data(), n});
+          }
+          // dW += x^T dpre
+          Gemm::gemm(in, outf, batch, transposed(x.data),
+                     Gemm::row_major(dpre.data(), outf), w.grad.data(), outf);
+          // dX += dpre W^T, x.grad is contiguous
+          Gemm::gemm(batch, in, outf, Gemm::row_major(dpre.data(), outf),
+                     Gemm::row_major(w.data.data(), outf, true), x.grad.data(),
+                     in);
+          // db += column sums of dpre
+          for (std::size_t r = 0; r < batch; ++r) {
+            Kernels::acc(dpre.data() + r * outf, b.grad.data(), outf);
+          }
+        });
+    node->label = "dense";
+    return node;
+  }
+
+  std::vector<TensorNS::TensorPtr<T>> parameters() const { return {weight, bias}; }
+
+private:
+  static Gemm::View<T> view(const TensorNS::Tensor<T> &t) {
+    return {t.data(), t.strides[0], t.strides[1]};
+  }
+  static Gemm::View<T> transposed(const TensorNS::Tensor<T> &t) {
+    return {t.data(), t.strides[1], t.strides[0]};
+  }
 };
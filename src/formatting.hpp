@@ -11,7 +11,7 @@ struct fmt::formatter<ScalarNS::ScalarValue<T>> : formatter<string_view> {
       -> decltype(ctx.out()) {
     // ctx.out() is an output iterator to write to.
     return fmt::format_to(ctx.out(), "{}(data={}, grad={}, op={})", sv.label,
-                          sv.data, sv.grad, *sv.op, sv.op->get_type());
+                          sv.data, sv.grad, Operation::symbol<T>(sv.code));
   }
 };
 
@@ -48,7 +48,85 @@ template <> struct fmt::formatter<Operation::OpType> : formatter<string_view> {
       return fmt::format_to(ctx.out(), "UNARY");
     case Operation::OpType::BINARY:
       return fmt::format_to(ctx.out(), "BINARY");
+    case Operation::OpType::TERNARY:
+      return fmt::format_to(ctx.out(), "TERNARY");
     }
     return ctx.out();
   }
 };
+
+template <> struct fmt::formatter<Operation::OpCode> : formatter<string_view> {
+
+  template <typename FormatContext>
+  auto format(const Operation::OpCode &code, FormatContext &ctx) const
+      -> decltype(ctx.out()) {
+    switch (code) {
+    case Operation::OpCode::NONE:
+      return fmt::format_to(ctx.out(), "NONE");
+    case Operation::OpCode::ADD:
+      return fmt::format_to(ctx.out(), "ADD");
+    case Operation::OpCode::MUL:
+      return fmt::format_to(ctx.out(), "MUL");
+    case Operation::OpCode::POW:
+      return fmt::format_to(ctx.out(), "POW");
+    case Operation::OpCode::TANH:
+      return fmt::format_to(ctx.out(), "TANH");
+    case Operation::OpCode::EXP:
+      return fmt::format_to(ctx.out(), "EXP");
+    case Operation::OpCode::LINEAR:
+      return fmt::format_to(ctx.out(), "LINEAR");
+    case Operation::OpCode::DIV:
+      return fmt::format_to(ctx.out(), "DIV");
+    case Operation::OpCode::FMA:
+      return fmt::format_to(ctx.out(), "FMA");
+    case Operation::OpCode::CHECKPOINT:
+      return fmt::format_to(ctx.out(), "CHECKPOINT");
+    }
+    return ctx.out();
+  }
+};
+
+template <> struct fmt::formatter<ProfileNS::Pass> : formatter<string_view> {
+
+  template <typename FormatContext>
+  auto format(const ProfileNS::Pass &pass, FormatContext &ctx) const
+      -> decltype(ctx.out()) {
+    return fmt::format_to(ctx.out(), "{}",
+                          pass == ProfileNS::Pass::FORWARD ? "forward" : "backward");
+  }
+};
+
+// the profile as three tables: ops, labelled nodes and passes, slowest first
+template <> struct fmt::formatter<ProfileNS::Report> : formatter<string_view> {
+
+  template <typename FormatContext>
+  auto format(const ProfileNS::Report &report, FormatContext &ctx) const
+      -> decltype(ctx.out()) {
+    auto out = ctx.out();
+    auto row = [&out](std::string_view first, std::string_view second,
+                      const ProfileNS::OpStats &stats) {
+      const double ms = static_cast<double>(stats.ns) / 1e6;
+      const double per_call = stats.calls ? static_cast<double>(stats.ns) / stats.calls : 0.0;
+      out = fmt::format_to(out, "{:<10} {:<20} {:>12} {:>12.3f} {:>10.1f}\n", first, second,
+                           stats.calls, ms, per_call);
+    };
+    out = fmt::format_to(out, "{:<10} {:<20} {:>12} {:>12} {:>10}\n", "pass", "op", "calls",
+                         "total ms", "ns/call");
+    for (const auto &op : report.ops) {
+      row(fmt::format("{}", op.pass), fmt::format("{}", op.code), op.stats);
+    }
+    if (!report.labels.empty()) {
+      out = fmt::format_to(out, "\n{:<10} {:<20}\n", "pass", "label");
+      for (const auto &l : report.labels) {
+        row("backward", l.label, l.stats);
+      }
+    }
+    if (!report.passes.empty()) {
+      out = fmt::format_to(out, "\n{:<10} {:<20}\n", "", "phase");
+      for (const auto &p : report.passes) {
+        row("", p.name, p.stats);
+      }
+    }
+    return out;
+  }
+};
@@ -0,0 +1,263 @@
+#pragma once
+#include "plan.hpp"
+#include <cmath>
+#include <concepts>
+#include <cstdint>
+#include <initializer_list>
+#include <unordered_map>
+#include <vector>
+
+// rewrites chains of small ops on a captured plan into fused ones:
+//   tanh_exp(x)         (exp(2x) - 1) * pow(exp(2x) + 1, -1) -> tanh(x)
+//   x / y               x * pow(y, -1)                       -> div(x, y)
+//   a * b + c                                                -> fma(a, b, c)
+//   pow(pow(x, a), b)   integer a and b                      -> pow(x, a * b)
+// the first two only apply to floating point plans. an intermediate is
+// only folded away when nothing else reads it. leaves that aren't listed as
+// inputs are constants: their value may be matched (the 2 and the 1s of
+// tanh_exp) and they are dropped once unused.
+// the fused ops round differently from the chains they replace, so values
+// and gradients agree to a few ulps, not bit for bit.
+// entries move, so fuse before handing out Vars.
+namespace PlanNS {
+
+template <typename T>
+struct Fusion {
+  TapeNS::Tape<T> &tape;
+  // outputs and inputs, never removed or treated as constants
+  std::vector<bool> pinned;
+  // readers of every entry, counted once more than needed after a rewrite
+  std::vector<std::uint32_t> uses;
+
+  Fusion(Plan<T> &plan, const std::vector<ScalarNS::Scalar<T>> &inputs)
+      : tape(plan.tape), pinned(plan.size(), false), uses(plan.size(), 0) {
+    for (auto o : plan.outputs) {
+      pinned[o] = true;
+    }
+    for (const auto &i : inputs) {
+      pinned[plan.slots.at(i.get())] = true;
+    }
+    for (std::size_t n = 0; n < tape.size(); ++n) {
+      switch (Operation::op_type(tape.code[n])) {
+      case Operation::OpType::TERNARY:
+        ++uses[tape.aux[n]];
+        [[fallthrough]];
+      case Operation::OpType::BINARY:
+        ++uses[tape.rhs[n]];
+        [[fallthrough]];
+      case Operation::OpType::UNARY:
+        ++uses[tape.lhs[n]];
+        break;
+      case Operation::OpType::NONE:
+        break;
+      }
+    }
+  }
+
+  bool is(std::uint32_t n, Operation::OpCode c) const { return tape.code[n] == c; }
+  // an intermediate only n reads
+  bool private_to_one(std::uint32_t n) const { return uses[n] == 1 && !pinned[n]; }
+  bool is_constant(std::uint32_t n, T v) const {
+    return is(n, Operation::OpCode::NONE) && !pinned[n] && tape.value[n] == v;
+  }
+
+  void rewrite(std::uint32_t n, Operation::OpCode c, std::uint32_t l, std::uint32_t r,
+               T imm = 0, std::uint32_t a = 0) {
+    tape.code[n] = c;
+    tape.lhs[n] = l;
+    tape.rhs[n] = r;
+    tape.aux[n] = a;
+    tape.imm[n] = imm;
+    ++uses[l];
+    if (r != l) {
+      ++uses[r];
+    }
+  }
+
+  // e = exp(2 * x) with e and the product private, returns x
+  bool exp_of_twice(std::uint32_t e, std::uint32_t &x) const {
+    using Operation::OpCode;
+    if (!is(e, OpCode::EXP) || !private_to_one(e)) {
+      return false;
+    }
+    const auto m = tape.lhs[e];
+    if (!is(m, OpCode::MUL) || !private_to_one(m)) {
+      return false;
+    }
+    if (is_constant(tape.lhs[m], T(2))) {
+      x = tape.rhs[m];
+      return true;
+    }
+    if (is_constant(tape.rhs[m], T(2))) {
+      x = tape.lhs[m];
+      return true;
+    }
+    return false;
+  }
+
+  // s = exp(2 * x) + c, returns x
+  bool exp_plus(std::uint32_t s, T c, std::uint32_t &x) const {
+    using Operation::OpCode;
+    if (!is(s, OpCode::ADD) || !private_to_one(s)) {
+      return false;
+    }
+    return (is_constant(tape.rhs[s], c) && exp_of_twice(tape.lhs[s], x)) ||
+           (is_constant(tape.lhs[s], c) && exp_of_twice(tape.rhs[s], x));
+  }
+
+  // p = pow(y, -1) with p private, returns y. floating point only: for
+  // integers a truncated pow(y, -1) times x isn't x / y
+  bool reciprocal(std::uint32_t p, std::uint32_t &y) const {
+    if constexpr (!std::floating_point<T>) {
+      return false;
+    }
+    if (!is(p, Operation::OpCode::POW) || !private_to_one(p) || tape.imm[p] != T(-1)) {
+      return false;
+    }
+    y = tape.lhs[p];
+    return true;
+  }
+
+  bool fuse_tanh(std::uint32_t n) {
+    std::uint32_t num_x, den_x, den;
+    if (!is(n, Operation::OpCode::MUL) || !reciprocal(tape.rhs[n], den) ||
+        !exp_plus(tape.lhs[n], T(-1), num_x) || !exp_plus(den, T(1), den_x) ||
+        num_x != den_x) {
+      return false;
+    }
+    rewrite(n, Operation::OpCode::TANH, num_x, num_x);
+    return true;
+  }
+
+  bool fuse_div(std::uint32_t n) {
+    std::uint32_t y;
+    if (!is(n, Operation::OpCode::MUL)) {
+      return false;
+    }
+    if (reciprocal(tape.rhs[n], y)) {
+      rewrite(n, Operation::OpCode::DIV, tape.lhs[n], y);
+      return true;
+    }
+    if (reciprocal(tape.lhs[n], y)) {
+      rewrite(n, Operation::OpCode::DIV, tape.rhs[n], y);
+      return true;
+    }
+    return false;
+  }
+
+  bool fuse_fma(std::uint32_t n) {
+    using Operation::OpCode;
+    if (!is(n, OpCode::ADD)) {
+      return false;
+    }
+    auto try_side = [&](std::uint32_t m, std::uint32_t c) {
+      if (!is(m, OpCode::MUL) || !private_to_one(m)) {
+        return false;
+      }
+      rewrite(n, OpCode::FMA, tape.lhs[m], tape.rhs[m], 0, c);
+      ++uses[c];
+      return true;
+    };
+    return try_side(tape.lhs[n], tape.rhs[n]) || try_side(tape.rhs[n], tape.lhs[n]);
+  }
+
+  bool fuse_pow(std::uint32_t n) {
+    using Operation::OpCode;
+    if (!is(n, OpCode::POW)) {
+      return false;
+    }
+    const auto p = tape.lhs[n];
+    const T a = tape.imm[p];
+    const T b = tape.imm[n];
+    // (x^a)^b is x^(ab) for any x only with integer exponents
+    if (!is(p, OpCode::POW) || !private_to_one(p) || a != std::trunc(a) ||
+        b != std::trunc(b)) {
+      return false;
+    }
+    rewrite(n, OpCode::POW, tape.lhs[p], tape.lhs[p], a * b);
+    return true;
+  }
+
+  void run() {
+    for (std::uint32_t n = 0; n < tape.size(); ++n) {
+      fuse_tanh(n) || fuse_div(n) || fuse_fma(n) || fuse_pow(n);
+    }
+  }
+};
+
+// returns the number of entries removed from the plan
+template <typename T>
+std::size_t fuse(Plan<T> &plan, const std::vector<ScalarNS::Scalar<T>> &inputs) {
+  Fusion<T>(plan, inputs).run();
+
+  // keep what the pinned entries still read, then close the gaps
+  auto &tape = plan.tape;
+  const std::size_t before = tape.size();
+  std::vector<bool> live(before, false);
+  for (auto o : plan.outputs) {
+    live[o] = true;
+  }
+  for (const auto &i : inputs) {
+    live[plan.slots.at(i.get())] = true;
+  }
+  for (std::size_t n = before; n-- > 0;) {
+    if (!live[n]) {
+      continue;
+    }
+    switch (Operation::op_type(tape.code[n])) {
+    case Operation::OpType::TERNARY:
+      live[tape.aux[n]] = true;
+      [[fallthrough]];
+    case Operation::OpType::BINARY:
+      live[tape.rhs[n]] = true;
+      [[fallthrough]];
+    case Operation::OpType::UNARY:
+      live[tape.lhs[n]] = true;
+      break;
+    case Operation::OpType::NONE:
+      break;
+    }
+  }
+  std::vector<std::uint32_t> moved(before, 0);
+  std::uint32_t next = 0;
+  for (std::size_t n = 0; n < before; ++n) {
+    if (!live[n]) {
+      continue;
+    }
+    moved[n] = next;
+    tape.code[next] = tape.code[n];
+    tape.lhs[next] = moved[tape.lhs[n]];
+    tape.rhs[next] = moved[tape.rhs[n]];
+    tape.aux[next] = moved[tape.aux[n]];
+    tape.imm[next] = tape.imm[n];
+    tape.value[next] = tape.value[n];
+    tape.grad[next] = tape.grad[n];
+    ++next;
+  }
+  tape.code.resize(next);
+  tape.lhs.resize(next);
+  tape.rhs.resize(next);
+  tape.aux.resize(next);
+  tape.imm.resize(next);
+  tape.value.resize(next);
+  tape.grad.resize(next);
+  for (auto &o : plan.outputs) {
+    o = moved[o];
+  }
+  for (auto it = plan.slots.begin(); it != plan.slots.end();) {
+    if (live[it->second]) {
+      it->second = moved[it->second];
+      ++it;
+    } else {
+      it = plan.slots.erase(it);
+    }
+  }
+  return before - next;
+}
+
+template <typename T>
+std::size_t fuse(Plan<T> &plan, std::initializer_list<ScalarNS::Scalar<T>> inputs) {
+  return fuse(plan, std::vector<ScalarNS::Scalar<T>>(inputs));
+}
+
+} // namespace PlanNS
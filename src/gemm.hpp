@@ -0,0 +1,187 @@
+#pragma once
+#include "kernels.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+// cache blocked matrix multiply, C += A * B.
+// A and B are read through element strides, so a transposed operand is
+// just swapped strides. B is packed into KC x NR panels that stay in L2/L3,
+// A into MC x KC blocks of MR-row panels that stay in L1/L2, and a
+// register-tiled MR x NR microkernel walks the packed panels.
+namespace Gemm {
+
+template <typename T>
+struct View {
+  const T *data;
+  std::ptrdiff_t row_stride;
+  std::ptrdiff_t col_stride;
+  const T &operator()(std::size_t r, std::size_t c) const {
+    return data[static_cast<std::ptrdiff_t>(r) * row_stride +
+                static_cast<std::ptrdiff_t>(c) * col_stride];
+  }
+};
+
+// row-major rows x cols matrix, optionally transposed
+template <typename T>
+View<T> row_major(const T *data, std::size_t cols, bool transposed = false) {
+  const auto ld = static_cast<std::ptrdiff_t>(cols);
+  return transposed ? View<T>{data, 1, ld} : View<T>{data, ld, 1};
+}
+
+constexpr std::size_t MC = 120;
+constexpr std::size_t KC = 256;
+constexpr std::size_t NC = 3072;
+
+// panel of MR rows of A, column after column, zero padded
+template <typename T, std::size_t MR>
+void pack_a(View<T> a, std::size_t i0, std::size_t k0, std::size_t mc,
+            std::size_t kc, T *out) {
+  for (std::size_t ir = 0; ir < mc; ir += MR) {
+    const std::size_t mr = std::min(MR, mc - ir);
+    for (std::size_t k = 0; k < kc; ++k) {
+      for (std::size_t i = 0; i < MR; ++i) {
+        *out++ = i < mr ? a(i0 + ir + i, k0 + k) : T(0);
+      }
+    }
+  }
+}
+
+// panel of NR columns of B, row after row, zero padded
+template <typename T, std::size_t NR>
+void pack_b(View<T> b, std::size_t k0, std::size_t j0, std::size_t kc,
+            std::size_t nc, T *out) {
+  for (std::size_t jr = 0; jr < nc; jr += NR) {
+    const std::size_t nr = std::min(NR, nc - jr);
+    for (std::size_t k = 0; k < kc; ++k) {
+      for (std::size_t j = 0; j < NR; ++j) {
+        *out++ = j < nr ? b(k0 + k, j0 + jr + j) : T(0);
+      }
+    }
+  }
+}
+
+template <typename T, std::size_t MR, std::size_t NR>
+void store_tile(const T (&acc)[MR][NR], T *c, std::size_t ldc, std::size_t mr,
+                std::size_t nr) {
+  for (std::size_t i = 0; i < mr; ++i) {
+    for (std::size_t j = 0; j < nr; ++j) {
+      c[i * ldc + j] += acc[i][j];
+    }
+  }
+}
+
+// plain loops, left to the auto-vectorizer
+template <typename T>
+struct PortableKernel {
+  static constexpr std::size_t MR = 4;
+  static constexpr std::size_t NR = 8;
+  static void run(std::size_t kc, const T *a, const T *b, T *c, std::size_t ldc,
+                  std::size_t mr, std::size_t nr) {
+    T acc[MR][NR] = {};
+    for (std::size_t k = 0; k < kc; ++k, a += MR, b += NR) {
+      for (std::size_t i = 0; i < MR; ++i) {
+        for (std::size_t j = 0; j < NR; ++j) {
+          acc[i][j] += a[i] * b[j];
+        }
+      }
+    }
+    store_tile(acc, c, ldc, mr, nr);
+  }
+};
+
+#if HUGEGRAD_X86_KERNELS
+// 6 x 2 vector registers of accumulators, broadcast A, fused multiply-add
+#define HUGEGRAD_DEFINE_MICROKERNEL(NAME, T, V, W, LOAD, STORE, SET1, FMADD)  \
+  struct NAME {                                                               \
+    static constexpr std::size_t MR = 6;                                      \
+    static constexpr std::size_t NR = 2 * W;                                  \
+    __attribute__((target("avx2,fma"))) static void                           \
+    run(std::size_t kc, const T *a, const T *b, T *c, std::size_t ldc,        \
+        std::size_t mr, std::size_t nr) {                                     \
+      V acc[MR][2];                                                           \
+      for (std::size_t i = 0; i < MR; ++i) {                                  \
+        acc[i][0] = SET1(T(0));                                               \
+        acc[i][1] = SET1(T(0));                                               \
+      }                                                                       \
+      for (std::size_t k = 0; k < kc; ++k, a += MR, b += NR) {                \
+        const V b0 = LOAD(b);                                                 \
+        const V b1 = LOAD(b + W);                                             \
+        _Pragma("GCC unroll 6") for (std::size_t i = 0; i < MR; ++i) {        \
+          const V ai = SET1(a[i]);                                            \
+          acc[i][0] = FMADD(ai, b0, acc[i][0]);                               \
+          acc[i][1] = FMADD(ai, b1, acc[i][1]);                               \
+        }                                                                     \
+      }                                                                       \
+      T tile[MR][NR];                                                         \
+      for (std::size_t i = 0; i < MR; ++i) {                                  \
+        STORE(tile[i], acc[i][0]);                                            \
+        STORE(tile[i] + W, acc[i][1]);                                        \
+      }                                                                       \
+      store_tile(tile, c, ldc, mr, nr);                                       \
+    }                                                                         \
+  };
+
+HUGEGRAD_DEFINE_MICROKERNEL(Avx2KernelF, float, __m256, 8, _mm256_loadu_ps,
+                            _mm256_storeu_ps, _mm256_set1_ps, _mm256_fmadd_ps)
+HUGEGRAD_DEFINE_MICROKERNEL(Avx2KernelD, double, __m256d, 4, _mm256_loadu_pd,
+                            _mm256_storeu_pd, _mm256_set1_pd, _mm256_fmadd_pd)
+#undef HUGEGRAD_DEFINE_MICROKERNEL
+
+inline bool has_fma() {
+  static const bool fma = (__builtin_cpu_init(), __builtin_cpu_supports("fma"));
+  return fma;
+}
+#endif
+
+template <typename T, typename Kernel>
+void blocked(std::size_t m, std::size_t n, std::size_t k, View<T> a, View<T> b,
+             T *c, std::size_t ldc) {
+  constexpr std::size_t MR = Kernel::MR;
+  constexpr std::size_t NR = Kernel::NR;
+  thread_local std::vector<T> packed_a;
+  thread_local std::vector<T> packed_b;
+  packed_a.resize((MC + MR) * KC);
+  packed_b.resize((NC + NR) * KC);
+  for (std::size_t jc = 0; jc < n; jc += NC) {
+    const std::size_t nc = std::min(NC, n - jc);
+    for (std::size_t pc = 0; pc < k; pc += KC) {
+      const std::size_t kc = std::min(KC, k - pc);
+      pack_b<T, NR>(b, pc, jc, kc, nc, packed_b.data());
+      for (std::size_t ic = 0; ic < m; ic += MC) {
+        const std::size_t mc = std::min(MC, m - ic);
+        pack_a<T, MR>(a, ic, pc, mc, kc, packed_a.data());
+        for (std::size_t jr = 0; jr < nc; jr += NR) {
+          const T *bp = packed_b.data() + jr * kc;
+          for (std::size_t ir = 0; ir < mc; ir += MR) {
+            Kernel::run(kc, packed_a.data() + ir * kc, bp,
+                        c + (ic + ir) * ldc + jc + jr, ldc,
+                        std::min(MR, mc - ir), std::min(NR, nc - jr));
+          }
+        }
+      }
+    }
+  }
+}
+
+// C (m x n, row-major with leading dimension ldc) += A (m x k) * B (k x n)
+template <typename T>
+void gemm(std::size_t m, std::size_t n, std::size_t k, View<T> a, View<T> b,
+          T *c, std::size_t ldc) {
+  if (m == 0 || n == 0 || k == 0) {
+    return;
+  }
+#if HUGEGRAD_X86_KERNELS
+  if (Kernels::active_isa() >= Kernels::Isa::AVX2 && has_fma()) {
+    if constexpr (std::is_same_v<T, float>) {
+      return blocked<T, Avx2KernelF>(m, n, k, a, b, c, ldc);
+    } else if constexpr (std::is_same_v<T, double>) {
+      return blocked<T, Avx2KernelD>(m, n, k, a, b, c, ldc);
+    }
+  }
+#endif
+  blocked<T, PortableKernel<T>>(m, n, k, a, b, c, ldc);
+}
+
+} // namespace Gemm
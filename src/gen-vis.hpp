@@ -1,51 +1,197 @@
 #pragma once
 #include "formatting.hpp"
 #include "scalar.hpp"
-#include <cstdlib>
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <fmt/format.h>
 #include <fstream>
-#include <stdlib.h>
+#include <iterator>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
-template <typename T>
-void rec_helper(std::shared_ptr<ScalarNS::ScalarValue<T>> &val, void *parent,
-                std::back_insert_iterator<std::string> c) {
-  void *val_void = static_cast<void *>(val.get());
-  fmt::format_to(c, "id{} [label=\"{}\"]\n", val_void, val);
-  if (parent) {
-    fmt::format_to(c, "id{} -> id{}\n", val_void, parent);
+// graphviz export of a Scalar graph, written straight to a stream.
+// every node is visited once however many paths lead to it, using the
+// nodes' generation marks instead of a visited set, so the time is linear
+// in the nodes and the only extra memory is the traversal's work list.
+// with max_depth the traversal is breadth first, so a node is first
+// reached at its shortest depth and expanded once.
+// each value is a box and each op a separate node, as before:
+//
+//   std::ofstream out("graph.dot");
+//   write_dot(out, loss, {.max_depth = 6, .cluster_separator = '.'});
+//
+// for big graphs:
+// - max_depth stops expanding nodes that many edges below the root; cut
+//   off nodes are drawn dashed
+// - collapse folds a run of the same binary op through child1, as in
+//   a + b + c + d, into one op node "+ x3" with all the operands. a node
+//   inside a run that is also used elsewhere shows up as a bare id there
+// - cluster_separator boxes nodes whose labels share the text before it,
+//   e.g. "layer1.w3" and "layer1.b" with '.'
+struct DotOptions {
+  // 0 is no limit
+  std::size_t max_depth = 0;
+  bool collapse = false;
+  // 0 doesn't cluster
+  char cluster_separator = 0;
+};
+
+namespace VisNS {
+
+// s with " and \ escaped for a quoted dot string
+inline void escape(std::string_view s, fmt::memory_buffer &buf) {
+  buf.clear();
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      buf.push_back('\\');
+    }
+    buf.push_back(c);
   }
-  if (val->op->get_type() != Operation::OpType::NONE) {
-    void *op_id = &val->op;
-    fmt::format_to(c, "id{} [label=\"{}\"]\n id{} -> id{}\n", op_id, val->op->symbol,
-                   op_id, val_void);
-    if (val->child1) {
-      rec_helper(val->child1, op_id, c);
+}
+
+} // namespace VisNS
+
+// writes the graph under root as a dot digraph, returns the nodes visited
+template <typename T>
+std::size_t write_dot(std::ostream &stream, const ScalarNS::Scalar<T> &root,
+                      const DotOptions &options = {}) {
+  using Node = ScalarNS::ScalarValue<T>;
+  // written in chunks of about 64k
+  fmt::memory_buffer chunk;
+  auto out = std::back_inserter(chunk);
+  auto flush = [&] {
+    stream.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+    chunk.clear();
+  };
+  // seen = base + the depth a node was first reached at, capped at
+  // max_depth. without a cap every depth is 0 and a node is done once seen;
+  // with one, breadth first order reaches it at its smallest depth first
+  const std::uint64_t levels = options.max_depth + 1;
+  const std::uint64_t base = ScalarNS::reserve_generations(levels);
+  auto depth_of = [&](const Node *n) -> std::uint64_t {
+    return n->seen >= base && n->seen < base + levels ? n->seen - base : levels;
+  };
+  auto expands = [&](std::uint64_t d) { return options.max_depth == 0 || d < options.max_depth; };
+  auto below = [&](std::uint64_t d) { return std::min<std::uint64_t>(d + 1, options.max_depth); };
+
+  fmt::memory_buffer text;
+  fmt::memory_buffer escaped;
+  // opens the node's cluster if it has one, returns whether it did
+  auto open_cluster = [&](const Node *n) {
+    if (!options.cluster_separator) {
+      return false;
+    }
+    const auto cut = n->label.find(options.cluster_separator);
+    if (cut == std::string::npos || cut == 0) {
+      return false;
+    }
+    VisNS::escape(std::string_view(n->label).substr(0, cut), escaped);
+    fmt::format_to(out, "subgraph \"cluster_{0}\" {{ label=\"{0}\"; ",
+                   fmt::string_view(escaped.data(), escaped.size()));
+    return true;
+  };
+
+  fmt::format_to(out, "digraph G {{\nnode [shape=box]\n");
+  std::size_t visited = 0;
+  struct Item {
+    Node *node;
+    std::uint64_t depth;
+  };
+  // a stack without a depth limit, a queue with one
+  std::deque<Item> work{{root.get(), 0}};
+  const bool breadth_first = options.max_depth != 0;
+  while (!work.empty()) {
+    if (chunk.size() > (1 << 16)) {
+      flush();
+    }
+    Item item;
+    if (breadth_first) {
+      item = work.front();
+      work.pop_front();
+    } else {
+      item = work.back();
+      work.pop_back();
+    }
+    auto [node, depth] = item;
+    if (depth_of(node) != levels) {
+      continue;
+    }
+    node->seen = base + depth;
+    const void *id = node;
+    const bool leaf = node->code == Operation::OpCode::NONE;
+    ++visited;
+    text.clear();
+    fmt::format_to(std::back_inserter(text), "{}", *node);
+    VisNS::escape(std::string_view(text.data(), text.size()), escaped);
+    const bool cluster = open_cluster(node);
+    fmt::format_to(out, "id{} [label=\"{}\"{}]", id,
+                   fmt::string_view(escaped.data(), escaped.size()),
+                   !leaf && !expands(depth) ? ", style=dashed" : "");
+    fmt::format_to(out, "{}", cluster ? " }\n" : "\n");
+    if (leaf || !expands(depth)) {
+      continue;
+    }
+
+    // the op, or a run of it through child1 when collapsing
+    Node *last = node;
+    std::size_t run = 1;
+    if (options.collapse && Operation::op_type(node->code) == Operation::OpType::BINARY) {
+      while (last->child1->code == node->code && depth_of(last->child1.get()) == levels) {
+        last = last->child1.get();
+        last->seen = base + depth;
+        ++visited;
+        ++run;
+      }
     }
-    if (val->child2) {
-      rec_helper(val->child2, op_id, c);
+    const void *op_id = &node->code;
+    const bool op_cluster = open_cluster(node);
+    fmt::format_to(out, "id{} [label=\"{}{}\", shape=ellipse]", op_id,
+                   Operation::symbol<T>(node->code),
+                   run > 1 ? fmt::format(" x{}", run) : std::string());
+    fmt::format_to(out, "{}", op_cluster ? " }\n" : "\n");
+    fmt::format_to(out, "id{} -> id{}\n", op_id, id);
+    // operands, pushed last first so depth first writes child1's side first
+    for (Node *k = node;; k = k->child1.get()) {
+      if (k->child2) {
+        fmt::format_to(out, "id{} -> id{}\n", static_cast<const void *>(k->child2.get()), op_id);
+        work.push_back({k->child2.get(), below(depth)});
+      }
+      if (k == last) {
+        break;
+      }
     }
+    fmt::format_to(out, "id{} -> id{}\n", static_cast<const void *>(last->child1.get()), op_id);
+    work.push_back({last->child1.get(), below(depth)});
   }
+  fmt::format_to(out, "}}\n");
+  flush();
+  return visited;
+}
+
+template <typename T>
+std::size_t write_dot(const std::string &path, const ScalarNS::Scalar<T> &root,
+                      const DotOptions &options = {}) {
+  std::ofstream file(path, std::ios::out | std::ios::trunc);
+  if (!file) {
+    throw new std::runtime_error(fmt::format("unable to open {}", path));
+  }
+  return write_dot(file, root, options);
 }
 
 template <typename T>
 std::string gen_vis(std::shared_ptr<ScalarNS::ScalarValue<T>> &vis) {
-  std::string result = "";
-  rec_helper(vis, nullptr, std::back_inserter(result));
-  return fmt::format("{}", result);
+  std::ostringstream out;
+  write_dot(out, vis);
+  return out.str();
 }
 
+// writes graphvis.dot; render it with dot -Tsvg graphvis.dot > graphvis.svg
 template <typename T>
 void write_vis(std::shared_ptr<ScalarNS::ScalarValue<T>> &val) {
-  std::ofstream myfile;
-  fmt::print("opening file...\n");
-  myfile.open("graphvis.dot", std::ios::in | std::ios::trunc);
-  if (myfile.good()) {
-    std::string v = gen_vis(val);
-    fmt::print("writing graph...\n");
-    myfile << "digraph G {" << v << "\n}\n";
-    myfile.close();
-    fmt::print("generating svg...\n");
-    system("dot -Tsvg graphvis.dot > graphvis.svg && open graphvis.svg");
-  }
-  else { fmt::print("unable to open file.\n"); }
+  write_dot("graphvis.dot", val);
+  fmt::print("wrote graphvis.dot\n");
 }
@@ -0,0 +1,154 @@
+#pragma once
+#include "batch.hpp"
+#include "derivative.hpp"
+#include "plan.hpp"
+#include "scalar.hpp"
+#include "thread-pool.hpp"
+#include "topo.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+// numerical check of backpropagation over a whole graph.
+// each leaf is moved by +-h and the graph evaluated again for the
+// symmetric difference quotient of derivative(), for every leaf at once:
+// the graph is captured a single time and every perturbed evaluation is a
+// lane of a PlanNS::Batch, so nothing is rebuilt and the forward passes run
+// as vectorized rows. groups of leaves go to different threads when there
+// is a pool.
+//
+//   auto check = gradcheck(loss, params, {.pool = &pool});
+//   EXPECT_LT(check.max_rel_error, 1e-6);
+//
+// with richardson set, the quotients D(h) and D(h / 2) are combined into
+// (4 D(h / 2) - D(h)) / 3, which cancels the h^2 error term, for two more
+// lanes per leaf. analytic gradients are the ones backpropagate gives on
+// the graph itself, so the nodes' own propagate_gradient is what's checked;
+// the leaves' grad fields are restored afterwards, interior ones are left
+// as backpropagate sets them. the plan only serves the perturbed lanes.
+
+template <typename T>
+struct GradCheckOptions {
+  T h = epsilon<T>;
+  bool richardson = false;
+  // relative errors are taken against at least this, so gradients that
+  // cancel to rounding noise aren't reported as 100% off
+  T floor = epsilon<T> * epsilon<T>;
+  ThreadPool *pool = nullptr;
+};
+
+template <typename T>
+struct GradCheck {
+  // per leaf, in the order the leaves were given
+  std::vector<T> analytic;
+  std::vector<T> numeric;
+  T max_abs_error = 0;
+  // |analytic - numeric| / max(|analytic|, |numeric|, floor)
+  T max_rel_error = 0;
+  // leaf with the largest relative error
+  std::size_t worst = 0;
+};
+
+template <typename T>
+GradCheck<T> gradcheck(const ScalarNS::Scalar<T> &root,
+                       const std::vector<ScalarNS::Scalar<T>> &leaves,
+                       GradCheckOptions<T> options = {}) {
+  // throws for checkpointed graphs, their segments can't be replayed
+  auto plan = PlanNS::capture({root});
+  const auto &tape = plan.tape;
+  std::vector<std::uint32_t> entries(leaves.size());
+  for (std::size_t j = 0; j < leaves.size(); ++j) {
+    auto it = plan.slots.find(leaves[j].get());
+    if (it == plan.slots.end()) {
+      throw new std::runtime_error("node is not part of the captured graph");
+    }
+    if (tape.code[it->second] != Operation::OpCode::NONE) {
+      throw new std::runtime_error("gradcheck only perturbs leaves");
+    }
+    entries[j] = it->second;
+  }
+
+  GradCheck<T> result;
+  // leaves accumulate across passes, so they start this one at 0
+  std::vector<std::pair<ScalarNS::Scalar<T>, T>> saved;
+  for (const auto &node : topological_sort({root})) {
+    if (node->num_children() == 0) {
+      saved.emplace_back(node, node->grad);
+      node->grad = 0;
+    }
+  }
+  backpropagate({root});
+  result.analytic.resize(leaves.size());
+  for (std::size_t j = 0; j < leaves.size(); ++j) {
+    result.analytic[j] = leaves[j]->grad;
+  }
+  for (auto &[node, grad] : saved) {
+    node->grad = grad;
+  }
+
+  // lanes per leaf: x + h, x - h, and x + h / 2, x - h / 2 for richardson.
+  // a batch holds about 1 << 22 values, at most 512 lanes
+  const std::size_t per = options.richardson ? 4 : 2;
+  const std::size_t threads = options.pool ? options.pool->size() : 1;
+  std::size_t group = std::clamp<std::size_t>((std::size_t(1) << 22) / (plan.size() * per),
+                                              1, 512 / per);
+  group = std::max<std::size_t>(
+      1, std::min(group, (leaves.size() + threads - 1) / threads));
+  const std::size_t groups = (leaves.size() + group - 1) / group;
+
+  result.numeric.resize(leaves.size());
+  auto check_group = [&](std::size_t g) {
+    const std::size_t first = g * group;
+    const std::size_t last = std::min(leaves.size(), first + group);
+    PlanNS::Batch<T> batch(plan, (last - first) * per, PlanNS::Mode::INFERENCE);
+    const T h = options.h;
+    for (std::size_t j = first; j < last; ++j) {
+      auto row = batch.value_row(entries[j]);
+      const T x = tape.value[entries[j]];
+      const std::size_t lane = (j - first) * per;
+      row[lane] = x + h;
+      row[lane + 1] = x - h;
+      if (options.richardson) {
+        row[lane + 2] = x + h / 2;
+        row[lane + 3] = x - h / 2;
+      }
+    }
+    batch.forward();
+    auto out = batch.output();
+    for (std::size_t j = first; j < last; ++j) {
+      auto row = batch.value_row(entries[j]);
+      const std::size_t lane = (j - first) * per;
+      // divide by the steps actually taken, x + h - x isn't always h
+      const T d = (out[lane] - out[lane + 1]) / (row[lane] - row[lane + 1]);
+      if (!options.richardson) {
+        result.numeric[j] = d;
+        continue;
+      }
+      const T d_half = (out[lane + 2] - out[lane + 3]) / (row[lane + 2] - row[lane + 3]);
+      result.numeric[j] = (4 * d_half - d) / 3;
+    }
+  };
+  if (options.pool && groups > 1) {
+    options.pool->parallel_for(0, groups, 1, check_group);
+  } else {
+    for (std::size_t g = 0; g < groups; ++g) {
+      check_group(g);
+    }
+  }
+
+  for (std::size_t j = 0; j < leaves.size(); ++j) {
+    const T a = result.analytic[j];
+    const T n = result.numeric[j];
+    const T abs_error = std::abs(a - n);
+    const T rel_error = abs_error / std::max({std::abs(a), std::abs(n), options.floor});
+    result.max_abs_error = std::max(result.max_abs_error, abs_error);
+    if (rel_error > result.max_rel_error) {
+      result.max_rel_error = rel_error;
+      result.worst = j;
+    }
+  }
+  return result;
+}
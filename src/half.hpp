@@ -0,0 +1,192 @@
+#pragma once
+#include "derivative.hpp"
+#include "kernels.hpp"
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+
+// 16 bit floating point storage, converted in software:
+// - bf16 is the top half of a float: the same range, 8 significant bits
+// - fp16 is IEEE binary16: 11 significant bits, normal from 6.1e-5 to 65504
+// they only store. arithmetic converts to float, so c = a * b multiplies
+// in fp32 and rounds once, when the result goes back into a 16 bit value.
+// float to 16 bits rounds to nearest even, overflows to inf and keeps NaN
+// a NaN; 16 bits to float is exact.
+//
+//   HalfNS::widen(std::span<const bf16>(row), scratch);   // whole arrays
+//   HalfNS::narrow(std::span<const float>(scratch), row);
+//
+// widen and narrow are vectorized for the instruction set Kernels picked.
+namespace HalfNS {
+
+constexpr std::uint16_t bf16_bits(float f) {
+  const auto u = std::bit_cast<std::uint32_t>(f);
+  const std::uint32_t rounded = (u + 0x7fffu + ((u >> 16) & 1u)) >> 16;
+  // a quiet NaN, rounding could carry a NaN into inf
+  const std::uint32_t nan = (u >> 16) | 0x40u;
+  return static_cast<std::uint16_t>((u & 0x7fffffffu) > 0x7f800000u ? nan : rounded);
+}
+
+constexpr float bf16_value(std::uint16_t h) {
+  return std::bit_cast<float>(static_cast<std::uint32_t>(h) << 16);
+}
+
+// after F. Giesen's float_to_half_fast3_rtne, with the subnormals rounded
+// in integers and no branches, so the array loops vectorize
+constexpr std::uint16_t fp16_bits(float f) {
+  std::uint32_t u = std::bit_cast<std::uint32_t>(f);
+  const std::uint32_t sign = u & 0x80000000u;
+  u ^= sign;
+  // 65536 and up: inf, or a quiet NaN
+  const std::uint32_t big = u > 0x7f800000u ? 0x7e00u : 0x7c00u;
+  // below 2^-14: f * 2^24 rounded, the significand shifted down by at
+  // least 14; 31 already rounds everything to 0. computed for every input,
+  // so the shift is kept in [1, 31] where it isn't used
+  const std::uint32_t m = (u & 0x7fffffu) | 0x800000u;
+  const std::uint32_t shift = std::clamp(126u - std::min(u >> 23, 126u), 1u, 31u);
+  const std::uint32_t small = (m + (1u << (shift - 1)) - 1 + ((m >> shift) & 1u)) >> shift;
+  // normal: rebias the exponent and round to nearest even
+  const std::uint32_t normal = (u + (0u - (112u << 23)) + 0xfffu + ((u >> 13) & 1u)) >> 13;
+  const std::uint32_t o = u >= (143u << 23) ? big : u < (113u << 23) ? small : normal;
+  return static_cast<std::uint16_t>(o | (sign >> 16));
+}
+
+constexpr float fp16_value(std::uint16_t h) {
+  constexpr std::uint32_t exp_mask = 0x7c00u << 13;
+  const std::uint32_t shifted = (static_cast<std::uint32_t>(h) & 0x7fffu) << 13;
+  const std::uint32_t exp = shifted & exp_mask;
+  const std::uint32_t normal = shifted + (112u << 23);
+  // inf and NaN keep an all ones exponent
+  const std::uint32_t special = normal + (112u << 23);
+  // subnormal: renormalized by a float subtraction
+  const std::uint32_t sub = std::bit_cast<std::uint32_t>(
+      std::bit_cast<float>(normal + (1u << 23)) - std::bit_cast<float>(113u << 23));
+  const std::uint32_t o = exp == exp_mask ? special : exp == 0 ? sub : normal;
+  return std::bit_cast<float>(o | (static_cast<std::uint32_t>(h) & 0x8000u) << 16);
+}
+
+struct bf16 {
+  std::uint16_t bits = 0;
+
+  constexpr bf16() = default;
+  constexpr bf16(float f) : bits(bf16_bits(f)) {}
+  constexpr operator float() const { return bf16_value(bits); }
+
+  static constexpr bf16 from_bits(std::uint16_t b) {
+    bf16 h;
+    h.bits = b;
+    return h;
+  }
+};
+
+struct fp16 {
+  std::uint16_t bits = 0;
+
+  constexpr fp16() = default;
+  constexpr fp16(float f) : bits(fp16_bits(f)) {}
+  constexpr operator float() const { return fp16_value(bits); }
+
+  static constexpr fp16 from_bits(std::uint16_t b) {
+    fp16 h;
+    h.bits = b;
+    return h;
+  }
+};
+
+static_assert(sizeof(bf16) == 2 && std::is_trivially_copyable_v<bf16>);
+static_assert(sizeof(fp16) == 2 && std::is_trivially_copyable_v<fp16>);
+
+template <typename H>
+constexpr bool half_type = std::is_same_v<H, bf16> || std::is_same_v<H, fp16>;
+
+template <typename H>
+constexpr bool isfinite(H h) {
+  constexpr std::uint16_t exp_mask = std::is_same_v<H, bf16> ? 0x7f80u : 0x7c00u;
+  return (h.bits & exp_mask) != exp_mask;
+}
+
+namespace Portable {
+template <typename H>
+HUGEGRAD_ALWAYS_INLINE void widen(const H *in, float *out, std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i) out[i] = in[i];
+}
+template <typename H>
+HUGEGRAD_ALWAYS_INLINE void narrow(const float *in, H *out, std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i) out[i] = in[i];
+}
+} // namespace Portable
+
+#if HUGEGRAD_X86_KERNELS
+#define HUGEGRAD_DEFINE_CONVERT(TARGET, H)                                     \
+  __attribute__((target(TARGET))) inline void widen(const H *in, float *out,   \
+                                                    std::size_t n) {           \
+    Portable::widen(in, out, n);                                               \
+  }                                                                            \
+  __attribute__((target(TARGET))) inline void narrow(const float *in, H *out,  \
+                                                     std::size_t n) {          \
+    Portable::narrow(in, out, n);                                              \
+  }
+namespace Sse {
+HUGEGRAD_DEFINE_CONVERT("sse2", bf16)
+HUGEGRAD_DEFINE_CONVERT("sse2", fp16)
+} // namespace Sse
+namespace Avx2 {
+HUGEGRAD_DEFINE_CONVERT("avx2", bf16)
+HUGEGRAD_DEFINE_CONVERT("avx2", fp16)
+} // namespace Avx2
+namespace Avx512 {
+HUGEGRAD_DEFINE_CONVERT("avx512f", bf16)
+HUGEGRAD_DEFINE_CONVERT("avx512f", fp16)
+} // namespace Avx512
+#undef HUGEGRAD_DEFINE_CONVERT
+
+#define HUGEGRAD_CONVERT_DISPATCH(NAME, ...)                                   \
+  switch (Kernels::active_isa()) {                                             \
+  case Kernels::Isa::AVX512:                                                   \
+    return Avx512::NAME(__VA_ARGS__);                                          \
+  case Kernels::Isa::AVX2:                                                     \
+    return Avx2::NAME(__VA_ARGS__);                                            \
+  case Kernels::Isa::SSE:                                                      \
+    return Sse::NAME(__VA_ARGS__);                                             \
+  case Kernels::Isa::SCALAR:                                                   \
+    break;                                                                     \
+  }                                                                            \
+  return Portable::NAME(__VA_ARGS__);
+#else
+#define HUGEGRAD_CONVERT_DISPATCH(NAME, ...) return Portable::NAME(__VA_ARGS__);
+#endif
+
+// out[i] = in[i], exact
+template <typename H>
+void widen(std::span<const H> in, std::span<float> out) {
+  if (in.size() != out.size()) {
+    throw new std::runtime_error("in widen, the spans differ in length");
+  }
+  HUGEGRAD_CONVERT_DISPATCH(widen, in.data(), out.data(), in.size())
+}
+
+// out[i] = in[i], rounded to nearest even
+template <typename H>
+void narrow(std::span<const float> in, std::span<H> out) {
+  if (in.size() != out.size()) {
+    throw new std::runtime_error("in narrow, the spans differ in length");
+  }
+  HUGEGRAD_CONVERT_DISPATCH(narrow, in.data(), out.data(), in.size())
+}
+
+#undef HUGEGRAD_CONVERT_DISPATCH
+
+} // namespace HalfNS
+
+using HalfNS::bf16;
+using HalfNS::fp16;
+
+// about the cube root of the precision, like 0.001 is close to it for
+// float; powers of two, so x + h and x - h are exact near 1
+template <> constexpr bf16 epsilon<bf16> = 0.125f;
+template <> constexpr fp16 epsilon<fp16> = 0.0625f;
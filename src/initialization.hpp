@@ -1,7 +1,14 @@
 #pragma once
-#include <random>
-#include <functional>
+#include "kernels.hpp"
+#include "thread-pool.hpp"
+#include <array>
 #include <cassert>
+#include <cmath>
+#include <concepts>
+#include <cstdint>
+#include <functional>
+#include <numbers>
+#include <random>
 #include <span>
 
 template <typename T>
@@ -19,36 +26,233 @@ struct ZeroInit {
 template <typename T>
 static ZeroInit<T> zero_singleton = ZeroInit<T>();
 
-template <std::floating_point T>
-struct UniformFloatInit {
-  std::default_random_engine generator;
-  std::uniform_real_distribution<T> distribution;
-  UniformFloatInit(T low, T high) : distribution(low, high) {
-    assert(low <= high);
+// counter based generator, Philox4x32-10 (Salmon et al., "Parallel random
+// numbers: as easy as 1, 2, 3"). block n of the stream is a pure function
+// of (seed, n), so any slice of it can be generated on its own: a range
+// split over threads comes out bit for bit as if drawn in one go.
+struct Philox {
+  std::uint32_t k0;
+  std::uint32_t k1;
+
+  explicit Philox(std::uint64_t seed = 0)
+      : k0(static_cast<std::uint32_t>(seed)), k1(static_cast<std::uint32_t>(seed >> 32)) {}
+
+  std::array<std::uint32_t, 4> operator()(std::uint64_t counter) const {
+    std::uint32_t c0 = static_cast<std::uint32_t>(counter);
+    std::uint32_t c1 = static_cast<std::uint32_t>(counter >> 32);
+    std::uint32_t c2 = 0;
+    std::uint32_t c3 = 0;
+    std::uint32_t a = k0;
+    std::uint32_t b = k1;
+    for (int round = 0; round < 10; ++round) {
+      const std::uint64_t p0 = std::uint64_t(0xD2511F53u) * c0;
+      const std::uint64_t p1 = std::uint64_t(0xCD9E8D57u) * c2;
+      const std::uint32_t n0 = static_cast<std::uint32_t>(p1 >> 32) ^ c1 ^ a;
+      const std::uint32_t n2 = static_cast<std::uint32_t>(p0 >> 32) ^ c3 ^ b;
+      c1 = static_cast<std::uint32_t>(p1);
+      c3 = static_cast<std::uint32_t>(p0);
+      c0 = n0;
+      c2 = n2;
+      a += 0x9E3779B9u;
+      b += 0xBB67AE85u;
+    }
+    return {c0, c1, c2, c3};
+  }
+
+  // blocks first ... first + lanes - 1 at once, word k of block first + j
+  // in w[k][j]. the same rounds, run in vector registers
+  static constexpr std::size_t lanes = Kernels::philox_lanes;
+  void operator()(std::uint64_t first, std::uint32_t (&w)[4][lanes]) const {
+    Kernels::philox(k0, k1, first, w);
   }
-  T init() { return distribution(generator); }
+};
+
+// [0, 1) from the top bits of the words
+template <typename T> T unit_interval(std::uint32_t w);
+template <> inline float unit_interval<float>(std::uint32_t w) {
+  return static_cast<float>(w >> 8) * 0x1p-24f;
+}
+template <typename T> T unit_interval(std::uint32_t hi, std::uint32_t lo);
+template <> inline double unit_interval<double>(std::uint32_t hi, std::uint32_t lo) {
+  return static_cast<double>(((std::uint64_t(hi) << 32) | lo) >> 11) * 0x1p-53;
+}
+
+// an initializer over a Philox stream. Derived turns the four words of
+// block n into values per_block * n ... per_block * (n + 1) - 1.
+// init() draws the next value, init_range the next size values, with the
+// same results; init_range_at fills any slice of the stream by position.
+template <typename T, typename Derived>
+struct CounterInit {
+  Philox rng;
+  // position of the next value init() hands out
+  std::uint64_t next = 0;
+
+  explicit CounterInit(std::uint64_t seed) : rng(seed) {}
+
+  T value(std::uint64_t i) const {
+    constexpr std::size_t per = Derived::per_block;
+    std::array<T, per> values;
+    static_cast<const Derived &>(*this).fill_block(rng(i / per), values.data());
+    return values[i % per];
+  }
+  T init() { return value(next++); }
   T operator()() { return init(); }
+
+  // values offset ... offset + size - 1 of the stream
+  void init_range_at(T *to_init, std::size_t size, std::uint64_t offset) const {
+    constexpr std::size_t per = Derived::per_block;
+    const auto &self = static_cast<const Derived &>(*this);
+    std::uint64_t i = offset;
+    const std::uint64_t end = offset + size;
+    // partial blocks at either end one value at a time, whole ones in bulk
+    for (; i < end && i % per != 0; ++i) {
+      *to_init++ = value(i);
+    }
+    std::uint32_t w[4][Philox::lanes];
+    for (; i + per * Philox::lanes <= end; i += per * Philox::lanes) {
+      rng(i / per, w);
+      for (std::size_t j = 0; j < Philox::lanes; ++j, to_init += per) {
+        self.fill_block({w[0][j], w[1][j], w[2][j], w[3][j]}, to_init);
+      }
+    }
+    for (; i + per <= end; i += per, to_init += per) {
+      self.fill_block(rng(i / per), to_init);
+    }
+    for (; i < end; ++i) {
+      *to_init++ = value(i);
+    }
+  }
   void init_range(T *to_init, std::size_t size) {
-    for (std::size_t i = 0; i < size; ++i) {
-      *to_init = init();
-      ++to_init;
+    init_range_at(to_init, size, next);
+    next += size;
+  }
+};
+
+template <std::floating_point T>
+struct UniformFloatInit : CounterInit<T, UniformFloatInit<T>> {
+  static constexpr std::size_t per_block = std::is_same_v<T, double> ? 2 : 4;
+  T low;
+  T high;
+  UniformFloatInit(T low, T high, std::uint64_t seed = 0)
+      : CounterInit<T, UniformFloatInit<T>>(seed), low(low), high(high) {
+    assert(low <= high);
+  }
+  void fill_block(const std::array<std::uint32_t, 4> &w, T *out) const {
+    if constexpr (per_block == 2) {
+      out[0] = low + (high - low) * static_cast<T>(unit_interval<double>(w[0], w[1]));
+      out[1] = low + (high - low) * static_cast<T>(unit_interval<double>(w[2], w[3]));
+    } else {
+      for (std::size_t k = 0; k < 4; ++k) {
+        out[k] = low + (high - low) * static_cast<T>(unit_interval<float>(w[k]));
+      }
     }
   }
 };
 
+// high 64 bits of a * b, from 32 bit limbs
+inline std::uint64_t mul_high(std::uint64_t a, std::uint64_t b) {
+  const std::uint64_t a_lo = a & 0xFFFFFFFFu, a_hi = a >> 32;
+  const std::uint64_t b_lo = b & 0xFFFFFFFFu, b_hi = b >> 32;
+  const std::uint64_t lo_lo = a_lo * b_lo;
+  const std::uint64_t hi_lo = a_hi * b_lo;
+  const std::uint64_t lo_hi = a_lo * b_hi;
+  const std::uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFFu) + lo_hi;
+  return a_hi * b_hi + (hi_lo >> 32) + (cross >> 32);
+}
+
+// [low, high] by multiply and shift, biased by at most range / 2^32.
+// 64 bit T draws two words per value and takes the high half of a 64 x 64
+// bit product, so ranges up to the whole of T (range wraps to 0, i.e.
+// 2^64) come out right; narrower T never needs more than 2^32.
 template <std::integral T>
-struct UniformIntInit {
-  std::default_random_engine generator;
-  std::uniform_int_distribution<T> distribution;
-  UniformIntInit(T low, T high) : distribution(low, high) {
+struct UniformIntInit : CounterInit<T, UniformIntInit<T>> {
+  static constexpr bool wide = sizeof(T) > sizeof(std::uint32_t);
+  static constexpr std::size_t per_block = wide ? 2 : 4;
+  T low;
+  std::uint64_t range;
+  UniformIntInit(T low, T high, std::uint64_t seed = 0)
+      : CounterInit<T, UniformIntInit<T>>(seed), low(low),
+        range(static_cast<std::uint64_t>(high) - static_cast<std::uint64_t>(low) + 1) {
     assert(low <= high);
   }
-  T init() { return distribution(generator); }
-  T operator()() { return init(); }
-  void init_range(T *to_init, std::size_t size) {
-    for (std::size_t i = 0; i < size; ++i) {
-      *to_init = init();
-      ++to_init;
+  std::uint64_t offset(std::uint64_t word) const {
+    return range == 0 ? word : mul_high(word, range);
+  }
+  void fill_block(const std::array<std::uint32_t, 4> &w, T *out) const {
+    // in uint64_t, wrapping: low + offset needn't fit in T until the end
+    if constexpr (wide) {
+      for (std::size_t k = 0; k < 2; ++k) {
+        const std::uint64_t word = (std::uint64_t(w[2 * k]) << 32) | w[2 * k + 1];
+        out[k] = static_cast<T>(static_cast<std::uint64_t>(low) + offset(word));
+      }
+    } else {
+      for (std::size_t k = 0; k < 4; ++k) {
+        out[k] = static_cast<T>(static_cast<std::uint64_t>(low) + ((w[k] * range) >> 32));
+      }
+    }
+  }
+};
+
+// gaussian by Box-Muller, two values per pair of uniforms
+template <std::floating_point T>
+struct NormalInit : CounterInit<T, NormalInit<T>> {
+  static constexpr std::size_t per_block = std::is_same_v<T, double> ? 2 : 4;
+  T mean;
+  T stddev;
+  NormalInit(T mean, T stddev, std::uint64_t seed = 0)
+      : CounterInit<T, NormalInit<T>>(seed), mean(mean), stddev(stddev) {
+    assert(stddev >= 0);
+  }
+  // u1 in (0, 1] keeps the log finite
+  void pair(T u1, T u2, T *out) const {
+    const T r = stddev * std::sqrt(-2 * std::log(1 - u1));
+    const T theta = 2 * std::numbers::pi_v<T> * u2;
+    out[0] = mean + r * std::cos(theta);
+    out[1] = mean + r * std::sin(theta);
+  }
+  void fill_block(const std::array<std::uint32_t, 4> &w, T *out) const {
+    if constexpr (per_block == 2) {
+      pair(static_cast<T>(unit_interval<double>(w[0], w[1])),
+           static_cast<T>(unit_interval<double>(w[2], w[3])), out);
+    } else {
+      pair(unit_interval<float>(w[0]), unit_interval<float>(w[1]), out);
+      pair(unit_interval<float>(w[2]), unit_interval<float>(w[3]), out + 2);
     }
   }
 };
+
+// Glorot & Bengio: variance 2 / (fan_in + fan_out)
+template <std::floating_point T>
+UniformFloatInit<T> xavier_uniform(std::size_t fan_in, std::size_t fan_out,
+                                   std::uint64_t seed = 0) {
+  const T limit = std::sqrt(T(6) / static_cast<T>(fan_in + fan_out));
+  return UniformFloatInit<T>(-limit, limit, seed);
+}
+template <std::floating_point T>
+NormalInit<T> xavier_normal(std::size_t fan_in, std::size_t fan_out, std::uint64_t seed = 0) {
+  return NormalInit<T>(0, std::sqrt(T(2) / static_cast<T>(fan_in + fan_out)), seed);
+}
+
+// He et al.: variance 2 / fan_in, for relu-like activations
+template <std::floating_point T>
+UniformFloatInit<T> kaiming_uniform(std::size_t fan_in, std::uint64_t seed = 0) {
+  const T limit = std::sqrt(T(6) / static_cast<T>(fan_in));
+  return UniformFloatInit<T>(-limit, limit, seed);
+}
+template <std::floating_point T>
+NormalInit<T> kaiming_normal(std::size_t fan_in, std::uint64_t seed = 0) {
+  return NormalInit<T>(0, std::sqrt(T(2) / static_cast<T>(fan_in)), seed);
+}
+
+// init.init_range(to_init, size) split over the pool, same values as the
+// serial call
+template <typename T, typename Init>
+void parallel_init_range(ThreadPool &pool, Init &init, T *to_init, std::size_t size) {
+  constexpr std::size_t chunk = 1 << 16;
+  const std::uint64_t offset = init.next;
+  pool.parallel_for(0, (size + chunk - 1) / chunk, 1, [&](std::size_t c) {
+    const std::size_t begin = c * chunk;
+    init.init_range_at(to_init + begin, std::min(chunk, size - begin), offset + begin);
+  });
+  init.next += size;
+}
@@ -0,0 +1,235 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define HUGEGRAD_X86_KERNELS 1
+#include <immintrin.h>
+#else
+#define HUGEGRAD_X86_KERNELS 0
+#endif
+
+// for the portable loops the instruction set wrappers below inline
+#if defined(__GNUC__) || defined(__clang__)
+#define HUGEGRAD_ALWAYS_INLINE __attribute__((always_inline)) inline
+#else
+#define HUGEGRAD_ALWAYS_INLINE inline
+#endif
+
+// array kernels behind Operation::forward_n / backward_n.
+// every path does exactly the per-element arithmetic of the scalar ops
+// (one rounding per add or mul, never fused), so results are bit for bit
+// the same whichever instruction set is picked at runtime.
+namespace Kernels {
+
+enum class Isa { SCALAR, SSE, AVX2, AVX512 };
+
+inline Isa detect_isa() {
+#if HUGEGRAD_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return Isa::AVX512;
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    return Isa::AVX2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return Isa::SSE;
+  }
+#endif
+  return Isa::SCALAR;
+}
+
+inline const Isa detected_isa = detect_isa();
+inline Isa selected_isa = detected_isa;
+
+// picks the instruction set used by the kernels, capped at what the cpu has.
+// mostly useful to compare the paths against each other.
+inline Isa set_isa(Isa isa) {
+  selected_isa = isa < detected_isa ? isa : detected_isa;
+  return selected_isa;
+}
+inline Isa active_isa() { return selected_isa; }
+
+namespace Portable {
+template <typename T>
+void add(const T *a, const T *b, T *out, std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i) out[i] = a[i] + b[i];
+}
+template <typename T>
+void mul(const T *a, const T *b, T *out, std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i) out[i] = a[i] * b[i];
+}
+// out += a
+template <typename T>
+void acc(const T *a, T *out, std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i) out[i] += a[i];
+}
+// out += a * b
+template <typename T>
+void mul_acc(const T *a, const T *b, T *out, std::size_t n) {
+  for (std::size_t i = 0; i < n; ++i) out[i] += a[i] * b[i];
+}
+
+// rounds of Philox4x32-10 for `lanes` consecutive counters, word k of
+// block first + j in w[k][j] (see Philox in initialization.hpp). written
+// lane-wise and forced inline so each instruction set's wrapper below gets
+// its own vectorized copy.
+constexpr std::size_t philox_lanes = 16;
+HUGEGRAD_ALWAYS_INLINE void
+philox(std::uint32_t k0, std::uint32_t k1, std::uint64_t first,
+       std::uint32_t (&w)[4][philox_lanes]) {
+  for (std::size_t j = 0; j < philox_lanes; ++j) {
+    w[0][j] = static_cast<std::uint32_t>(first + j);
+    w[1][j] = static_cast<std::uint32_t>((first + j) >> 32);
+    w[2][j] = 0;
+    w[3][j] = 0;
+  }
+  for (int round = 0; round < 10; ++round) {
+    for (std::size_t j = 0; j < philox_lanes; ++j) {
+      const std::uint64_t p0 = std::uint64_t(0xD2511F53u) * w[0][j];
+      const std::uint64_t p1 = std::uint64_t(0xCD9E8D57u) * w[2][j];
+      w[0][j] = static_cast<std::uint32_t>(p1 >> 32) ^ w[1][j] ^ k0;
+      w[2][j] = static_cast<std::uint32_t>(p0 >> 32) ^ w[3][j] ^ k1;
+      w[1][j] = static_cast<std::uint32_t>(p1);
+      w[3][j] = static_cast<std::uint32_t>(p0);
+    }
+    k0 += 0x9E3779B9u;
+    k1 += 0xBB67AE85u;
+  }
+}
+} // namespace Portable
+
+#if HUGEGRAD_X86_KERNELS
+// one set of kernels per (instruction set, element type); the tail that
+// doesn't fill a register is finished by the scalar loop
+#define HUGEGRAD_DEFINE_KERNELS(TARGET, T, W, LOAD, STORE, ADD, MUL)           \
+  __attribute__((target(TARGET))) inline void add(const T *a, const T *b,      \
+                                                  T *out, std::size_t n) {     \
+    std::size_t i = 0;                                                         \
+    for (; i + W <= n; i += W)                                                 \
+      STORE(out + i, ADD(LOAD(a + i), LOAD(b + i)));                           \
+    Portable::add(a + i, b + i, out + i, n - i);                               \
+  }                                                                            \
+  __attribute__((target(TARGET))) inline void mul(const T *a, const T *b,      \
+                                                  T *out, std::size_t n) {     \
+    std::size_t i = 0;                                                         \
+    for (; i + W <= n; i += W)                                                 \
+      STORE(out + i, MUL(LOAD(a + i), LOAD(b + i)));                           \
+    Portable::mul(a + i, b + i, out + i, n - i);                               \
+  }                                                                            \
+  __attribute__((target(TARGET))) inline void acc(const T *a, T *out,          \
+                                                  std::size_t n) {             \
+    std::size_t i = 0;                                                         \
+    for (; i + W <= n; i += W)                                                 \
+      STORE(out + i, ADD(LOAD(out + i), LOAD(a + i)));                         \
+    Portable::acc(a + i, out + i, n - i);                                      \
+  }                                                                            \
+  __attribute__((target(TARGET))) inline void mul_acc(                         \
+      const T *a, const T *b, T *out, std::size_t n) {                         \
+    std::size_t i = 0;                                                         \
+    for (; i + W <= n; i += W)                                                 \
+      STORE(out + i, ADD(LOAD(out + i), MUL(LOAD(a + i), LOAD(b + i))));       \
+    Portable::mul_acc(a + i, b + i, out + i, n - i);                           \
+  }
+
+namespace Sse {
+HUGEGRAD_DEFINE_KERNELS("sse2", float, 4, _mm_loadu_ps, _mm_storeu_ps,
+                        _mm_add_ps, _mm_mul_ps)
+HUGEGRAD_DEFINE_KERNELS("sse2", double, 2, _mm_loadu_pd, _mm_storeu_pd,
+                        _mm_add_pd, _mm_mul_pd)
+} // namespace Sse
+namespace Avx2 {
+HUGEGRAD_DEFINE_KERNELS("avx2", float, 8, _mm256_loadu_ps, _mm256_storeu_ps,
+                        _mm256_add_ps, _mm256_mul_ps)
+HUGEGRAD_DEFINE_KERNELS("avx2", double, 4, _mm256_loadu_pd, _mm256_storeu_pd,
+                        _mm256_add_pd, _mm256_mul_pd)
+} // namespace Avx2
+namespace Avx512 {
+HUGEGRAD_DEFINE_KERNELS("avx512f", float, 16, _mm512_loadu_ps, _mm512_storeu_ps,
+                        _mm512_add_ps, _mm512_mul_ps)
+HUGEGRAD_DEFINE_KERNELS("avx512f", double, 8, _mm512_loadu_pd, _mm512_storeu_pd,
+                        _mm512_add_pd, _mm512_mul_pd)
+} // namespace Avx512
+#undef HUGEGRAD_DEFINE_KERNELS
+
+#define HUGEGRAD_DEFINE_PHILOX(TARGET)                                         \
+  __attribute__((target(TARGET))) inline void philox(                          \
+      std::uint32_t k0, std::uint32_t k1, std::uint64_t first,                 \
+      std::uint32_t(&w)[4][Portable::philox_lanes]) {                          \
+    Portable::philox(k0, k1, first, w);                                        \
+  }
+namespace Sse {
+HUGEGRAD_DEFINE_PHILOX("sse2")
+} // namespace Sse
+namespace Avx2 {
+HUGEGRAD_DEFINE_PHILOX("avx2")
+} // namespace Avx2
+namespace Avx512 {
+HUGEGRAD_DEFINE_PHILOX("avx512f")
+} // namespace Avx512
+#undef HUGEGRAD_DEFINE_PHILOX
+#endif
+
+template <typename T>
+constexpr bool vectorized = std::is_same_v<T, float> || std::is_same_v<T, double>;
+
+// runtime dispatch, only float and double have vector paths
+#if HUGEGRAD_X86_KERNELS
+#define HUGEGRAD_DISPATCH(NAME, ...)                                           \
+  if constexpr (vectorized<T>) {                                               \
+    switch (active_isa()) {                                                    \
+    case Isa::AVX512:                                                          \
+      return Avx512::NAME(__VA_ARGS__);                                        \
+    case Isa::AVX2:                                                            \
+      return Avx2::NAME(__VA_ARGS__);                                          \
+    case Isa::SSE:                                                             \
+      return Sse::NAME(__VA_ARGS__);                                           \
+    case Isa::SCALAR:                                                          \
+      break;                                                                   \
+    }                                                                          \
+  }                                                                            \
+  return Portable::NAME(__VA_ARGS__);
+#else
+#define HUGEGRAD_DISPATCH(NAME, ...) return Portable::NAME(__VA_ARGS__);
+#endif
+
+template <typename T>
+void add(const T *a, const T *b, T *out, std::size_t n) {
+  HUGEGRAD_DISPATCH(add, a, b, out, n)
+}
+template <typename T>
+void mul(const T *a, const T *b, T *out, std::size_t n) {
+  HUGEGRAD_DISPATCH(mul, a, b, out, n)
+}
+template <typename T>
+void acc(const T *a, T *out, std::size_t n) {
+  HUGEGRAD_DISPATCH(acc, a, out, n)
+}
+template <typename T>
+void mul_acc(const T *a, const T *b, T *out, std::size_t n) {
+  HUGEGRAD_DISPATCH(mul_acc, a, b, out, n)
+}
+
+#undef HUGEGRAD_DISPATCH
+
+constexpr std::size_t philox_lanes = Portable::philox_lanes;
+inline void philox(std::uint32_t k0, std::uint32_t k1, std::uint64_t first,
+                   std::uint32_t (&w)[4][philox_lanes]) {
+#if HUGEGRAD_X86_KERNELS
+  switch (active_isa()) {
+  case Isa::AVX512:
+    return Avx512::philox(k0, k1, first, w);
+  case Isa::AVX2:
+    return Avx2::philox(k0, k1, first, w);
+  case Isa::SSE:
+    return Sse::philox(k0, k1, first, w);
+  case Isa::SCALAR:
+    break;
+  }
+#endif
+  return Portable::philox(k0, k1, first, w);
+}
+
+} // namespace Kernels
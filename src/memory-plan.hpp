@@ -0,0 +1,345 @@
+#pragma once
+#include "plan.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+// liveness based buffer reuse for captured plans.
+// a tape keeps a value and a gradient for every entry, but in a fixed
+// execution order most of them are only needed for a short while: a
+// partial sum is dead once the next ADD has read it, and its gradient only
+// exists between the backward steps of its last reader and itself.
+// plan_memory() works out these lifetimes from the tape order and packs
+// values and gradients into one buffer, reusing a slot as soon as whatever
+// was in it is dead. forward and backward then run inside that buffer.
+//
+//   auto mem = PlanNS::plan_memory(PlanNS::capture({loss}), {x, w});
+//   mem.value(x) = 0.25;
+//   mem.forward();
+//   mem.backward();  // mem.grad(w)
+//
+// the timeline has forward steps 0..n-1, the output seeds at n and the
+// backward step of entry m at 2n - m. a value lives from its own step to
+// its last forward reader, or to the backward step of its first reader
+// when that op needs it again (see Operation::backward_reads). slots freed
+// at a step are handed out again at the same step, which is safe because
+// every step reads all its operands before writing. slots are given out in
+// order of start time, so the buffer holds exactly the peak number of live
+// values and gradients.
+//
+// inputs and outputs keep their own value and gradient slots and are the
+// only nodes that can be looked up. other leaves are constants: their
+// gradients go to a sink slot nobody reads. values and gradients are the
+// ones the plan computes, bit for bit.
+// the plan is consumed; its graph nodes other than inputs and outputs can
+// be freed once it is.
+namespace PlanNS {
+
+template <typename T>
+struct MemoryPlan {
+  // read by entries that have no readers, so always 0
+  static constexpr std::uint32_t zero_slot = 0;
+  // written by constants' gradients, never read
+  static constexpr std::uint32_t sink_slot = 1;
+
+  Mode mode = Mode::TRAINING;
+  // the program, as on the tape
+  std::vector<Operation::OpCode> code;
+  std::vector<std::uint32_t> lhs;
+  std::vector<std::uint32_t> rhs;
+  // empty unless there are TERNARY ops
+  std::vector<std::uint32_t> aux;
+  std::vector<T> imm;
+  // where the value and gradient of each entry live in buffer
+  std::vector<std::uint32_t> value_slot;
+  std::vector<std::uint32_t> grad_slot;
+  // bit p set: operand p's gradient starts at this entry, so it's assigned
+  // instead of added to, and nothing has to be cleared in between
+  std::vector<std::uint8_t> fresh;
+  std::vector<T> buffer;
+  std::vector<std::uint32_t> outputs;
+  // inputs and outputs, their gradients are reset by backward
+  std::vector<std::uint32_t> pinned;
+  std::unordered_map<const ScalarNS::ScalarValue<T> *, std::uint32_t> slots;
+  std::vector<ScalarNS::Scalar<T>> roots;
+
+  std::size_t size() const { return code.size(); }
+  // a value and a gradient per entry, what the tape holds
+  std::size_t naive_bytes() const { return 2 * size() * sizeof(T); }
+  std::size_t planned_bytes() const { return buffer.size() * sizeof(T); }
+
+  std::uint32_t entry(const ScalarNS::Scalar<T> &node) const {
+    auto it = slots.find(node.get());
+    if (it == slots.end()) {
+      throw new std::runtime_error("node is neither an input nor an output of the plan");
+    }
+    return it->second;
+  }
+  T &value(const ScalarNS::Scalar<T> &node) { return buffer[value_slot[entry(node)]]; }
+  T &grad(const ScalarNS::Scalar<T> &node) {
+    if (mode != Mode::TRAINING) {
+      throw new std::runtime_error("an inference plan keeps no gradients");
+    }
+    return buffer[grad_slot[entry(node)]];
+  }
+  T &output(std::size_t i = 0) { return buffer[value_slot[outputs.at(i)]]; }
+
+  T &val(std::uint32_t n) { return buffer[value_slot[n]]; }
+
+  void forward() {
+    for (std::size_t n = 0; n < size(); ++n) {
+      switch (Operation::op_type(code[n])) {
+      case Operation::OpType::BINARY:
+        val(n) = Operation::forward(code[n], imm[n], val(lhs[n]), val(rhs[n]));
+        break;
+      case Operation::OpType::UNARY:
+        val(n) = Operation::forward<T>(code[n], imm[n], val(lhs[n]), 0);
+        break;
+      case Operation::OpType::TERNARY:
+        val(n) = Operation::forward(code[n], imm[n], val(lhs[n]), val(rhs[n]),
+                                    val(aux[n]));
+        break;
+      case Operation::OpType::NONE:
+        break;
+      }
+    }
+  }
+
+  void accumulate(std::uint32_t n, unsigned p, std::uint32_t target, T d) {
+    T &g = buffer[grad_slot[target]];
+    g = (fresh[n] >> p & 1) ? d : g + d;
+  }
+
+  // gradients of this pass only, the same sweep as Plan::backward
+  void backward() {
+    if (mode != Mode::TRAINING) {
+      throw new std::runtime_error("an inference plan can't run backward");
+    }
+    for (auto p : pinned) {
+      buffer[grad_slot[p]] = 0;
+    }
+    std::uint32_t last = 0;
+    for (auto o : outputs) {
+      buffer[grad_slot[o]] = 1;
+      last = std::max(last, o);
+    }
+    for (std::size_t n = last + 1; n-- > 0;) {
+      const T g = buffer[grad_slot[n]];
+      const auto l = lhs[n];
+      const auto r = rhs[n];
+      // every read happens before the first write, the written slots may
+      // be the ones just read for the last time
+      switch (Operation::op_type(code[n])) {
+      case Operation::OpType::BINARY: {
+        const T dl = Operation::backward_operand(code[n], imm[n], g, 0, val(l), val(r));
+        const T dr = Operation::backward_operand(code[n], imm[n], g, 1, val(l), val(r));
+        accumulate(n, 0, l, dl);
+        accumulate(n, 1, r, dr);
+        break;
+      }
+      case Operation::OpType::UNARY:
+        accumulate(n, 0, l, Operation::backward<T>(code[n], imm[n], g, val(l), 0));
+        break;
+      case Operation::OpType::TERNARY: {
+        const auto a = aux[n];
+        const T dl = Operation::backward_operand(code[n], imm[n], g, 0, val(l), val(r),
+                                                 val(a));
+        const T dr = Operation::backward_operand(code[n], imm[n], g, 1, val(l), val(r),
+                                                 val(a));
+        const T da = Operation::backward_operand(code[n], imm[n], g, 2, val(l), val(r),
+                                                 val(a));
+        accumulate(n, 0, l, dl);
+        accumulate(n, 1, r, dr);
+        accumulate(n, 2, a, da);
+        break;
+      }
+      case Operation::OpType::NONE:
+        break;
+      }
+    }
+  }
+};
+
+// inputs are the nodes written or read through the result besides the
+// outputs, as for fuse
+template <typename T>
+MemoryPlan<T> plan_memory(Plan<T> &&plan, const std::vector<ScalarNS::Scalar<T>> &inputs,
+                          Mode mode = Mode::TRAINING) {
+  constexpr std::uint32_t none = UINT32_MAX;
+  auto &tape = plan.tape;
+  const auto n = static_cast<std::uint32_t>(tape.size());
+  const bool training = mode == Mode::TRAINING;
+
+  MemoryPlan<T> mem;
+  mem.mode = mode;
+  mem.outputs = plan.outputs;
+  std::vector<bool> pinned(n, false);
+  for (auto o : plan.outputs) {
+    pinned[o] = true;
+  }
+  for (const auto &i : inputs) {
+    const auto e = plan.slots.at(i.get());
+    pinned[e] = true;
+    mem.slots.emplace(i.get(), e);
+    mem.roots.push_back(i);
+  }
+  for (std::size_t i = 0; i < plan.outputs.size(); ++i) {
+    mem.slots.emplace(plan.roots[i].get(), plan.outputs[i]);
+    mem.roots.push_back(plan.roots[i]);
+  }
+  for (std::uint32_t e = 0; e < n; ++e) {
+    if (pinned[e]) {
+      mem.pinned.push_back(e);
+    }
+  }
+  // everything below only needs the tape, let the graph go before the
+  // scratch arrays are allocated
+  plan.slots = {};
+  plan.roots = {};
+  tape.grad = {};
+
+  // last reader of every entry, and the first one that reads it again on
+  // the way back
+  std::vector<std::uint32_t> last_read(n, none);
+  std::vector<std::uint32_t> first_back(n, none);
+  std::vector<std::uint8_t> fresh(n, 0);
+  auto operands = [&](std::uint32_t m, std::uint32_t *ops) -> unsigned {
+    ops[0] = tape.lhs[m];
+    ops[1] = tape.rhs[m];
+    ops[2] = tape.aux[m];
+    switch (Operation::op_type(tape.code[m])) {
+    case Operation::OpType::TERNARY:
+      return 3;
+    case Operation::OpType::BINARY:
+      return 2;
+    case Operation::OpType::UNARY:
+      return 1;
+    case Operation::OpType::NONE:
+      break;
+    }
+    return 0;
+  };
+  for (std::uint32_t m = 0; m < n; ++m) {
+    std::uint32_t ops[3];
+    const unsigned k = operands(m, ops);
+    const unsigned reads = Operation::backward_reads(tape.code[m]);
+    for (unsigned p = 0; p < k; ++p) {
+      last_read[ops[p]] = m;
+      if (p < reads && first_back[ops[p]] == none) {
+        first_back[ops[p]] = m;
+      }
+    }
+  }
+
+  // sweep the timeline once, freeing before allocating at every step.
+  // most recently freed first, it's the likeliest to still be in cache
+  mem.value_slot.assign(n, MemoryPlan<T>::zero_slot);
+  mem.grad_slot.assign(n, MemoryPlan<T>::zero_slot);
+  std::uint32_t next = 2;
+  std::vector<std::uint32_t> free_slots;
+  auto take = [&]() {
+    if (free_slots.empty()) {
+      return next++;
+    }
+    const auto s = free_slots.back();
+    free_slots.pop_back();
+    return s;
+  };
+  for (std::uint32_t e = 0; e < n; ++e) {
+    const bool leaf = tape.code[e] == Operation::OpCode::NONE;
+    if (pinned[e] || leaf) {
+      mem.value_slot[e] = next++;
+    }
+    if (!training) {
+      continue;
+    }
+    if (pinned[e]) {
+      mem.grad_slot[e] = next++;
+    } else if (leaf) {
+      mem.grad_slot[e] = MemoryPlan<T>::sink_slot;
+    }
+  }
+  // the entries whose value and gradient share slots with others
+  auto reused = [&](std::uint32_t e) {
+    return !pinned[e] && tape.code[e] != Operation::OpCode::NONE;
+  };
+
+  // forward: values end at their last reader unless backward needs them
+  for (std::uint32_t m = 0; m < n; ++m) {
+    std::uint32_t ops[3];
+    const unsigned k = operands(m, ops);
+    for (unsigned p = 0; p < k; ++p) {
+      const auto t = ops[p];
+      if (reused(t) && last_read[t] == m && std::find(ops, ops + p, t) == ops + p &&
+          (!training || first_back[t] == none)) {
+        free_slots.push_back(mem.value_slot[t]);
+      }
+    }
+    if (reused(m)) {
+      mem.value_slot[m] = take();
+      // read by nothing, dead right away
+      if (last_read[m] == none && (!training || first_back[m] == none)) {
+        free_slots.push_back(mem.value_slot[m]);
+      }
+    }
+  }
+
+  // backward: step m reads its gradient and the operand values it needs for
+  // the last time and starts the gradients of operands it reads last
+  for (std::uint32_t m = training ? n : 0; m-- > 0;) {
+    std::uint32_t ops[3];
+    const unsigned k = operands(m, ops);
+    if (reused(m) && last_read[m] != none) {
+      free_slots.push_back(mem.grad_slot[m]);
+    }
+    const unsigned reads = Operation::backward_reads(tape.code[m]);
+    for (unsigned p = 0; p < std::min(k, reads); ++p) {
+      const auto t = ops[p];
+      if (reused(t) && first_back[t] == m && std::find(ops, ops + p, t) == ops + p) {
+        free_slots.push_back(mem.value_slot[t]);
+      }
+    }
+    for (unsigned p = 0; p < k; ++p) {
+      const auto t = ops[p];
+      if (mem.grad_slot[t] == MemoryPlan<T>::sink_slot) {
+        fresh[m] |= std::uint8_t(1u << p);
+      } else if (reused(t) && last_read[t] == m &&
+                 std::find(ops, ops + p, t) == ops + p) {
+        mem.grad_slot[t] = take();
+        fresh[m] |= std::uint8_t(1u << p);
+      }
+    }
+  }
+
+  mem.buffer.assign(next, T(0));
+  for (std::uint32_t e = 0; e < n; ++e) {
+    if (tape.code[e] == Operation::OpCode::NONE || pinned[e]) {
+      mem.buffer[mem.value_slot[e]] = tape.value[e];
+    }
+  }
+  mem.fresh = std::move(fresh);
+  mem.code = std::move(tape.code);
+  mem.lhs = std::move(tape.lhs);
+  mem.rhs = std::move(tape.rhs);
+  // only fused plans read a third operand
+  const bool ternary = std::any_of(mem.code.begin(), mem.code.end(), [](auto c) {
+    return Operation::op_type(c) == Operation::OpType::TERNARY;
+  });
+  if (ternary) {
+    mem.aux = std::move(tape.aux);
+  }
+  mem.imm = std::move(tape.imm);
+  plan = Plan<T>();
+  return mem;
+}
+
+template <typename T>
+MemoryPlan<T> plan_memory(Plan<T> &&plan, std::initializer_list<ScalarNS::Scalar<T>> inputs,
+                          Mode mode = Mode::TRAINING) {
+  return plan_memory(std::move(plan), std::vector<ScalarNS::Scalar<T>>(inputs), mode);
+}
+
+} // namespace PlanNS
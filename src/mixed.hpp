@@ -0,0 +1,283 @@
+#pragma once
+#include "half.hpp"
+#include "plan.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+// a Batch whose values and gradients are stored in 16 bits (bf16 or fp16)
+// while every op computes in fp32, for half the memory and bandwidth of
+// the activations and parameters. the graph is the usual Scalar<float>
+// one and stays the fp32 master copy.
+//
+//   auto plan = PlanNS::capture({loss});
+//   PlanNS::MixedBatch<bf16> batch(plan, 1024);
+//   std::copy(xs.begin(), xs.end(), batch.value(x).begin());
+//   PlanNS::LossScale scaler;
+//   batch.forward();
+//   batch.backward(scaler.scale);
+//   if (scaler.update(batch.finite())) {
+//     w->data -= lr * batch.grad_sum(w);  // unscaled, summed in fp32
+//   }
+//
+// rows are processed in blocks of `block` lanes: the operands are widened
+// into fp32 scratch, run through the same array kernels as Batch<float>,
+// and the result is rounded once into its row. gradients are accumulated
+// in fp32 as well: an entry read by a single op gets exactly one
+// contribution, which is rounded once into its row; entries read more
+// than once (shared activations) and the outputs add up in an fp32 row of
+// their own and are rounded once, when complete.
+//
+// the gradients are of scale times the outputs, so small ones don't
+// underflow fp16. LossScale picks the largest scale that doesn't overflow.
+namespace PlanNS {
+
+// dynamic loss scaling: the scale is lowered when a step's gradients
+// overflowed and raised after `interval` steps in a row that didn't.
+// powers of two keep the scaled seeds and the unscaling exact.
+struct LossScale {
+  float scale = 65536.0f;
+  float factor = 2.0f;
+  std::size_t interval = 1000;
+  std::size_t finite_steps = 0;
+
+  // call after every backward; false when the step has to be skipped
+  bool update(bool finite) {
+    if (!finite) {
+      scale = std::max(1.0f, scale / factor);
+      finite_steps = 0;
+      return false;
+    }
+    if (++finite_steps == interval) {
+      scale *= factor;
+      finite_steps = 0;
+    }
+    return true;
+  }
+};
+
+template <typename H>
+struct MixedBatch {
+  static_assert(HalfNS::half_type<H>, "MixedBatch stores bf16 or fp16");
+  // lanes converted at a time, the scratch stays in L1
+  static constexpr std::size_t block = 256;
+  static constexpr std::uint32_t no_row = std::numeric_limits<std::uint32_t>::max();
+
+  const Plan<float> &plan;
+  std::size_t lanes;
+  // entry-major, row e holds the lanes of tape entry e
+  std::vector<H> values;
+  // empty for INFERENCE
+  std::vector<H> grads;
+  // fp32 rows of the entries with more than one gradient contribution
+  std::vector<float> sums;
+  // entry -> its row in sums, or no_row
+  std::vector<std::uint32_t> sum_row;
+  Mode mode;
+  // of the last backward
+  float scale = 1;
+
+  MixedBatch(const Plan<float> &plan, std::size_t lanes, Mode mode = Mode::TRAINING)
+      : plan(plan), lanes(lanes), values(plan.size() * lanes),
+        grads(mode == Mode::TRAINING ? plan.size() * lanes : 0), mode(mode) {
+    if (lanes == 0) {
+      throw new std::runtime_error("a batch needs at least one lane");
+    }
+    const auto &tape = plan.tape;
+    for (std::size_t e = 0; e < plan.size(); ++e) {
+      std::fill_n(values.begin() + e * lanes, lanes, H(tape.value[e]));
+    }
+    if (mode != Mode::TRAINING) {
+      return;
+    }
+    // contributions per entry, one per operand slot reading it
+    std::vector<std::uint8_t> writes(plan.size());
+    auto count = [&writes](std::uint32_t e) { writes[e] = std::min(writes[e] + 1, 2); };
+    for (std::size_t n = 0; n < plan.size(); ++n) {
+      const auto type = Operation::op_type(tape.code[n]);
+      if (type == Operation::OpType::NONE) {
+        continue;
+      }
+      count(tape.lhs[n]);
+      if (type != Operation::OpType::UNARY) {
+        count(tape.rhs[n]);
+      }
+      if (type == Operation::OpType::TERNARY) {
+        count(tape.aux[n]);
+      }
+    }
+    // outputs are seeded with the scale, which needn't fit in fp16
+    for (auto o : plan.outputs) {
+      writes[o] = 2;
+    }
+    sum_row.assign(plan.size(), no_row);
+    std::uint32_t rows = 0;
+    for (std::size_t e = 0; e < plan.size(); ++e) {
+      if (writes[e] > 1) {
+        sum_row[e] = rows++;
+      }
+    }
+    sums.resize(std::size_t(rows) * lanes);
+  }
+  MixedBatch(const MixedBatch &) = delete;
+  MixedBatch &operator=(const MixedBatch &) = delete;
+
+  std::size_t size() const { return plan.size(); }
+
+  std::span<H> value_row(std::uint32_t e) { return {values.data() + e * lanes, lanes}; }
+  std::span<H> grad_row(std::uint32_t e) {
+    if (mode != Mode::TRAINING) {
+      throw new std::runtime_error("an inference batch keeps no gradients");
+    }
+    return {grads.data() + e * lanes, lanes};
+  }
+
+  std::uint32_t entry(const ScalarNS::Scalar<float> &node) const {
+    auto it = plan.slots.find(node.get());
+    if (it == plan.slots.end()) {
+      throw new std::runtime_error("node is not part of the captured graph");
+    }
+    return it->second;
+  }
+  // per sample values and scaled gradients of a captured node
+  std::span<H> value(const ScalarNS::Scalar<float> &node) { return value_row(entry(node)); }
+  std::span<H> grad(const ScalarNS::Scalar<float> &node) { return grad_row(entry(node)); }
+  std::span<H> output(std::size_t i = 0) { return value_row(plan.outputs.at(i)); }
+
+  // gradient of the summed outputs, reduced across the batch in lane order
+  // in fp32 and divided by the scale
+  float grad_sum(const ScalarNS::Scalar<float> &node) {
+    float sum = 0;
+    for (H g : grad(node)) {
+      sum += g;
+    }
+    return sum / scale;
+  }
+
+  // whether the last backward left every leaf gradient finite; an overflow
+  // anywhere reaches the leaves as inf or NaN
+  bool finite() const {
+    if (mode != Mode::TRAINING) {
+      throw new std::runtime_error("an inference batch keeps no gradients");
+    }
+    const auto &tape = plan.tape;
+    for (std::size_t e = 0; e < size(); ++e) {
+      if (tape.code[e] != Operation::OpCode::NONE) {
+        continue;
+      }
+      const H *g = grads.data() + e * lanes;
+      if (!std::all_of(g, g + lanes, HalfNS::isfinite<H>)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void forward() {
+    const auto &tape = plan.tape;
+    float scratch[4][block];
+    for (std::uint32_t n = 0; n < size(); ++n) {
+      const auto type = Operation::op_type(tape.code[n]);
+      if (type == Operation::OpType::NONE) {
+        continue;
+      }
+      for (std::size_t i = 0; i < lanes; i += block) {
+        const std::size_t m = std::min(block, lanes - i);
+        auto load = [&](float *to, std::uint32_t e) {
+          HalfNS::widen<H>({values.data() + e * lanes + i, m}, {to, m});
+          return std::span<const float>(to, m);
+        };
+        const auto l = load(scratch[0], tape.lhs[n]);
+        // unary ops have rhs == lhs
+        const auto r = type == Operation::OpType::UNARY ? l : load(scratch[1], tape.rhs[n]);
+        std::span<const float> a;
+        if (type == Operation::OpType::TERNARY) {
+          a = load(scratch[2], tape.aux[n]);
+        }
+        Operation::forward_n<float>(tape.code[n], tape.imm[n], l, r, a, {scratch[3], m});
+        HalfNS::narrow<H>({scratch[3], m}, {values.data() + n * lanes + i, m});
+      }
+    }
+  }
+
+  // per lane gradients of scale * the outputs, this pass only; the sweep
+  // of Batch::backward
+  void backward(float scale = 1) {
+    if (mode != Mode::TRAINING) {
+      throw new std::runtime_error("an inference batch can't run backward");
+    }
+    this->scale = scale;
+    const auto &tape = plan.tape;
+    std::fill(grads.begin(), grads.end(), H(0));
+    std::fill(sums.begin(), sums.end(), 0.0f);
+    if (size() == 0 || plan.outputs.empty()) {
+      return;
+    }
+    std::uint32_t last = 0;
+    for (auto o : plan.outputs) {
+      std::fill_n(sums.begin() + sum_row[o] * lanes, lanes, scale);
+      last = std::max(last, o);
+    }
+    float scratch[5][block];
+    for (std::size_t n = last + 1; n-- > 0;) {
+      const auto code = tape.code[n];
+      const auto type = Operation::op_type(code);
+      if (type == Operation::OpType::NONE) {
+        // a leaf read more than once is complete, round it into its row
+        if (sum_row[n] != no_row) {
+          HalfNS::narrow<H>({sums.data() + sum_row[n] * lanes, lanes}, grad_row(n));
+        }
+        continue;
+      }
+      for (std::size_t i = 0; i < lanes; i += block) {
+        const std::size_t m = std::min(block, lanes - i);
+        auto load = [&](float *to, std::uint32_t e) {
+          HalfNS::widen<H>({values.data() + e * lanes + i, m}, {to, m});
+          return std::span<const float>(to, m);
+        };
+        // the incoming gradient, straight from its fp32 sum when it has one
+        std::span<const float> g;
+        if (sum_row[n] != no_row) {
+          float *sum = sums.data() + sum_row[n] * lanes + i;
+          HalfNS::narrow<H>({sum, m}, {grads.data() + n * lanes + i, m});
+          g = {sum, m};
+        } else {
+          HalfNS::widen<H>({grads.data() + n * lanes + i, m}, {scratch[0], m});
+          g = {scratch[0], m};
+        }
+        const auto l = load(scratch[1], tape.lhs[n]);
+        const auto r = type == Operation::OpType::UNARY ? l : load(scratch[2], tape.rhs[n]);
+        std::span<const float> a;
+        if (type == Operation::OpType::TERNARY) {
+          a = load(scratch[3], tape.aux[n]);
+        }
+        auto contribute = [&](unsigned slot, std::uint32_t e) {
+          if (sum_row[e] != no_row) {
+            Operation::backward_operand_n<float>(code, tape.imm[n], g, slot, l, r, a,
+                                                 {sums.data() + sum_row[e] * lanes + i, m});
+            return;
+          }
+          // the only contribution: computed from 0 and rounded once
+          std::fill_n(scratch[4], m, 0.0f);
+          Operation::backward_operand_n<float>(code, tape.imm[n], g, slot, l, r, a,
+                                               {scratch[4], m});
+          HalfNS::narrow<H>({scratch[4], m}, {grads.data() + e * lanes + i, m});
+        };
+        contribute(0, tape.lhs[n]);
+        if (type == Operation::OpType::UNARY) {
+          continue;
+        }
+        contribute(1, tape.rhs[n]);
+        if (type == Operation::OpType::TERNARY) {
+          contribute(2, tape.aux[n]);
+        }
+      }
+    }
+  }
+};
+
+} // namespace PlanNS
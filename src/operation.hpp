@@ -1,11 +1,15 @@
 #pragma once
+#include "kernels.hpp"
 #include <cmath>
+#include <cstdint>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
 namespace Operation {
 
-  enum class OpType { NONE, UNARY, BINARY };
+  // TERNARY ops only come out of the fusion pass on tapes
+  enum class OpType { NONE, UNARY, BINARY, TERNARY };
 
   // unary operators ignore the 2nd argument
   // could replace it with variant, not sure which is better.
@@ -14,7 +18,7 @@ namespace Operation {
   private:
     static const OpType type = OpType::NONE;
   public:
-    virtual const OpType get_type() const
+    virtual OpType get_type() const
     {
       return type;
     }
@@ -33,6 +37,22 @@ namespace Operation {
     virtual T backward(T grad, T curr_data, T other_data) {
       throw new std::runtime_error("in Operation backward, not implemented");
     }
+
+    // array versions, one virtual call per span instead of per element.
+    // out[i] = forward(first[i], second[i]); unary ops ignore second.
+    virtual void forward_n(std::span<const T> first, std::span<const T> second,
+                           std::span<T> out) {
+      for (std::size_t i = 0; i < out.size(); ++i) {
+        out[i] = forward(first[i], second.empty() ? T(0) : second[i]);
+      }
+    }
+    // out[i] += backward(grad[i], curr[i], other[i]); unary ops ignore other.
+    virtual void backward_n(std::span<const T> grad, std::span<const T> curr,
+                            std::span<const T> other, std::span<T> out) {
+      for (std::size_t i = 0; i < out.size(); ++i) {
+        out[i] += backward(grad[i], curr[i], other.empty() ? T(0) : other[i]);
+      }
+    }
   };
   template <typename T>
   const std::string Operation<T>::symbol = "";
@@ -42,11 +62,19 @@ namespace Operation {
   private:
     static const OpType type = OpType::BINARY;
   public:
-    const OpType get_type() const { return type; }
+    OpType get_type() const { return type; }
     static const std::string symbol;
     const std::string get_symbol() const { return symbol; }
     T forward(T first, T second) { return first + second; }
     T backward(T grad, T curr_data, T other_data) { return grad; }
+    void forward_n(std::span<const T> first, std::span<const T> second,
+                   std::span<T> out) {
+      Kernels::add(first.data(), second.data(), out.data(), out.size());
+    }
+    void backward_n(std::span<const T> grad, std::span<const T>,
+                    std::span<const T>, std::span<T> out) {
+      Kernels::acc(grad.data(), out.data(), out.size());
+    }
   };
 
   template <typename T>
@@ -62,11 +90,19 @@ namespace Operation {
   private:
     static const OpType type = OpType::BINARY;
   public:
-    const OpType get_type() const { return type; }
+    OpType get_type() const { return type; }
     static const std::string symbol;
     const std::string get_symbol() const { return symbol; }
     T forward(T first, T second) { return first * second; }
     T backward(T grad, T _, T other_data) { return grad * other_data; }
+    void forward_n(std::span<const T> first, std::span<const T> second,
+                   std::span<T> out) {
+      Kernels::mul(first.data(), second.data(), out.data(), out.size());
+    }
+    void backward_n(std::span<const T> grad, std::span<const T>,
+                    std::span<const T> other, std::span<T> out) {
+      Kernels::mul_acc(grad.data(), other.data(), out.data(), out.size());
+    }
   };
 
   template <typename T>
@@ -82,7 +118,7 @@ namespace Operation {
   private:
     static const OpType type = OpType::UNARY;
   public:
-    const OpType get_type() const { return type; }
+    OpType get_type() const { return type; }
     T power;
     Pow(T power) : power(power) {}
     static const std::string symbol;
@@ -93,10 +129,43 @@ namespace Operation {
     T backward(T grad, T curr_data, T _) {
       return power * grad * std::pow(curr_data, power - 1);
     }
+    // libm calls don't vectorize, these only save the per element dispatch
+    void forward_n(std::span<const T> first, std::span<const T>,
+                   std::span<T> out) {
+      for (std::size_t i = 0; i < out.size(); ++i) {
+        out[i] = Pow::forward(first[i], 0);
+      }
+    }
+    void backward_n(std::span<const T> grad, std::span<const T> curr,
+                    std::span<const T>, std::span<T> out) {
+      for (std::size_t i = 0; i < out.size(); ++i) {
+        out[i] += Pow::backward(grad[i], curr[i], 0);
+      }
+    }
   };
   template <typename T>
   const std::string Pow<T>::symbol = "pow";
 
+  // multiplication by a constant factor. the factor isn't a node of the
+  // graph, so it gets no gradient.
+  template <typename T>
+  struct Linear : Operation<T> {
+  private:
+    static const OpType type = OpType::UNARY;
+  public:
+    OpType get_type() const { return type; }
+    T factor;
+    Linear(T factor) : factor(factor) {}
+    static const std::string symbol;
+    const std::string get_symbol() const { return symbol; }
+    T forward(T first, [[maybe_unused]] T _) { return factor * first; }
+    T backward(T grad, [[maybe_unused]] T curr_data, [[maybe_unused]] T _) {
+      return factor * grad;
+    }
+  };
+  template <typename T>
+  const std::string Linear<T>::symbol = "linear";
+
   template <typename Op, typename T>
   struct OpCache {
     std::unordered_map<T, Op*> cache;
@@ -122,7 +191,7 @@ namespace Operation {
   private:
     static const OpType type = OpType::NONE;
   public:
-    const OpType get_type() const { return type; }
+    OpType get_type() const { return type; }
     static const std::string symbol;
     T forward(T first, T second) { return 137; }
     T backward(T grad, T curr_data, T other_data) { return 137; }
@@ -144,12 +213,24 @@ namespace Operation {
   private:
     static const OpType type = OpType::UNARY;
   public:
-    const OpType get_type() const { return type; }
+    OpType get_type() const { return type; }
     static const std::string symbol;
     const std::string get_symbol() const { return symbol; }
     T forward(T first, T _) { return my_tanh(first); }
     T backward(T grad, T curr_data, T _) {
-      return 1 - std::pow(my_tanh(curr_data), 2) * grad;
+      return (1 - std::pow(my_tanh(curr_data), 2)) * grad;
+    }
+    void forward_n(std::span<const T> first, std::span<const T>,
+                   std::span<T> out) {
+      for (std::size_t i = 0; i < out.size(); ++i) {
+        out[i] = Tanh::forward(first[i], 0);
+      }
+    }
+    void backward_n(std::span<const T> grad, std::span<const T> curr,
+                    std::span<const T>, std::span<T> out) {
+      for (std::size_t i = 0; i < out.size(); ++i) {
+        out[i] += Tanh::backward(grad[i], curr[i], 0);
+      }
     }
   };
 
@@ -164,13 +245,25 @@ namespace Operation {
   private:
     static const OpType type = OpType::UNARY;
   public:
-    const OpType get_type() const { return type; }
+    OpType get_type() const { return type; }
     static const std::string symbol;
     const std::string get_symbol() const { return symbol; }
     T forward(T first, T _) { return my_exp(first); }
     T backward(T grad, T curr_data, T _) {
       return my_exp(curr_data) * grad;
     }
+    void forward_n(std::span<const T> first, std::span<const T>,
+                   std::span<T> out) {
+      for (std::size_t i = 0; i < out.size(); ++i) {
+        out[i] = Exp::forward(first[i], 0);
+      }
+    }
+    void backward_n(std::span<const T> grad, std::span<const T> curr,
+                    std::span<const T>, std::span<T> out) {
+      for (std::size_t i = 0; i < out.size(); ++i) {
+        out[i] += Exp::backward(grad[i], curr[i], 0);
+      }
+    }
   };
   template <typename T>
   const std::string Exp<T>::symbol = "exp";
@@ -178,4 +271,231 @@ namespace Operation {
   template <typename T> static Exp<T> exp_singleton = Exp<T>();
   template <typename T> static Exp<T> *exp_ptr = &exp_singleton<T>;
 
+  // compact tag for the built-in ops, for flat representations where a
+  // pointer to an Operation per node is too heavy. imm is the pow exponent or
+  // the linear factor. DIV and FMA (first * second + third) are made by
+  // fusing chains of the others. CHECKPOINT nodes stand for a segment that
+  // is evaluated again on the backward pass, see checkpoint.hpp.
+  enum class OpCode : std::uint8_t {
+    NONE, ADD, MUL, POW, TANH, EXP, LINEAR, DIV, FMA, CHECKPOINT
+  };
+
+  inline OpType op_type(OpCode code) {
+    switch (code) {
+    case OpCode::ADD:
+    case OpCode::MUL:
+    case OpCode::DIV:
+      return OpType::BINARY;
+    case OpCode::FMA:
+      return OpType::TERNARY;
+    case OpCode::POW:
+    case OpCode::TANH:
+    case OpCode::EXP:
+    case OpCode::LINEAR:
+    case OpCode::CHECKPOINT:
+      return OpType::UNARY;
+    case OpCode::NONE:
+      return OpType::NONE;
+    }
+    return OpType::NONE;
+  }
+
+  // how many leading operands backward reads the value of: the other
+  // factor for MUL and FMA, both sides of DIV, the argument of the unary
+  // ops. ADD and LINEAR only pass the gradient on.
+  inline unsigned backward_reads(OpCode code) {
+    switch (code) {
+    case OpCode::MUL:
+    case OpCode::DIV:
+    case OpCode::FMA:
+      return 2;
+    case OpCode::POW:
+    case OpCode::TANH:
+    case OpCode::EXP:
+    case OpCode::CHECKPOINT:
+      return 1;
+    case OpCode::ADD:
+    case OpCode::LINEAR:
+    case OpCode::NONE:
+      return 0;
+    }
+    return 0;
+  }
+
+  template <typename T>
+  const std::string &symbol(OpCode code) {
+    switch (code) {
+    case OpCode::ADD:
+      return Add<T>::symbol;
+    case OpCode::MUL:
+      return Mul<T>::symbol;
+    case OpCode::POW:
+      return Pow<T>::symbol;
+    case OpCode::TANH:
+      return Tanh<T>::symbol;
+    case OpCode::EXP:
+      return Exp<T>::symbol;
+    case OpCode::LINEAR:
+      return Linear<T>::symbol;
+    case OpCode::DIV: {
+      static const std::string div = "/";
+      return div;
+    }
+    case OpCode::FMA: {
+      static const std::string fma = "fma";
+      return fma;
+    }
+    case OpCode::CHECKPOINT: {
+      static const std::string checkpoint = "checkpoint";
+      return checkpoint;
+    }
+    case OpCode::NONE:
+      break;
+    }
+    return None<T>::symbol;
+  }
+
+  // the ops are constructed in place so the calls bind statically
+  template <typename T>
+  T forward(OpCode code, T imm, T first, T second, T third = T(0)) {
+    switch (code) {
+    case OpCode::ADD:
+      return Add<T>().forward(first, second);
+    case OpCode::MUL:
+      return Mul<T>().forward(first, second);
+    case OpCode::POW:
+      return Pow<T>(imm).forward(first, second);
+    case OpCode::TANH:
+      return Tanh<T>().forward(first, second);
+    case OpCode::EXP:
+      return Exp<T>().forward(first, second);
+    case OpCode::LINEAR:
+      return Linear<T>(imm).forward(first, second);
+    case OpCode::DIV:
+      return first / second;
+    case OpCode::FMA:
+      // two roundings, like the MUL and ADD it replaces
+      return first * second + third;
+    case OpCode::CHECKPOINT:
+      throw new std::runtime_error("in forward, checkpoints run their segment");
+    case OpCode::NONE:
+      break;
+    }
+    throw new std::runtime_error("in forward, not implemented for NONE");
+  }
+
+  template <typename T>
+  T backward(OpCode code, T imm, T grad, T curr_data, T other_data) {
+    switch (code) {
+    case OpCode::ADD:
+      return Add<T>().backward(grad, curr_data, other_data);
+    case OpCode::MUL:
+      return Mul<T>().backward(grad, curr_data, other_data);
+    case OpCode::POW:
+      return Pow<T>(imm).backward(grad, curr_data, other_data);
+    case OpCode::TANH:
+      return Tanh<T>().backward(grad, curr_data, other_data);
+    case OpCode::EXP:
+      return Exp<T>().backward(grad, curr_data, other_data);
+    case OpCode::LINEAR:
+      return Linear<T>(imm).backward(grad, curr_data, other_data);
+    case OpCode::DIV:
+    case OpCode::FMA:
+      throw new std::runtime_error("in backward, use backward_operand for fused ops");
+    case OpCode::CHECKPOINT:
+      throw new std::runtime_error("in backward, checkpoints run their segment");
+    case OpCode::NONE:
+      break;
+    }
+    throw new std::runtime_error("in backward, not implemented for NONE");
+  }
+
+  // gradient for operand slot (0, 1 or 2) of the op applied to
+  // (first, second, third). unlike backward it also covers the fused ops,
+  // which aren't symmetric in their operands.
+  template <typename T>
+  T backward_operand(OpCode code, T imm, T grad, unsigned slot, T first, T second,
+                     [[maybe_unused]] T third = T(0)) {
+    switch (code) {
+    case OpCode::DIV:
+      return slot == 0 ? grad / second : -grad * first / (second * second);
+    case OpCode::FMA:
+      return slot == 0 ? grad * second : slot == 1 ? grad * first : grad;
+    default:
+      return slot == 0 ? backward(code, imm, grad, first, second)
+                       : backward(code, imm, grad, second, first);
+    }
+  }
+
+  // lane versions of forward and backward_operand over spans of equal
+  // length, e.g. one value per sample. they go through the ops' array
+  // kernels and round exactly like the per element calls.
+  // out[i] = forward(first[i], second[i], third[i]); spans an op doesn't
+  // read may be empty.
+  template <typename T>
+  void forward_n(OpCode code, T imm, std::span<const T> first,
+                 std::span<const T> second, std::span<const T> third,
+                 std::span<T> out) {
+    switch (code) {
+    case OpCode::ADD:
+      return Add<T>().forward_n(first, second, out);
+    case OpCode::MUL:
+      return Mul<T>().forward_n(first, second, out);
+    case OpCode::POW:
+      return Pow<T>(imm).forward_n(first, second, out);
+    case OpCode::TANH:
+      return Tanh<T>().forward_n(first, second, out);
+    case OpCode::EXP:
+      return Exp<T>().forward_n(first, second, out);
+    case OpCode::LINEAR:
+      return Linear<T>(imm).forward_n(first, {}, out);
+    case OpCode::DIV:
+    case OpCode::FMA:
+      for (std::size_t i = 0; i < out.size(); ++i) {
+        out[i] = forward(code, imm, first[i], second[i],
+                         third.empty() ? T(0) : third[i]);
+      }
+      return;
+    case OpCode::CHECKPOINT:
+    case OpCode::NONE:
+      break;
+    }
+    throw new std::runtime_error("in forward_n, not implemented for this op");
+  }
+
+  // out[i] += backward_operand(code, imm, grad[i], slot, first[i], ...)
+  template <typename T>
+  void backward_operand_n(OpCode code, T imm, std::span<const T> grad, unsigned slot,
+                          std::span<const T> first, std::span<const T> second,
+                          std::span<const T> third, std::span<T> out) {
+    // curr and other as the Operation structs see them
+    const auto curr = slot == 0 ? first : second;
+    const auto other = slot == 0 ? second : first;
+    switch (code) {
+    case OpCode::ADD:
+      return Add<T>().backward_n(grad, curr, other, out);
+    case OpCode::MUL:
+      return Mul<T>().backward_n(grad, curr, other, out);
+    case OpCode::POW:
+      return Pow<T>(imm).backward_n(grad, first, {}, out);
+    case OpCode::TANH:
+      return Tanh<T>().backward_n(grad, first, {}, out);
+    case OpCode::EXP:
+      return Exp<T>().backward_n(grad, first, {}, out);
+    case OpCode::LINEAR:
+      return Linear<T>(imm).backward_n(grad, first, {}, out);
+    case OpCode::DIV:
+    case OpCode::FMA:
+      for (std::size_t i = 0; i < out.size(); ++i) {
+        out[i] += backward_operand(code, imm, grad[i], slot, first[i], second[i],
+                                   third.empty() ? T(0) : third[i]);
+      }
+      return;
+    case OpCode::CHECKPOINT:
+    case OpCode::NONE:
+      break;
+    }
+    throw new std::runtime_error("in backward_operand_n, not implemented for this op");
+  }
+
 } // namespace Operation
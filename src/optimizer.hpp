@@ -0,0 +1,196 @@
+#pragma once
+#include "parameters.hpp"
+#include "thread-pool.hpp"
+#include <cmath>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+// optimizers over flat parameter and gradient arrays.
+// a step is one fused elementwise pass over parameters, gradients and the
+// optimizer state: no per parameter dispatch or pointer chasing, and loops
+// simple enough for the compiler to vectorize. given a ThreadPool, large
+// models are split into blocks stepped in parallel; every element is
+// updated by the same arithmetic either way, so results don't depend on
+// the thread count.
+//
+//   OptimNS::Adam<float> adam(params.size(), {.lr = 1e-3f});
+//   ...backpropagate...
+//   adam.step(params);  // gather, update, scatter values
+//   params.zero_grad();
+//
+// state is allocated for a fixed number of parameters at construction.
+namespace OptimNS {
+
+// elements per parallel block, big enough to amortize the task
+constexpr std::size_t block = 1 << 14;
+
+// runs kernel(begin, end) over [0, n), in blocks on pool if there is one
+template <typename F>
+void for_blocks(std::size_t n, ThreadPool *pool, F &&kernel) {
+  if (!pool || pool->size() == 1 || n <= block) {
+    kernel(std::size_t(0), n);
+    return;
+  }
+  pool->parallel_for(0, (n + block - 1) / block, 1, [&](std::size_t b) {
+    kernel(b * block, std::min(n, (b + 1) * block));
+  });
+}
+
+template <typename T, typename Derived>
+struct Optimizer {
+  ThreadPool *pool = nullptr;
+  std::size_t size;
+
+  explicit Optimizer(std::size_t size) : size(size) {}
+
+  void check(std::size_t n) const {
+    if (n != size) {
+      throw new std::runtime_error("optimizer was set up for a different number of parameters");
+    }
+  }
+
+  void step(std::span<T> params, std::span<const T> grads) {
+    check(params.size());
+    check(grads.size());
+    auto &self = static_cast<Derived &>(*this);
+    self.begin_step();
+    for_blocks(size, pool, [&](std::size_t begin, std::size_t end) {
+      self.update(params.data(), grads.data(), begin, end);
+    });
+  }
+
+  // the registry's values and gradients in, its updated values out. the
+  // values are gathered each step, so edits to a node's data between steps
+  // aren't overwritten by a stale copy
+  void step(ScalarNS::ParameterRegistry<T> &registry) {
+    auto values = registry.gather_values();
+    auto grads = registry.gather_grads();
+    step(values, grads);
+    registry.scatter_values();
+  }
+
+  // loose leaves, e.g. made with make_scalar, copied through scratch arrays
+  void step(const std::vector<ScalarNS::Scalar<T>> &leaves) {
+    scratch_values.resize(leaves.size());
+    scratch_grads.resize(leaves.size());
+    for (std::size_t i = 0; i < leaves.size(); ++i) {
+      scratch_values[i] = leaves[i]->data;
+      scratch_grads[i] = leaves[i]->grad;
+    }
+    step(std::span<T>(scratch_values), std::span<const T>(scratch_grads));
+    for (std::size_t i = 0; i < leaves.size(); ++i) {
+      leaves[i]->data = scratch_values[i];
+    }
+  }
+
+private:
+  std::vector<T> scratch_values;
+  std::vector<T> scratch_grads;
+};
+
+// plain sgd, with momentum when momentum > 0:
+//   v = momentum * v + g;  p -= lr * v
+// weight_decay adds weight_decay * p to g.
+template <typename T>
+struct Sgd : Optimizer<T, Sgd<T>> {
+  struct Options {
+    T lr = T(0.01);
+    T momentum = 0;
+    T weight_decay = 0;
+  };
+  Options options;
+  std::vector<T> velocity;
+
+  Sgd(std::size_t size, Options options)
+      : Optimizer<T, Sgd<T>>(size), options(options),
+        velocity(options.momentum != 0 ? size : 0) {}
+
+  // options are public, momentum may have been turned on since
+  void begin_step() {
+    if (options.momentum != 0 && velocity.size() != this->size) {
+      velocity.assign(this->size, T(0));
+    }
+  }
+
+  void update(T *p, const T *g, std::size_t begin, std::size_t end) {
+    const T lr = options.lr;
+    const T wd = options.weight_decay;
+    const T mu = options.momentum;
+    if (mu == 0) {
+      for (std::size_t i = begin; i < end; ++i) {
+        p[i] -= lr * (g[i] + wd * p[i]);
+      }
+      return;
+    }
+    T *v = velocity.data();
+    for (std::size_t i = begin; i < end; ++i) {
+      v[i] = mu * v[i] + (g[i] + wd * p[i]);
+      p[i] -= lr * v[i];
+    }
+  }
+};
+
+// adam, and adamw when decoupled is set:
+//   m = b1 m + (1 - b1) g;  v = b2 v + (1 - b2) g^2
+//   p -= lr * (m / (1 - b1^t)) / (sqrt(v / (1 - b2^t)) + eps)
+// weight_decay is added to g for adam (l2), and applied to p directly as
+// p -= lr * weight_decay * p for adamw.
+template <typename T>
+struct Adam : Optimizer<T, Adam<T>> {
+  struct Options {
+    T lr = T(0.001);
+    T beta1 = T(0.9);
+    T beta2 = T(0.999);
+    T eps = T(1e-8);
+    T weight_decay = 0;
+    bool decoupled = false;
+  };
+  Options options;
+  std::vector<T> m;
+  std::vector<T> v;
+  std::size_t t = 0;
+  // bias corrections of the current step
+  T c1 = 1;
+  T c2 = 1;
+
+  Adam(std::size_t size, Options options)
+      : Optimizer<T, Adam<T>>(size), options(options), m(size), v(size) {}
+
+  void begin_step() {
+    ++t;
+    c1 = 1 - std::pow(options.beta1, T(t));
+    c2 = 1 - std::pow(options.beta2, T(t));
+  }
+
+  void update(T *p, const T *g, std::size_t begin, std::size_t end) {
+    const T lr = options.lr;
+    const T b1 = options.beta1;
+    const T b2 = options.beta2;
+    const T eps = options.eps;
+    const T wd = options.weight_decay;
+    // l2 folds into the gradient, decoupled decay into the parameter
+    const T l2 = options.decoupled ? T(0) : wd;
+    const T shrink = options.decoupled ? 1 - lr * wd : T(1);
+    const T step_size = lr / c1;
+    const T inv_c2 = 1 / c2;
+    T *mm = m.data();
+    T *vv = v.data();
+    for (std::size_t i = begin; i < end; ++i) {
+      const T gi = g[i] + l2 * p[i];
+      mm[i] = b1 * mm[i] + (1 - b1) * gi;
+      vv[i] = b2 * vv[i] + (1 - b2) * gi * gi;
+      p[i] = shrink * p[i] - step_size * mm[i] / (std::sqrt(vv[i] * inv_c2) + eps);
+    }
+  }
+};
+
+// adam with decoupled weight decay
+template <typename T>
+struct AdamW : Adam<T> {
+  AdamW(std::size_t size, typename Adam<T>::Options options)
+      : Adam<T>(size, (options.decoupled = true, options)) {}
+};
+
+} // namespace OptimNS
@@ -0,0 +1,103 @@
+#pragma once
+#include "scalar.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+
+// the trainable leaves of a model, kept apart from the graphs built on them.
+// parameters are placed back to back in the registry's own arena, so the
+// gathers are a linear sweep over the parameters, O(params) and
+// independent of the size of the graph, where clear_gradient walks every
+// node reachable from a loss.
+// values and grads are flat arrays for the optimizer math. the nodes keep
+// their own data and grad, which every op reads directly, so the arrays
+// are not the storage itself; instead the gradient of parameter i is
+// grads[i] plus whatever backpropagate has added to its node since.
+// gather_grads moves the nodes' share into grads (leaving the nodes at
+// zero), and zero_grad only has to clear the one contiguous grads array.
+// gather before zero_grad: gradient still on a node isn't cleared.
+//
+//   ParameterRegistry<float> params;
+//   auto w = params.add(0.5f, "w");
+//   ...build loss from w, backpropagate({loss})...
+//   auto g = params.gather_grads();
+//   for (i...) params.values[i] -= lr * g[i];
+//   params.scatter_values();
+//   params.zero_grad();
+//
+// the Scalars handed out don't own their node: the registry has to outlive
+// every graph built on its parameters.
+namespace ScalarNS {
+
+template <typename T>
+struct ParameterRegistry {
+  // handles in registration order, index i is entry i of the flat arrays
+  std::vector<Scalar<T>> params;
+  std::vector<T> values;
+  std::vector<T> grads;
+
+  ParameterRegistry() = default;
+  explicit ParameterRegistry(std::size_t chunk_nodes) : storage(chunk_nodes) {}
+  ParameterRegistry(const ParameterRegistry &) = delete;
+  ParameterRegistry &operator=(const ParameterRegistry &) = delete;
+
+  Scalar<T> add(T value, std::string label = "") {
+    auto p = label.empty() ? storage.create(value) : storage.create(value, label);
+    params.push_back(p);
+    values.push_back(value);
+    grads.push_back(0);
+    return p;
+  }
+  // n parameters drawn from init, e.g. a UniformFloatInit
+  template <typename Init>
+  std::vector<Scalar<T>> add_n(std::size_t n, Init &&init) {
+    std::vector<Scalar<T>> added;
+    added.reserve(n);
+    params.reserve(params.size() + n);
+    for (std::size_t i = 0; i < n; ++i) {
+      added.push_back(add(init()));
+    }
+    return added;
+  }
+
+  std::size_t size() const { return params.size(); }
+  const Scalar<T> &operator[](std::size_t i) const { return params[i]; }
+
+  void zero_grad() { std::fill(grads.begin(), grads.end(), T(0)); }
+
+  // moves the gradient on the nodes into grads, gathering twice is harmless
+  std::span<T> gather_grads() {
+    std::size_t i = 0;
+    storage.arena.for_each([&](ScalarValue<T> &p) {
+      grads[i++] += p.grad;
+      p.grad = 0;
+    });
+    return grads;
+  }
+  std::span<T> gather_values() {
+    std::size_t i = 0;
+    storage.arena.for_each([&](ScalarValue<T> &p) { values[i++] = p.data; });
+    return values;
+  }
+  // writes values back into the parameter nodes
+  void scatter_values() {
+    std::size_t i = 0;
+    storage.arena.for_each([&](ScalarValue<T> &p) { p.data = values[i++]; });
+  }
+  // moves grads back onto the nodes, the inverse of gather_grads
+  void scatter_grads() {
+    std::size_t i = 0;
+    storage.arena.for_each([&](ScalarValue<T> &p) {
+      p.grad += grads[i];
+      grads[i++] = 0;
+    });
+  }
+
+private:
+  // holds the parameters and nothing else, the sweeps above rely on it
+  GraphContext<T> storage;
+};
+
+} // namespace ScalarNS
@@ -0,0 +1,118 @@
+#pragma once
+#include "scalar.hpp"
+#include "tape.hpp"
+#include "topo.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+// trace once, replay many.
+// capture() sorts a ScalarValue graph a single time and copies it onto a
+// tape in that order, so every node gets a fixed value and grad slot.
+// after that a training step is: write the leaves through their Var
+// handles, forward(), backward(). nothing is allocated or sorted again.
+//
+//   auto plan = PlanNS::capture({loss});
+//   auto xv = plan.var(x);
+//   xv->data = 0.25f;
+//   plan.forward();
+//   plan.backward();  // xv->grad
+//
+// results are the ones backpropagate gives on a freshly built graph: the
+// ops are the same and the sweep adds gradients in the same order.
+// nodes made by ExprNS::materialize only hold the expression's value and
+// gradient at the point they were built, not the expression itself, so
+// graphs with them are rejected like checkpointed ones.
+namespace PlanNS {
+
+// what a compiled form of a plan is run for: INFERENCE drops everything
+// only the backward pass needs
+enum class Mode { TRAINING, INFERENCE };
+
+template <typename T>
+struct Plan {
+  TapeNS::Tape<T> tape;
+  // tape entries of the outputs, seeded with 1 by backward
+  std::vector<std::uint32_t> outputs;
+  // captured node -> tape entry, only used when handing out Vars
+  std::unordered_map<const ScalarNS::ScalarValue<T> *, std::uint32_t> slots;
+  // keeps heap nodes alive so no other node can take an address in slots;
+  // arena nodes are up to their GraphContext
+  std::vector<ScalarNS::Scalar<T>> roots;
+
+  Plan() = default;
+  // Vars point into the tape, so a plan isn't copied; move it only before
+  // handing out Vars
+  Plan(const Plan &) = delete;
+  Plan &operator=(const Plan &) = delete;
+  Plan(Plan &&) = default;
+  Plan &operator=(Plan &&) = default;
+
+  std::size_t size() const { return tape.size(); }
+
+  // handle to the slot of a captured node, keep it across steps
+  TapeNS::Var<T> var(const ScalarNS::Scalar<T> &node) {
+    auto it = slots.find(node.get());
+    if (it == slots.end()) {
+      throw new std::runtime_error("node is not part of the captured graph");
+    }
+    return {&tape, it->second};
+  }
+  TapeNS::Var<T> output(std::size_t i = 0) { return {&tape, outputs.at(i)}; }
+
+  void forward() { tape.forward(); }
+
+  // gradients of this pass only, for every slot including the leaves
+  void backward() {
+    tape.zero_grad();
+    if (size() == 0 || outputs.empty()) {
+      return;
+    }
+    std::uint32_t last = 0;
+    for (auto o : outputs) {
+      tape.grad[o] = 1;
+      last = std::max(last, o);
+    }
+    tape.backward_from(last);
+  }
+};
+
+template <typename T>
+Plan<T> capture(const std::vector<ScalarNS::Scalar<T>> &outputs) {
+  Plan<T> plan;
+  auto sorted = topological_sort(outputs);
+  plan.tape.reserve(sorted.size());
+  plan.slots.reserve(sorted.size());
+  for (const auto &node : sorted) {
+    if (node->code == Operation::OpCode::CHECKPOINT) {
+      throw new std::runtime_error("checkpointed graphs can't be captured");
+    }
+    if (node->code == Operation::OpCode::LINEAR) {
+      throw new std::runtime_error("materialized expressions can't be captured");
+    }
+    std::uint32_t l = 0;
+    std::uint32_t r = 0;
+    // children come earlier in sorted, so they already have a slot
+    if (node->num_children() > 0) {
+      l = plan.slots.at(node->child1.get());
+      r = node->num_children() > 1 ? plan.slots.at(node->child2.get()) : l;
+    }
+    auto v = plan.tape.push(node->code, l, r, node->imm, node->data);
+    plan.slots.emplace(node.get(), v.index);
+  }
+  for (const auto &o : outputs) {
+    plan.outputs.push_back(plan.slots.at(o.get()));
+  }
+  plan.roots = outputs;
+  return plan;
+}
+
+template <typename T>
+Plan<T> capture(std::initializer_list<ScalarNS::Scalar<T>> outputs) {
+  return capture(std::vector<ScalarNS::Scalar<T>>(outputs));
+}
+
+} // namespace PlanNS
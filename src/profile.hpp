@@ -0,0 +1,234 @@
+#pragma once
+#include "operation.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <fmt/format.h>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// opt-in instrumentation of the forward, sort and backward passes.
+// configure with -DHUGEGRAD_PROFILE=ON and the hooks the passes call
+// (HUGEGRAD_PROFILE_SCOPE, HUGEGRAD_PROFILE_OP) start recording; without
+// it they expand to nothing. two things are recorded:
+// - per op: calls and time by OpCode for forward and backward, and by the
+//   label of labelled nodes on the backward pass
+// - per pass: one trace event for every Tape/Plan forward,
+//   topological_sort and backward sweep, on the thread that ran it
+//
+//   fmt::print("{}", ProfileNS::report());  // table, see formatting.hpp
+//   ProfileNS::write_trace("trace.json");    // chrome://tracing or perfetto
+//
+// a graph of Scalars is evaluated while it is built, so wrap the model in
+// HUGEGRAD_PROFILE_SCOPE("forward") to see that pass in the trace.
+// threads record into their own buffers; report, write_trace and reset
+// merge or clear them and are meant for when no pass is running.
+namespace ProfileNS {
+
+using Clock = std::chrono::steady_clock;
+
+enum class Pass : std::uint8_t { FORWARD, BACKWARD };
+
+struct OpStats {
+  std::uint64_t calls = 0;
+  std::uint64_t ns = 0;
+
+  void add(std::uint64_t elapsed) {
+    ++calls;
+    ns += elapsed;
+  }
+};
+
+constexpr std::size_t op_codes = static_cast<std::size_t>(Operation::OpCode::CHECKPOINT) + 1;
+
+// one finished pass; name is a string literal
+struct Event {
+  const char *name;
+  Clock::time_point start;
+  Clock::duration length;
+};
+
+struct ThreadRecord {
+  std::uint32_t tid = 0;
+  std::array<std::array<OpStats, op_codes>, 2> ops{};
+  std::unordered_map<std::string, OpStats> labels;
+  std::vector<Event> events;
+};
+
+struct Registry {
+  std::mutex m;
+  // never shrinks, records outlive their threads
+  std::vector<std::unique_ptr<ThreadRecord>> threads;
+  Clock::time_point origin = Clock::now();
+};
+
+inline Registry &registry() {
+  static Registry r;
+  return r;
+}
+
+inline ThreadRecord &thread_record() {
+  thread_local ThreadRecord *record = [] {
+    auto &r = registry();
+    std::lock_guard lock(r.m);
+    r.threads.push_back(std::make_unique<ThreadRecord>());
+    r.threads.back()->tid = static_cast<std::uint32_t>(r.threads.size() - 1);
+    return r.threads.back().get();
+  }();
+  return *record;
+}
+
+inline std::uint64_t nanoseconds(Clock::duration d) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+}
+
+// times the enclosing block as one trace event
+struct Scope {
+  const char *name;
+  Clock::time_point start = Clock::now();
+
+  explicit Scope(const char *name) : name(name) {}
+  Scope(const Scope &) = delete;
+  Scope &operator=(const Scope &) = delete;
+  ~Scope() { thread_record().events.push_back({name, start, Clock::now() - start}); }
+};
+
+inline const std::string no_label;
+
+// times the enclosing block as one call of op code
+struct OpTimer {
+  Pass pass;
+  Operation::OpCode code;
+  const std::string &label;
+  Clock::time_point start = Clock::now();
+
+  OpTimer(Pass pass, Operation::OpCode code, const std::string &label = no_label)
+      : pass(pass), code(code), label(label) {}
+  OpTimer(const OpTimer &) = delete;
+  OpTimer &operator=(const OpTimer &) = delete;
+  ~OpTimer() {
+    if (code == Operation::OpCode::NONE) {
+      // leaves, nothing ran
+      return;
+    }
+    const auto elapsed = nanoseconds(Clock::now() - start);
+    auto &record = thread_record();
+    record.ops[static_cast<std::size_t>(pass)][static_cast<std::size_t>(code)].add(elapsed);
+    if (!label.empty()) {
+      record.labels[label].add(elapsed);
+    }
+  }
+};
+
+struct OpRow {
+  Pass pass;
+  Operation::OpCode code;
+  OpStats stats;
+};
+struct LabelRow {
+  std::string label;
+  OpStats stats;
+};
+struct PassRow {
+  std::string name;
+  OpStats stats;
+};
+
+// everything recorded so far over all threads, each part sorted by time
+struct Report {
+  std::vector<OpRow> ops;
+  std::vector<LabelRow> labels;
+  std::vector<PassRow> passes;
+};
+
+inline Report report() {
+  auto &r = registry();
+  std::lock_guard lock(r.m);
+  std::array<std::array<OpStats, op_codes>, 2> ops{};
+  std::unordered_map<std::string, OpStats> labels;
+  std::unordered_map<std::string, OpStats> passes;
+  for (const auto &t : r.threads) {
+    for (std::size_t p = 0; p < 2; ++p) {
+      for (std::size_t c = 0; c < op_codes; ++c) {
+        ops[p][c].calls += t->ops[p][c].calls;
+        ops[p][c].ns += t->ops[p][c].ns;
+      }
+    }
+    for (const auto &[label, stats] : t->labels) {
+      labels[label].calls += stats.calls;
+      labels[label].ns += stats.ns;
+    }
+    for (const auto &e : t->events) {
+      passes[e.name].add(nanoseconds(e.length));
+    }
+  }
+  Report out;
+  for (std::size_t p = 0; p < 2; ++p) {
+    for (std::size_t c = 0; c < op_codes; ++c) {
+      if (ops[p][c].calls != 0) {
+        out.ops.push_back({static_cast<Pass>(p), static_cast<Operation::OpCode>(c), ops[p][c]});
+      }
+    }
+  }
+  for (const auto &[label, stats] : labels) {
+    out.labels.push_back({label, stats});
+  }
+  for (const auto &[name, stats] : passes) {
+    out.passes.push_back({name, stats});
+  }
+  auto by_time = [](const auto &a, const auto &b) { return a.stats.ns > b.stats.ns; };
+  std::sort(out.ops.begin(), out.ops.end(), by_time);
+  std::sort(out.labels.begin(), out.labels.end(), by_time);
+  std::sort(out.passes.begin(), out.passes.end(), by_time);
+  return out;
+}
+
+// the pass events in chrome's trace_event format, one row per thread
+inline void write_trace(const std::string &path) {
+  auto &r = registry();
+  std::lock_guard lock(r.m);
+  std::ofstream out(path);
+  if (!out) {
+    throw new std::runtime_error(fmt::format("can't write trace to {}", path));
+  }
+  out << "{\"traceEvents\": [";
+  bool first = true;
+  auto us = [](Clock::duration d) { return static_cast<double>(nanoseconds(d)) / 1e3; };
+  for (const auto &t : r.threads) {
+    for (const auto &e : t->events) {
+      out << (first ? "\n" : ",\n")
+          << fmt::format(R"({{"name": "{}", "ph": "X", "pid": 0, "tid": {}, "ts": {:.3f}, "dur": {:.3f}}})",
+                         e.name, t->tid, us(e.start - r.origin), us(e.length));
+      first = false;
+    }
+  }
+  out << "\n], \"displayTimeUnit\": \"ns\"}\n";
+}
+
+// forgets everything recorded so far
+inline void reset() {
+  auto &r = registry();
+  std::lock_guard lock(r.m);
+  for (auto &t : r.threads) {
+    t->ops = {};
+    t->labels.clear();
+    t->events.clear();
+  }
+  r.origin = Clock::now();
+}
+
+} // namespace ProfileNS
+
+#if HUGEGRAD_PROFILE
+#define HUGEGRAD_PROFILE_SCOPE(name) ProfileNS::Scope hugegrad_profile_scope(name)
+#define HUGEGRAD_PROFILE_OP(...) ProfileNS::OpTimer hugegrad_profile_op(__VA_ARGS__)
+#else
+#define HUGEGRAD_PROFILE_SCOPE(name)
+#define HUGEGRAD_PROFILE_OP(...)
+#endif
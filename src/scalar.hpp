@@ -1,5 +1,9 @@
 #pragma once
+#include "arena.hpp"
 #include "operation.hpp"
+#include "profile.hpp"
+#include <atomic>
+#include <cstdint>
 #include <fmt/format.h>
 #include <memory>
 #include <optional>
@@ -7,20 +11,50 @@
 #include <string>
 #include <tuple>
 #include <cmath>
+#include <functional>
 #include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 namespace ScalarNS {
 
 template <typename T> struct ScalarValue;
 
 template <typename T> using Scalar = std::shared_ptr<ScalarValue<T>>;
 
-enum class SeenMark { NONE, TMP, PERM };
+// traversals stamp the nodes they visit instead of flipping a flag, so marks
+// left behind by earlier traversals read as "unvisited" without a reset walk.
+// each traversal owns two stamps: gen (on the stack) and gen + 1 (finished).
+inline std::atomic<std::uint64_t> generation_counter{0};
+inline std::uint64_t next_generation() {
+  return generation_counter.fetch_add(2, std::memory_order_relaxed) + 2;
+}
+// n consecutive stamps no traversal will hand out, for passes that number
+// the nodes of a sorted graph in their seen field (stamp = base + index)
+inline std::uint64_t reserve_generations(std::uint64_t n) {
+  return generation_counter.fetch_add(n, std::memory_order_relaxed) + 2;
+}
+
+// the part of a checkpoint node that evaluates its segment again, see
+// checkpoint.hpp. returns grad * d output / d input and adds the segment's
+// contributions to the leaves it reads.
+template <typename T>
+struct Segment {
+  virtual ~Segment() = default;
+  virtual T backward(T grad, T input) = 0;
+};
+
+template <typename T> struct CheckpointValue;
+
 template <typename T>
 struct ScalarValue {
   Scalar<T> child1;
   Scalar<T> child2;
 
-  Operation::Operation<T>* op;
+  // the op is stored inline and dispatched with a switch, no vtable and no
+  // shared op objects. imm is the op's parameter (the pow exponent).
+  Operation::OpCode code = Operation::OpCode::NONE;
+  T imm = 0;
 
   // aka "activation"
   T data = 0;
@@ -29,93 +63,339 @@ struct ScalarValue {
 
   std::string label;
 
-  SeenMark seen = SeenMark::NONE;
+  // generation stamp of the last traversal that reached this node
+  std::uint64_t seen = 0;
+
+  // the gradient child1 gets from a unary op
+  T unary_backward(T g) const {
+    if (code == Operation::OpCode::CHECKPOINT) {
+      return static_cast<const CheckpointValue<T> *>(this)->segment->backward(g, child1->data);
+    }
+    return Operation::backward(code, imm, g, child1->data, T(0));
+  }
+
+  std::size_t num_children() const {
+    switch (Operation::op_type(code)) {
+    case Operation::OpType::BINARY:
+      return 2;
+    case Operation::OpType::UNARY:
+      return 1;
+    case Operation::OpType::NONE:
+    case Operation::OpType::TERNARY:
+      return 0;
+    }
+    return 0;
+  }
+  Scalar<T> &child(std::size_t i) { return i == 0 ? child1 : child2; }
 
+  // zeroes the gradient of every node reachable from this one
   void clear_gradient() {
-    grad = 0;
-    seen = false;
-    if (op->type != Operation::OpType::NONE) {
-      child1->clear_gradient();
-      child2->clear_gradient();
+    const auto gen = next_generation();
+    std::vector<ScalarValue *> stack{this};
+    seen = gen;
+    while (!stack.empty()) {
+      auto node = stack.back();
+      stack.pop_back();
+      node->grad = 0;
+      for (std::size_t i = 0; i < node->num_children(); ++i) {
+        auto c = node->child(i).get();
+        if (c->seen != gen) {
+          c->seen = gen;
+          stack.push_back(c);
+        }
+      }
     }
   }
 
   // derivative of anything with respect to itself is 1
+  // walks the graph as a tree, use backpropagate for graphs with shared nodes
   void compute_grad(T prev_grad = 1) {
-    //fmt::print("{}\n", *this);
-    if (seen != SeenMark::NONE) {
-      //fmt::print("throwing\n");
-      throw new std::runtime_error(fmt::format("node {} has been seen before, aborting", label));
+    const auto gen = next_generation();
+    std::vector<std::pair<ScalarValue *, T>> stack{{this, prev_grad}};
+    while (!stack.empty()) {
+      auto [node, incoming] = stack.back();
+      stack.pop_back();
+      if (node->seen == gen) {
+        throw new std::runtime_error(
+            fmt::format("node {} has been seen before, aborting", node->label));
+      }
+      node->seen = gen;
+      node->grad += incoming;
+      const auto code = node->code;
+      const T imm = node->imm;
+      auto c1 = node->child1.get();
+      auto c2 = node->child2.get();
+      // child2 goes on the stack first so child1's subtree is finished first
+      switch (Operation::op_type(code)) {
+      case Operation::OpType::BINARY:
+        stack.emplace_back(
+            c2, Operation::backward(code, imm, node->grad, c2->data, c1->data));
+        stack.emplace_back(
+            c1, Operation::backward(code, imm, node->grad, c1->data, c2->data));
+        break;
+      case Operation::OpType::UNARY:
+        stack.emplace_back(c1, node->unary_backward(node->grad));
+        break;
+      case Operation::OpType::NONE:
+      case Operation::OpType::TERNARY:
+        break;
+      }
     }
-    seen = SeenMark::PERM;
-    grad += prev_grad;
-    switch (op->get_type()) {
-    case Operation::OpType::BINARY:
-      child1->compute_grad(op->backward(grad, child1->data, child2->data));
-      child2->compute_grad(op->backward(grad, child2->data, child1->data));
-      break;
-    case Operation::OpType::UNARY:
-      child1->compute_grad(op->backward(grad, child1->data, 0));
-      break;
-    case Operation::OpType::NONE:
-      break;
+  }
+
+  // gradient this node sends to child(i)
+  T grad_contribution(std::size_t i) const {
+    if (Operation::op_type(code) == Operation::OpType::UNARY) {
+      return unary_backward(grad);
     }
+    return i == 0 ? Operation::backward(code, imm, grad, child1->data, child2->data)
+                  : Operation::backward(code, imm, grad, child2->data, child1->data);
   }
 
   void propagate_gradient() {
     // assumes grad is set to the correct value
     // used to propagate gradients from topolgical sort
-    switch (op->get_type()) {
+    HUGEGRAD_PROFILE_OP(ProfileNS::Pass::BACKWARD, code, label);
+    switch (Operation::op_type(code)) {
     case Operation::OpType::BINARY:
-      child1->grad += op->backward(grad, child1->data, child2->data);
-      child2->grad += op->backward(grad, child2->data, child1->data);
+      child1->grad += Operation::backward(code, imm, grad, child1->data, child2->data);
+      child2->grad += Operation::backward(code, imm, grad, child2->data, child1->data);
       break;
     case Operation::OpType::UNARY:
-      child1->grad += op->backward(grad, child1->data, 0);
+      child1->grad += unary_backward(grad);
       break;
     case Operation::OpType::NONE:
+    case Operation::OpType::TERNARY:
       break;
     }
   }
 
-  ScalarValue(T data) : data(data), op(Operation::none_ptr<T>) {}
-  ScalarValue(T data, std::string label) : data(data), label(label), op(Operation::none_ptr<T>) {}
+  ScalarValue(T data) : data(data) {}
+  ScalarValue(T data, std::string label) : data(data), label(label) {}
+
+  ScalarValue(T data, Scalar<T> &child1, Scalar<T> &child2, Operation::OpCode code,
+              T imm = 0)
+      : child1(child1), child2(child2), code(code), imm(imm), data(data) {}
+
+  ScalarValue(T data, Scalar<T> &child1, Scalar<T> &child2, Operation::OpCode code,
+              T imm, std::string &label)
+      : child1(child1), child2(child2), code(code), imm(imm), data(data), label(label) {}
+  ScalarValue() = default;
 
-  ScalarValue(T data, Scalar<T> &child1, Scalar<T> &child2, Operation::Operation<T>* op)
-      : data(data), op(op), child1(child1), child2(child2) {
-    if (child1.get() == child2.get()) {
-      throw new std::runtime_error("cannot have the same children for now");
+  // children this node is the last owner of are moved onto a stack and
+  // released one at a time, so freeing a long heap chain doesn't recurse
+  // once per node. arena handles own nothing and are left alone.
+  ~ScalarValue() {
+    std::vector<Scalar<T>> stack;
+    auto take = [&stack](Scalar<T> &c) {
+      if (c.use_count() == 1) {
+        stack.push_back(std::move(c));
+      }
+    };
+    take(child1);
+    take(child2);
+    while (!stack.empty()) {
+      auto node = std::move(stack.back());
+      stack.pop_back();
+      take(node->child1);
+      take(node->child2);
     }
   }
+};
+
+// a CHECKPOINT node, the only kind that owns a Segment. kept out of
+// ScalarValue so the other nodes don't carry the pointer; always on the
+// heap, the arena only holds plain ScalarValues.
+template <typename T>
+struct CheckpointValue : ScalarValue<T> {
+  std::unique_ptr<Segment<T>> segment;
+
+  CheckpointValue(T data, Scalar<T> input, std::unique_ptr<Segment<T>> segment)
+      : segment(std::move(segment)) {
+    this->data = data;
+    this->child1 = std::move(input);
+    this->code = Operation::OpCode::CHECKPOINT;
+  }
+};
+
+// owns the nodes of one graph (e.g. one training step).
+// while a GraphScope is active every node built through make_scalar or the
+// operators below is placed in the context's arena instead of the heap, and
+// handed out as a non-owning Scalar: no control block, no refcount traffic.
+// reset() frees the whole graph at once; Scalars into it dangle afterwards.
+template <typename T>
+struct GraphContext {
+  Arena<ScalarValue<T>> arena;
+
+  GraphContext() = default;
+  explicit GraphContext(std::size_t chunk_nodes) : arena(chunk_nodes) {}
+
+  template <typename... Args>
+  Scalar<T> create(Args &&...args) {
+    ScalarValue<T> *node = arena.create(std::forward<Args>(args)...);
+    // aliasing constructor with an empty owner: points at node, owns nothing
+    return Scalar<T>(Scalar<T>(), node);
+  }
+  void reset() { arena.reset(); }
+  std::size_t size() const { return arena.size(); }
+};
+
+template <typename T>
+inline thread_local GraphContext<T> *active_graph = nullptr;
+
+// makes ctx the allocation target for Scalar<T> nodes on this thread
+template <typename T>
+struct GraphScope {
+  GraphContext<T> *previous;
+  explicit GraphScope(GraphContext<T> &ctx) : previous(active_graph<T>) {
+    active_graph<T> = &ctx;
+  }
+  GraphScope(const GraphScope &) = delete;
+  GraphScope &operator=(const GraphScope &) = delete;
+  ~GraphScope() { active_graph<T> = previous; }
+};
 
-  ScalarValue(T data, Scalar<T> &child1, Scalar<T> &child2, Operation::Operation<T>* op,
-              std::string &label)
-      : data(data), op(op), child1(child1), child2(child2), label(label) {
-    if (child1.get() == child2.get()) {
-      throw new std::runtime_error("cannot have the same children for now");
+// hash consing: while a CseScope is active, building an op that already
+// exists with the same operands (or a constant with the same value) returns
+// the existing node, so repeated subexpressions are stored and
+// differentiated once. operands are compared by identity; add and mul
+// match either operand order. a node is only handed out again if its value
+// is what the op gives for its operands' current data: after a leaf
+// changes (say an optimizer step) rebuilding an expression on it makes new
+// nodes, which replace the stale ones in the table. the table holds on to
+// every node it hands out until it is cleared or destroyed; clear it along
+// with the GraphContext when the nodes live in an arena.
+template <typename T>
+struct CseTable {
+  struct Key {
+    Operation::OpCode code;
+    const ScalarValue<T> *first;
+    const ScalarValue<T> *second;
+    T imm;
+    bool operator==(const Key &) const = default;
+  };
+  struct KeyHash {
+    std::size_t operator()(const Key &k) const {
+      std::size_t h = std::hash<const void *>()(k.first);
+      h = h * 31 + std::hash<const void *>()(k.second);
+      h = h * 31 + std::hash<T>()(k.imm);
+      return h * 31 + static_cast<std::size_t>(k.code);
+    }
+  };
+  std::unordered_map<Key, Scalar<T>, KeyHash> nodes;
+  // lookups answered with an existing node
+  std::size_t hits = 0;
+
+  static Key key(Operation::OpCode code, const Scalar<T> &child1,
+                 const Scalar<T> &child2, T imm) {
+    const ScalarValue<T> *a = child1.get();
+    const ScalarValue<T> *b = child2.get();
+    const bool commutes = code == Operation::OpCode::ADD || code == Operation::OpCode::MUL;
+    if (commutes && std::less<const ScalarValue<T> *>()(b, a)) {
+      std::swap(a, b);
     }
+    return {code, a, b, imm};
+  }
+  // the node for k if it still holds value
+  Scalar<T> find(const Key &k, T value) {
+    auto it = nodes.find(k);
+    if (it == nodes.end() || !(it->second->data == value)) {
+      return nullptr;
+    }
+    ++hits;
+    return it->second;
+  }
+  void insert(const Key &k, const Scalar<T> &node) { nodes.insert_or_assign(k, node); }
+  std::size_t size() const { return nodes.size(); }
+  void clear() {
+    nodes.clear();
+    hits = 0;
   }
-  ScalarValue() = default;
 };
 
+template <typename T>
+inline thread_local CseTable<T> *active_cse = nullptr;
+
+template <typename T>
+struct CseScope {
+  CseTable<T> *previous;
+  explicit CseScope(CseTable<T> &table) : previous(active_cse<T>) {
+    active_cse<T> = &table;
+  }
+  CseScope(const CseScope &) = delete;
+  CseScope &operator=(const CseScope &) = delete;
+  ~CseScope() { active_cse<T> = previous; }
+};
+
+template <typename T, typename... Args>
+Scalar<T> allocate_scalar(Args &&...args) {
+  if (auto ctx = active_graph<T>) {
+    return ctx->create(std::forward<Args>(args)...);
+  }
+  return Scalar<T>(new ScalarValue<T>(std::forward<Args>(args)...));
+}
+
 template <typename T> Scalar<T> make_scalar(T data) {
-  return Scalar<T>(new ScalarValue<T>(data));
+  return allocate_scalar<T>(data);
 }
 
 template <typename T> Scalar<T> make_scalar(T data, std::string label) {
-  return Scalar<T>(new ScalarValue<T>(data, label));
+  return allocate_scalar<T>(data, label);
 }
 
 template <typename T>
 Scalar<T> make_scalar(T data, Scalar<T> &child1,
-                      Scalar<T> &child2, Operation::Operation<T>* op,
+                      Scalar<T> &child2, Operation::OpCode code,
                       std::string label) {
-  return Scalar<T>(new ScalarValue<T>(data, child1, child2, op, label));
+  return allocate_scalar<T>(data, child1, child2, code, T(0), label);
 }
 template <typename T>
 Scalar<T> make_scalar(T data, Scalar<T> &child1, Scalar<T> &child2,
-                      Operation::Operation<T>* op) {
-  return Scalar<T>(new ScalarValue<T>(data, child1, child2, op));
+                      Operation::OpCode code, T imm = 0) {
+  return allocate_scalar<T>(data, child1, child2, code, imm);
+}
+
+// evaluates the op and records it, child2 is empty for unary ops
+template <typename T>
+Scalar<T> apply(Operation::OpCode code, Scalar<T> &child1, Scalar<T> &child2,
+                T imm = 0) {
+  auto cse = active_cse<T>;
+  const T second = child2 ? child2->data : T(0);
+  typename CseTable<T>::Key key{};
+  std::optional<T> value;
+  if (cse) {
+    key = CseTable<T>::key(code, child1, child2, imm);
+    value = Operation::forward(code, imm, child1->data, second);
+    if (auto hit = cse->find(key, *value)) {
+      return hit;
+    }
+  }
+  // forward time of a graph op includes making its node
+  HUGEGRAD_PROFILE_OP(ProfileNS::Pass::FORWARD, code);
+  auto node = make_scalar(value ? *value : Operation::forward(code, imm, child1->data, second),
+                          child1, child2, code, imm);
+  if (cse) {
+    cse->insert(key, node);
+  }
+  return node;
+}
+
+// leaf for a number appearing in an expression, e.g. the 2 in x * 2.
+// unlike make_scalar these are shared under a CseScope.
+template <typename T>
+Scalar<T> constant(T value) {
+  auto cse = active_cse<T>;
+  if (!cse) {
+    return make_scalar(value);
+  }
+  Scalar<T> none;
+  const auto key = CseTable<T>::key(Operation::OpCode::NONE, none, none, value);
+  if (auto hit = cse->find(key, value)) {
+    return hit;
+  }
+  auto node = make_scalar(value);
+  cse->insert(key, node);
+  return node;
 }
 
 template <typename T>
@@ -123,24 +403,19 @@ concept arithmetic = std::integral<T> || std::floating_point<T>;
 
 template <typename T>
 Scalar<T> operator+(Scalar<T> left, Scalar<T> right) {
-  auto op_ptr = Operation::add_ptr<T>;
-  return make_scalar(op_ptr->forward(left->data, right->data), left, right, op_ptr);
+  return apply(Operation::OpCode::ADD, left, right);
 }
 
 template <typename T, arithmetic K>
 Scalar<T> operator+(K left, Scalar<T> right) {
-  auto left_val = make_scalar(static_cast<T>(left));
-  auto op_ptr = Operation::add_ptr<T>;
-  return make_scalar(op_ptr->forward(left_val->data, right->data), left_val, right,
-                     op_ptr);
+  auto left_val = constant(static_cast<T>(left));
+  return apply(Operation::OpCode::ADD, left_val, right);
 }
 
 template <typename T, arithmetic K>
 Scalar<T> operator+(Scalar<T> left, K right) {
-  auto right_val = make_scalar(static_cast<T>(right));
-  auto op_ptr = Operation::add_ptr<T>;
-  return make_scalar(op_ptr->forward(left->data, right_val->data), left,
-                     right_val, op_ptr);
+  auto right_val = constant(static_cast<T>(right));
+  return apply(Operation::OpCode::ADD, left, right_val);
 }
 
 template <typename T>
@@ -165,31 +440,26 @@ Scalar<T> operator-(Scalar<T> left, K right) {
 
 template <typename T>
 Scalar<T> operator*(Scalar<T> left, Scalar<T> right) {
-  auto op_ptr = Operation::mul_ptr<T>;
-  return make_scalar(op_ptr->forward(left->data, right->data), left, right, op_ptr);
+  return apply(Operation::OpCode::MUL, left, right);
 }
 
 template <typename T, arithmetic K>
 Scalar<T> operator*(K left, Scalar<T> right) {
-  auto left_val = make_scalar(static_cast<K>(left));
-  auto op_ptr = Operation::mul_ptr<T>;
-  return make_scalar(op_ptr->forward(left_val->data, right->data), left_val, right,
-                     op_ptr);
+  auto left_val = constant(static_cast<T>(left));
+  return apply(Operation::OpCode::MUL, left_val, right);
 }
 
 
 template <typename T, arithmetic K>
 Scalar<T> operator*(Scalar<T> left, K right) {
-  auto right_val = make_scalar(static_cast<T>(right));
-  auto op_ptr = Operation::mul_ptr<T>;
-  return make_scalar(op_ptr->forward(left->data, right_val->data), left, right_val, op_ptr);
+  auto right_val = constant(static_cast<T>(right));
+  return apply(Operation::OpCode::MUL, left, right_val);
 }
 
 template <typename T>
 Scalar<T> pow(Scalar<T> val, T power) {
   Scalar<T> tmp;
-  auto op_ptr = Operation::pow_cache<T>.get(power);
-  return make_scalar(op_ptr->forward(val->data, 0), val, tmp, op_ptr);
+  return apply(Operation::OpCode::POW, val, tmp, power);
 }
 
 template <std::floating_point T>
@@ -222,8 +492,7 @@ bool operator!=(const Scalar<T> &left,
 template <typename T>
 Scalar<T> tanh(Scalar<T> val) {
   Scalar<T> tmp;
-  auto op_ptr = Operation::tanh_ptr<T>;
-  return make_scalar<T>(op_ptr->forward(val->data, 0), val, tmp, op_ptr);
+  return apply(Operation::OpCode::TANH, val, tmp);
 }
 
 template <std::floating_point T>
@@ -235,7 +504,6 @@ Scalar<T> tanh_exp(Scalar<T> val) {
 template <typename T>
 Scalar<T> exp(Scalar<T> val) {
   Scalar<T> tmp;
-  auto op_ptr = Operation::exp_ptr<T>;
-  return make_scalar<T>(op_ptr->forward(val->data, 0), val, tmp, op_ptr);
+  return apply(Operation::OpCode::EXP, val, tmp);
 }
 } // namespace Scalar
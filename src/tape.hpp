@@ -0,0 +1,307 @@
+#pragma once
+#include "operation.hpp"
+#include "profile.hpp"
+#include <algorithm>
+#include <cassert>
+#include <concepts>
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+// Wengert list alternative to the ScalarValue graph.
+// every op appends one record to flat arrays, in evaluation order, so the
+// tape is already topologically sorted: backward is one reverse sweep with
+// no sort and no pointer chasing.
+namespace TapeNS {
+
+template <typename T> struct Tape;
+
+// handle to an entry of a tape, used like a Scalar<T>
+template <typename T>
+struct Var {
+  Tape<T> *tape = nullptr;
+  std::uint32_t index = 0;
+
+  // lets user code keep writing x->data and x->grad
+  struct Entry {
+    T &data;
+    T &grad;
+    Entry *operator->() { return this; }
+  };
+  Entry operator->() const {
+    return {tape->value[index], tape->grad[index]};
+  }
+};
+
+// the arrays of a tape wherever they live, a Tape's vectors or a mapped
+// file (see archive.hpp)
+template <typename T>
+struct View {
+  std::size_t size;
+  const Operation::OpCode *code;
+  const std::uint32_t *lhs;
+  const std::uint32_t *rhs;
+  const std::uint32_t *aux;
+  const T *imm;
+  T *value;
+  T *grad;
+};
+
+// recomputes every op from the current values of its inputs
+template <typename T>
+void forward(const View<T> &t) {
+  HUGEGRAD_PROFILE_SCOPE("forward");
+  const auto *code = t.code;
+  const auto *lhs = t.lhs;
+  const auto *rhs = t.rhs;
+  const auto *imm = t.imm;
+  T *value = t.value;
+  for (std::size_t n = 0; n < t.size; ++n) {
+    HUGEGRAD_PROFILE_OP(ProfileNS::Pass::FORWARD, code[n]);
+    switch (Operation::op_type(code[n])) {
+    case Operation::OpType::BINARY:
+      value[n] = Operation::forward(code[n], imm[n], value[lhs[n]], value[rhs[n]]);
+      break;
+    case Operation::OpType::UNARY:
+      value[n] = Operation::forward<T>(code[n], imm[n], value[lhs[n]], 0);
+      break;
+    case Operation::OpType::TERNARY:
+      value[n] = Operation::forward(code[n], imm[n], value[lhs[n]], value[rhs[n]],
+                                    value[t.aux[n]]);
+      break;
+    case Operation::OpType::NONE:
+      break;
+    }
+  }
+}
+
+// reverse sweep from entry last down, with the output gradients already
+// seeded
+template <typename T>
+void backward_from(const View<T> &t, std::uint32_t last) {
+  HUGEGRAD_PROFILE_SCOPE("backward");
+  const auto *code = t.code;
+  const auto *imm = t.imm;
+  const T *value = t.value;
+  T *grad = t.grad;
+  for (std::size_t n = last + 1; n-- > 0;) {
+    HUGEGRAD_PROFILE_OP(ProfileNS::Pass::BACKWARD, code[n]);
+    const T g = grad[n];
+    const auto l = t.lhs[n];
+    const auto r = t.rhs[n];
+    switch (Operation::op_type(code[n])) {
+    case Operation::OpType::BINARY:
+      grad[l] += Operation::backward_operand(code[n], imm[n], g, 0, value[l], value[r]);
+      grad[r] += Operation::backward_operand(code[n], imm[n], g, 1, value[l], value[r]);
+      break;
+    case Operation::OpType::UNARY:
+      grad[l] += Operation::backward<T>(code[n], imm[n], g, value[l], 0);
+      break;
+    case Operation::OpType::TERNARY: {
+      const auto a = t.aux[n];
+      grad[l] += Operation::backward_operand(code[n], imm[n], g, 0, value[l],
+                                             value[r], value[a]);
+      grad[r] += Operation::backward_operand(code[n], imm[n], g, 1, value[l],
+                                             value[r], value[a]);
+      grad[a] += Operation::backward_operand(code[n], imm[n], g, 2, value[l],
+                                             value[r], value[a]);
+      break;
+    }
+    case Operation::OpType::NONE:
+      break;
+    }
+  }
+}
+
+template <typename T>
+struct Tape {
+  // structure of arrays, one slot per recorded value
+  std::vector<Operation::OpCode> code;
+  std::vector<std::uint32_t> lhs;
+  std::vector<std::uint32_t> rhs;
+  // third operand, only read for TERNARY ops
+  std::vector<std::uint32_t> aux;
+  // immediate operand, the exponent for POW
+  std::vector<T> imm;
+  std::vector<T> value;
+  std::vector<T> grad;
+
+  Tape() = default;
+  explicit Tape(std::size_t capacity) { reserve(capacity); }
+
+  void reserve(std::size_t n) {
+    code.reserve(n);
+    lhs.reserve(n);
+    rhs.reserve(n);
+    aux.reserve(n);
+    imm.reserve(n);
+    value.reserve(n);
+    grad.reserve(n);
+  }
+
+  std::size_t size() const { return code.size(); }
+
+  void clear() {
+    code.clear();
+    lhs.clear();
+    rhs.clear();
+    aux.clear();
+    imm.clear();
+    value.clear();
+    grad.clear();
+  }
+
+  Var<T> push(Operation::OpCode c, std::uint32_t l, std::uint32_t r, T i, T v,
+              std::uint32_t a = 0) {
+    const auto index = static_cast<std::uint32_t>(code.size());
+    code.push_back(c);
+    lhs.push_back(l);
+    rhs.push_back(r);
+    aux.push_back(a);
+    imm.push_back(i);
+    value.push_back(v);
+    grad.push_back(0);
+    return {this, index};
+  }
+
+  Var<T> variable(T data) {
+    return push(Operation::OpCode::NONE, 0, 0, 0, data);
+  }
+
+  Var<T> apply(Operation::OpCode c, Var<T> first, Var<T> second, T i = 0) {
+    assert(first.tape == this && second.tape == this);
+    T v = Operation::forward(c, i, value[first.index], value[second.index]);
+    return push(c, first.index, second.index, i, v);
+  }
+
+  Var<T> apply(Operation::OpCode c, Var<T> first, T i = 0) {
+    assert(first.tape == this);
+    T v = Operation::forward<T>(c, i, value[first.index], 0);
+    return push(c, first.index, first.index, i, v);
+  }
+
+  void zero_grad() { std::fill(grad.begin(), grad.end(), T(0)); }
+
+  // recomputes every recorded op from the current values of its inputs,
+  // e.g. after the variables were given new data
+  void forward() { TapeNS::forward(view()); }
+
+  // reverse sweep from the latest output down to entry 0, visiting each of
+  // those entries once; entries recorded after the latest output are
+  // skipped. gradients from a previous call are discarded.
+  void backward(std::initializer_list<Var<T>> outputs) {
+    zero_grad();
+    if (size() == 0 || outputs.size() == 0) {
+      return;
+    }
+    std::uint32_t last = 0;
+    for (const auto &o : outputs) {
+      assert(o.tape == this);
+      grad[o.index] = 1;
+      last = std::max(last, o.index);
+    }
+    backward_from(last);
+  }
+
+  // the sweep alone, from entry last down, with the output gradients
+  // already seeded
+  void backward_from(std::uint32_t last) { TapeNS::backward_from(view(), last); }
+
+  View<T> view() {
+    return {size(), code.data(), lhs.data(), rhs.data(), aux.data(),
+            imm.data(), value.data(), grad.data()};
+  }
+};
+
+template <typename T>
+concept arithmetic = std::integral<T> || std::floating_point<T>;
+
+// entry point replacing ScalarNS::make_scalar, the label is accepted for
+// source compatibility but not recorded
+template <typename T> Var<T> make_scalar(Tape<T> &tape, T data) {
+  return tape.variable(data);
+}
+template <typename T>
+Var<T> make_scalar(Tape<T> &tape, T data, const std::string &) {
+  return tape.variable(data);
+}
+
+template <typename T>
+Var<T> operator+(Var<T> left, Var<T> right) {
+  return left.tape->apply(Operation::OpCode::ADD, left, right);
+}
+template <typename T, arithmetic K>
+Var<T> operator+(K left, Var<T> right) {
+  return right.tape->variable(static_cast<T>(left)) + right;
+}
+template <typename T, arithmetic K>
+Var<T> operator+(Var<T> left, K right) {
+  return left + left.tape->variable(static_cast<T>(right));
+}
+
+template <typename T>
+Var<T> operator*(Var<T> left, Var<T> right) {
+  return left.tape->apply(Operation::OpCode::MUL, left, right);
+}
+template <typename T, arithmetic K>
+Var<T> operator*(K left, Var<T> right) {
+  return right.tape->variable(static_cast<T>(left)) * right;
+}
+template <typename T, arithmetic K>
+Var<T> operator*(Var<T> left, K right) {
+  return left * left.tape->variable(static_cast<T>(right));
+}
+
+template <typename T>
+Var<T> operator-(Var<T> left) {
+  return left * -1;
+}
+template <typename T>
+Var<T> operator-(Var<T> left, Var<T> right) {
+  return left + -right;
+}
+template <typename T, arithmetic K>
+Var<T> operator-(K left, Var<T> right) {
+  return left + -right;
+}
+template <typename T, arithmetic K>
+Var<T> operator-(Var<T> left, K right) {
+  return left + -right;
+}
+
+template <typename T>
+Var<T> pow(Var<T> val, T power) {
+  return val.tape->apply(Operation::OpCode::POW, val, power);
+}
+
+template <std::floating_point T>
+Var<T> operator/(Var<T> num, Var<T> den) {
+  return num * pow(den, static_cast<T>(-1.0));
+}
+
+template <typename T>
+Var<T> tanh(Var<T> val) {
+  return val.tape->apply(Operation::OpCode::TANH, val);
+}
+
+template <typename T>
+Var<T> exp(Var<T> val) {
+  return val.tape->apply(Operation::OpCode::EXP, val);
+}
+
+template <std::floating_point T>
+Var<T> tanh_exp(Var<T> val) {
+  return (exp(static_cast<T>(2.0) * val) - static_cast<T>(1.0)) /
+         (exp(static_cast<T>(2.0) * val) + static_cast<T>(1.0));
+}
+
+// entry point replacing backpropagate from topo.hpp
+template <typename T>
+void backpropagate(std::initializer_list<Var<T>> outputs) {
+  if (outputs.size() != 0) {
+    outputs.begin()->tape->backward(outputs);
+  }
+}
+
+} // namespace TapeNS
@@ -0,0 +1,472 @@
+#pragma once
+#include "operation.hpp"
+#include "scalar.hpp"
+#include "topo.hpp"
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <fmt/format.h>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+namespace TensorNS {
+
+using Shape = std::vector<std::size_t>;
+using Strides = std::vector<std::ptrdiff_t>;
+
+inline std::size_t numel(const Shape &shape) {
+  std::size_t n = 1;
+  for (auto d : shape) {
+    n *= d;
+  }
+  return n;
+}
+
+inline Strides row_major_strides(const Shape &shape) {
+  Strides strides(shape.size());
+  std::ptrdiff_t s = 1;
+  for (std::size_t d = shape.size(); d-- > 0;) {
+    strides[d] = s;
+    s *= static_cast<std::ptrdiff_t>(shape[d]);
+  }
+  return strides;
+}
+
+// a strided view into a shared contiguous buffer.
+// copies are shallow: they alias the same storage, like the views returned
+// by reshape, transpose and slice. clone() makes an independent copy.
+template <typename T>
+struct Tensor {
+  std::shared_ptr<std::vector<T>> storage;
+  std::size_t offset = 0;
+  Shape shape;
+  Strides strides;
+
+  Tensor() = default;
+  explicit Tensor(Shape shape, T fill = 0)
+      : storage(std::make_shared<std::vector<T>>(numel(shape), fill)),
+        shape(shape), strides(row_major_strides(shape)) {}
+  Tensor(Shape shape, std::vector<T> values)
+      : storage(std::make_shared<std::vector<T>>(std::move(values))),
+        shape(shape), strides(row_major_strides(shape)) {
+    if (storage->size() != numel(this->shape)) {
+      throw new std::runtime_error(
+          fmt::format("{} values do not fill a tensor of {} elements",
+                      storage->size(), numel(this->shape)));
+    }
+  }
+
+  std::size_t ndim() const { return shape.size(); }
+  std::size_t size() const { return numel(shape); }
+
+  bool is_contiguous() const { return strides == row_major_strides(shape); }
+
+  // first element, the whole tensor when contiguous
+  T *data() { return storage->data() + offset; }
+  const T *data() const { return storage->data() + offset; }
+
+  std::size_t storage_offset(std::initializer_list<std::size_t> index) const {
+    if (index.size() != shape.size()) {
+      throw new std::runtime_error(fmt::format(
+          "{} indices for a tensor of {} dimensions", index.size(), ndim()));
+    }
+    std::ptrdiff_t o = static_cast<std::ptrdiff_t>(offset);
+    std::size_t d = 0;
+    for (auto i : index) {
+      if (i >= shape[d]) {
+        throw new std::runtime_error(
+            fmt::format("index {} out of range for dimension {}", i, d));
+      }
+      o += static_cast<std::ptrdiff_t>(i) * strides[d++];
+    }
+    return static_cast<std::size_t>(o);
+  }
+  T &at(std::initializer_list<std::size_t> index) {
+    return (*storage)[storage_offset(index)];
+  }
+  const T &at(std::initializer_list<std::size_t> index) const {
+    return (*storage)[storage_offset(index)];
+  }
+
+  Tensor reshape(Shape new_shape) const {
+    if (numel(new_shape) != size()) {
+      throw new std::runtime_error("reshape must keep the number of elements");
+    }
+    if (!is_contiguous()) {
+      throw new std::runtime_error("reshape needs a contiguous tensor");
+    }
+    Tensor view = *this;
+    view.strides = row_major_strides(new_shape);
+    view.shape = std::move(new_shape);
+    return view;
+  }
+
+  Tensor transpose(std::size_t dim0, std::size_t dim1) const {
+    if (dim0 >= ndim() || dim1 >= ndim()) {
+      throw new std::runtime_error("transpose dimension out of range");
+    }
+    Tensor view = *this;
+    std::swap(view.shape[dim0], view.shape[dim1]);
+    std::swap(view.strides[dim0], view.strides[dim1]);
+    return view;
+  }
+
+  // elements [begin, end) along dim
+  Tensor slice(std::size_t dim, std::size_t begin, std::size_t end) const {
+    if (dim >= ndim() || begin > end || end > shape[dim]) {
+      throw new std::runtime_error("slice out of range");
+    }
+    Tensor view = *this;
+    view.offset = static_cast<std::size_t>(
+        static_cast<std::ptrdiff_t>(offset) +
+        static_cast<std::ptrdiff_t>(begin) * strides[dim]);
+    view.shape[dim] = end - begin;
+    return view;
+  }
+
+  Tensor clone() const;
+  Tensor contiguous() const { return is_contiguous() ? *this : clone(); }
+  void fill(T value);
+  std::vector<T> to_vector() const;
+};
+
+// calls f with the storage offset of the current element of every tensor,
+// visiting the common shape in row-major order. handles any strides, so
+// views can be read and written in place.
+template <typename F, typename... Ts>
+void for_each_element(const Shape &shape, F f, const Ts &...tensors) {
+  constexpr std::size_t N = sizeof...(Ts);
+  const std::size_t total = numel(shape);
+  if (total == 0) {
+    return;
+  }
+  std::array<std::ptrdiff_t, N> off{static_cast<std::ptrdiff_t>(tensors.offset)...};
+  const std::array<const Strides *, N> strides{&tensors.strides...};
+  std::vector<std::size_t> index(shape.size(), 0);
+  for (std::size_t n = 0; n < total; ++n) {
+    std::apply([&](auto... o) { f(static_cast<std::size_t>(o)...); }, off);
+    for (std::size_t d = shape.size(); d-- > 0;) {
+      ++index[d];
+      for (std::size_t k = 0; k < N; ++k) {
+        off[k] += (*strides[k])[d];
+      }
+      if (index[d] < shape[d]) {
+        break;
+      }
+      for (std::size_t k = 0; k < N; ++k) {
+        off[k] -= (*strides[k])[d] * static_cast<std::ptrdiff_t>(shape[d]);
+      }
+      index[d] = 0;
+    }
+  }
+}
+
+template <typename T>
+Tensor<T> Tensor<T>::clone() const {
+  Tensor<T> out(shape);
+  auto &src = *storage;
+  auto &dst = *out.storage;
+  for_each_element(shape, [&](std::size_t s, std::size_t d) { dst[d] = src[s]; },
+                   *this, out);
+  return out;
+}
+
+template <typename T>
+void Tensor<T>::fill(T value) {
+  auto &s = *storage;
+  for_each_element(shape, [&](std::size_t o) { s[o] = value; }, *this);
+}
+
+template <typename T>
+std::vector<T> Tensor<T>::to_vector() const {
+  std::vector<T> out;
+  out.reserve(size());
+  auto &s = *storage;
+  for_each_element(shape, [&](std::size_t o) { out.push_back(s[o]); }, *this);
+  return out;
+}
+
+template <typename T> struct TensorValue;
+
+template <typename T> using TensorPtr = std::shared_ptr<TensorValue<T>>;
+
+// autograd node holding a whole tensor, the counterpart of ScalarValue
+template <typename T>
+struct TensorValue {
+  std::vector<TensorPtr<T>> children;
+
+  // elementwise op applied to the children, none for leaves and views
+  Operation::Operation<T> *op;
+
+  // adds this node's contribution to the children's grads
+  std::function<void(TensorValue &)> backward;
+
+  Tensor<T> data;
+  // contiguous, same shape as data
+  Tensor<T> grad;
+
+  std::string label;
+
+  std::uint64_t seen = 0;
+
+  std::size_t num_children() const { return children.size(); }
+  TensorPtr<T> &child(std::size_t i) { return children[i]; }
+
+  void propagate_gradient() {
+    if (backward) {
+      backward(*this);
+    }
+  }
+
+  TensorValue(Tensor<T> data)
+      : op(Operation::none_ptr<T>), data(data), grad(data.shape) {}
+  TensorValue(Tensor<T> data, std::string label)
+      : op(Operation::none_ptr<T>), data(data), grad(data.shape), label(label) {}
+  TensorValue(Tensor<T> data, std::vector<TensorPtr<T>> children,
+              Operation::Operation<T> *op,
+              std::function<void(TensorValue &)> backward)
+      : children(std::move(children)), op(op), backward(std::move(backward)),
+        data(data), grad(data.shape) {}
+};
+
+template <typename T> TensorPtr<T> make_tensor(Tensor<T> data) {
+  return std::make_shared<TensorValue<T>>(data);
+}
+template <typename T> TensorPtr<T> make_tensor(Tensor<T> data, std::string label) {
+  return std::make_shared<TensorValue<T>>(data, label);
+}
+template <typename T>
+TensorPtr<T> make_tensor(Shape shape, std::vector<T> values, std::string label = "") {
+  return std::make_shared<TensorValue<T>>(Tensor<T>(shape, std::move(values)), label);
+}
+
+template <typename T>
+TensorPtr<T> elementwise(Operation::Operation<T> *op, TensorPtr<T> left,
+                         TensorPtr<T> right) {
+  if (left->data.shape != right->data.shape) {
+    throw new std::runtime_error(fmt::format("shape mismatch in {}", op->get_symbol()));
+  }
+  Tensor<T> out(left->data.shape);
+  if (left->data.is_contiguous() && right->data.is_contiguous()) {
+    const std::size_t n = out.size();
+    op->forward_n({left->data.data(), n}, {right->data.data(), n}, {out.data(), n});
+  } else {
+    auto &a = *left->data.storage;
+    auto &b = *right->data.storage;
+    auto &o = *out.storage;
+    for_each_element(
+        out.shape,
+        [&](std::size_t ia, std::size_t ib, std::size_t io) {
+          o[io] = op->forward(a[ia], b[ib]);
+        },
+        left->data, right->data, out);
+  }
+  return std::make_shared<TensorValue<T>>(
+      out, std::vector<TensorPtr<T>>{left, right}, op, [](TensorValue<T> &node) {
+        auto &l = *node.children[0];
+        auto &r = *node.children[1];
+        if (l.data.is_contiguous() && r.data.is_contiguous()) {
+          const std::size_t n = node.grad.size();
+          const std::span<const T> g(node.grad.data(), n);
+          const std::span<const T> ld(l.data.data(), n);
+          const std::span<const T> rd(r.data.data(), n);
+          node.op->backward_n(g, ld, rd, {l.grad.data(), n});
+          node.op->backward_n(g, rd, ld, {r.grad.data(), n});
+          return;
+        }
+        auto &g = *node.grad.storage;
+        auto &ld = *l.data.storage;
+        auto &rd = *r.data.storage;
+        auto &lg = *l.grad.storage;
+        auto &rg = *r.grad.storage;
+        for_each_element(
+            node.grad.shape,
+            [&](std::size_t io, std::size_t il, std::size_t ir, std::size_t igl,
+                std::size_t igr) {
+              const T dl = node.op->backward(g[io], ld[il], rd[ir]);
+              const T dr = node.op->backward(g[io], rd[ir], ld[il]);
+              lg[igl] += dl;
+              rg[igr] += dr;
+            },
+            node.grad, l.data, r.data, l.grad, r.grad);
+      });
+}
+
+template <typename T>
+TensorPtr<T> elementwise(Operation::Operation<T> *op, TensorPtr<T> val) {
+  Tensor<T> out(val->data.shape);
+  if (val->data.is_contiguous()) {
+    const std::size_t n = out.size();
+    op->forward_n({val->data.data(), n}, {}, {out.data(), n});
+  } else {
+    auto &a = *val->data.storage;
+    auto &o = *out.storage;
+    for_each_element(
+        out.shape,
+        [&](std::size_t ia, std::size_t io) { o[io] = op->forward(a[ia], 0); },
+        val->data, out);
+  }
+  return std::make_shared<TensorValue<T>>(
+      out, std::vector<TensorPtr<T>>{val}, op, [](TensorValue<T> &node) {
+        auto &c = *node.children[0];
+        if (c.data.is_contiguous()) {
+          const std::size_t n = node.grad.size();
+          node.op->backward_n({node.grad.data(), n}, {c.data.data(), n}, {},
+                              {c.grad.data(), n});
+          return;
+        }
+        auto &g = *node.grad.storage;
+        auto &cd = *c.data.storage;
+        auto &cg = *c.grad.storage;
+        for_each_element(
+            node.grad.shape,
+            [&](std::size_t io, std::size_t ic, std::size_t igc) {
+              cg[igc] += node.op->backward(g[io], cd[ic], 0);
+            },
+            node.grad, c.data, c.grad);
+      });
+}
+
+// a node whose data is view(child data); its gradient flows back through
+// the same view of the child's gradient, so nothing is copied either way
+template <typename T>
+TensorPtr<T> make_view(TensorPtr<T> val,
+                       std::function<Tensor<T>(const Tensor<T> &)> view) {
+  return std::make_shared<TensorValue<T>>(
+      view(val->data), std::vector<TensorPtr<T>>{val}, Operation::none_ptr<T>,
+      [view](TensorValue<T> &node) {
+        auto child_grad = view(node.children[0]->grad);
+        auto &g = *node.grad.storage;
+        auto &cg = *child_grad.storage;
+        for_each_element(
+            node.grad.shape, [&](std::size_t io, std::size_t ic) { cg[ic] += g[io]; },
+            node.grad, child_grad);
+      });
+}
+
+template <typename T>
+TensorPtr<T> reshape(TensorPtr<T> val, Shape shape) {
+  return make_view<T>(val, [shape](const Tensor<T> &t) { return t.reshape(shape); });
+}
+
+template <typename T>
+TensorPtr<T> transpose(TensorPtr<T> val, std::size_t dim0, std::size_t dim1) {
+  return make_view<T>(
+      val, [dim0, dim1](const Tensor<T> &t) { return t.transpose(dim0, dim1); });
+}
+
+template <typename T>
+TensorPtr<T> slice(TensorPtr<T> val, std::size_t dim, std::size_t begin,
+                   std::size_t end) {
+  return make_view<T>(val, [dim, begin, end](const Tensor<T> &t) {
+    return t.slice(dim, begin, end);
+  });
+}
+
+template <typename T>
+concept arithmetic = std::integral<T> || std::floating_point<T>;
+
+// constants are broadcast to a leaf of the other operand's shape
+template <typename T, arithmetic K>
+TensorPtr<T> full_like(const TensorPtr<T> &like, K value) {
+  return make_tensor(Tensor<T>(like->data.shape, static_cast<T>(value)));
+}
+
+template <typename T>
+TensorPtr<T> operator+(TensorPtr<T> left, TensorPtr<T> right) {
+  return elementwise(static_cast<Operation::Operation<T> *>(Operation::add_ptr<T>),
+                     left, right);
+}
+template <typename T, arithmetic K>
+TensorPtr<T> operator+(K left, TensorPtr<T> right) {
+  return full_like(right, left) + right;
+}
+template <typename T, arithmetic K>
+TensorPtr<T> operator+(TensorPtr<T> left, K right) {
+  return left + full_like(left, right);
+}
+
+template <typename T>
+TensorPtr<T> operator*(TensorPtr<T> left, TensorPtr<T> right) {
+  return elementwise(static_cast<Operation::Operation<T> *>(Operation::mul_ptr<T>),
+                     left, right);
+}
+template <typename T, arithmetic K>
+TensorPtr<T> operator*(K left, TensorPtr<T> right) {
+  return full_like(right, left) * right;
+}
+template <typename T, arithmetic K>
+TensorPtr<T> operator*(TensorPtr<T> left, K right) {
+  return left * full_like(left, right);
+}
+
+template <typename T>
+TensorPtr<T> operator-(TensorPtr<T> left) {
+  return left * -1;
+}
+template <typename T>
+TensorPtr<T> operator-(TensorPtr<T> left, TensorPtr<T> right) {
+  return left + -right;
+}
+template <typename T, arithmetic K>
+TensorPtr<T> operator-(K left, TensorPtr<T> right) {
+  return left + -right;
+}
+template <typename T, arithmetic K>
+TensorPtr<T> operator-(TensorPtr<T> left, K right) {
+  return left + -right;
+}
+
+template <typename T>
+TensorPtr<T> pow(TensorPtr<T> val, T power) {
+  return elementwise(
+      static_cast<Operation::Operation<T> *>(Operation::pow_cache<T>.get(power)), val);
+}
+
+template <std::floating_point T>
+TensorPtr<T> operator/(TensorPtr<T> num, TensorPtr<T> den) {
+  return num * pow(den, static_cast<T>(-1.0));
+}
+
+template <typename T>
+TensorPtr<T> tanh(TensorPtr<T> val) {
+  return elementwise(static_cast<Operation::Operation<T> *>(Operation::tanh_ptr<T>),
+                     val);
+}
+
+template <typename T>
+TensorPtr<T> exp(TensorPtr<T> val) {
+  return elementwise(static_cast<Operation::Operation<T> *>(Operation::exp_ptr<T>),
+                     val);
+}
+
+// every element of every output is seeded with gradient 1
+template <typename T>
+void backpropagate(const std::vector<TensorPtr<T>> &outputs) {
+  HUGEGRAD_PROFILE_SCOPE("backward");
+  auto sorted = topological_sort(outputs);
+  for (const auto &i : sorted) {
+    if (i->num_children() != 0) {
+      i->grad.fill(0);
+    }
+  }
+  for (const auto &i : outputs) {
+    i->grad.fill(1);
+  }
+  for (auto i = sorted.rbegin(); i != sorted.rend(); ++i) {
+    (*i)->propagate_gradient();
+  }
+}
+
+template <typename T>
+void backpropagate(std::initializer_list<TensorPtr<T>> outputs) {
+  backpropagate(std::vector<TensorPtr<T>>(outputs));
+}
+
+} // namespace TensorNS
@@ -0,0 +1,159 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// fixed set of worker threads with one task deque each.
+// a worker pops from the back of its own deque and, when that runs dry,
+// steals from the front of the others. parallel_for blocks the calling
+// thread, which works through the tasks too. not reentrant: don't call
+// parallel_for from inside a task. an exception thrown by f is caught on
+// whichever thread ran it and the first one is rethrown by parallel_for
+// once every chunk is done, as if the loop had run on the caller.
+class ThreadPool {
+  struct Queue {
+    std::mutex m;
+    std::deque<std::function<void()>> tasks;
+  };
+  // one queue per worker plus one for the calling thread, which is last
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> workers;
+  std::mutex sleep_m;
+  std::condition_variable wake;
+  std::atomic<std::size_t> pending{0};
+  bool stop = false;
+
+  bool pop(std::size_t self, std::function<void()> &task) {
+    {
+      auto &q = *queues[self];
+      std::lock_guard lock(q.m);
+      if (!q.tasks.empty()) {
+        task = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        return true;
+      }
+    }
+    for (std::size_t i = 1; i < queues.size(); ++i) {
+      auto &q = *queues[(self + i) % queues.size()];
+      std::lock_guard lock(q.m);
+      if (!q.tasks.empty()) {
+        task = std::move(q.tasks.front());
+        q.tasks.pop_front();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool run_one(std::size_t self) {
+    std::function<void()> task;
+    if (!pop(self, task)) {
+      return false;
+    }
+    pending.fetch_sub(1, std::memory_order_relaxed);
+    task();
+    return true;
+  }
+
+  void worker_loop(std::size_t self) {
+    while (true) {
+      if (run_one(self)) {
+        continue;
+      }
+      std::unique_lock lock(sleep_m);
+      wake.wait(lock, [this] { return stop || pending.load() > 0; });
+      if (stop) {
+        return;
+      }
+    }
+  }
+
+public:
+  // threads counts the calling thread, so ThreadPool(1) runs everything inline
+  explicit ThreadPool(std::size_t threads = std::thread::hardware_concurrency()) {
+    threads = std::max<std::size_t>(threads, 1);
+    for (std::size_t i = 0; i < threads; ++i) {
+      queues.push_back(std::make_unique<Queue>());
+    }
+    for (std::size_t i = 0; i + 1 < threads; ++i) {
+      workers.emplace_back([this, i] { worker_loop(i); });
+    }
+  }
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+  ~ThreadPool() {
+    {
+      std::lock_guard lock(sleep_m);
+      stop = true;
+    }
+    wake.notify_all();
+    for (auto &w : workers) {
+      w.join();
+    }
+  }
+
+  std::size_t size() const { return queues.size(); }
+
+  // calls f(i) for every i in [begin, end), in chunks of at least grain
+  template <typename F>
+  void parallel_for(std::size_t begin, std::size_t end, std::size_t grain, F &&f) {
+    if (begin >= end) {
+      return;
+    }
+    const std::size_t n = end - begin;
+    grain = std::max<std::size_t>(grain, 1);
+    // a few chunks per thread leaves room for stealing
+    const std::size_t chunk = std::max(grain, n / (4 * size()) + 1);
+    if (workers.empty() || n <= chunk) {
+      for (std::size_t i = begin; i < end; ++i) {
+        f(i);
+      }
+      return;
+    }
+    const std::size_t chunks = (n + chunk - 1) / chunk;
+    std::atomic<std::size_t> remaining{chunks};
+    std::mutex error_m;
+    std::exception_ptr error;
+    {
+      std::lock_guard lock(sleep_m);
+      pending.fetch_add(chunks);
+    }
+    for (std::size_t c = 0; c < chunks; ++c) {
+      const std::size_t lo = begin + c * chunk;
+      const std::size_t hi = std::min(end, lo + chunk);
+      auto &q = *queues[c % queues.size()];
+      std::lock_guard lock(q.m);
+      q.tasks.push_back([&f, &remaining, &error_m, &error, lo, hi] {
+        try {
+          for (std::size_t i = lo; i < hi; ++i) {
+            f(i);
+          }
+        } catch (...) {
+          std::lock_guard lock(error_m);
+          if (!error) {
+            error = std::current_exception();
+          }
+        }
+        remaining.fetch_sub(1, std::memory_order_release);
+      });
+    }
+    wake.notify_all();
+    const std::size_t self = queues.size() - 1;
+    while (remaining.load(std::memory_order_acquire) != 0) {
+      if (!run_one(self)) {
+        std::this_thread::yield();
+      }
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+};
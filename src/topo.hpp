@@ -1,5 +1,7 @@
 #pragma once
 #include "scalar.hpp"
+#include "thread-pool.hpp"
+#include <algorithm>
 #include <fmt/ranges.h>
 #include <initializer_list>
 #include <memory>
@@ -9,46 +11,80 @@
 template <typename T>
 using TopoType = std::vector<ScalarNS::Scalar<T>>;
 
-template <typename T>
-void topo_visit(ScalarNS::Scalar<T> node, TopoType<T> &t)
+// depth first post-order from node, using an explicit stack so that long
+// chains don't grow the call stack. gen is the traversal's stamp from
+// ScalarNS::next_generation(): gen marks nodes on the stack, gen + 1 marks
+// nodes already emitted.
+// works for any node exposing seen, num_children() and child(i).
+template <typename Node>
+void topo_visit(std::shared_ptr<Node> node, std::vector<std::shared_ptr<Node>> &t,
+                std::uint64_t gen)
 {
-  if (node->seen == ScalarNS::SeenMark::PERM) {
+  const std::uint64_t tmp = gen;
+  const std::uint64_t perm = gen + 1;
+  if (node->seen == perm) {
     return;
   }
-  if (node->seen == ScalarNS::SeenMark::TMP) {
-    throw new std::runtime_error("Cycle detected in topological sort.");
-  }
-  node->seen = ScalarNS::SeenMark::TMP;
-  switch (node->op->get_type()) {
-  case Operation::OpType::BINARY:
-    topo_visit(node->child1, t);
-    topo_visit(node->child2, t);
-    break;
-  case Operation::OpType::UNARY:
-    topo_visit(node->child1, t);
-    break;
-  case Operation::OpType::NONE:
-    break;
+  struct Frame {
+    std::shared_ptr<Node> node;
+    std::size_t next_child;
+  };
+  std::vector<Frame> stack;
+  node->seen = tmp;
+  stack.push_back({std::move(node), 0});
+  while (!stack.empty()) {
+    auto &top = stack.back();
+    if (top.next_child < top.node->num_children()) {
+      auto &child = top.node->child(top.next_child++);
+      if (child->seen == perm) {
+        continue;
+      }
+      if (child->seen == tmp) {
+        throw new std::runtime_error("Cycle detected in topological sort.");
+      }
+      child->seen = tmp;
+      stack.push_back({child, 0});
+      continue;
+    }
+    top.node->seen = perm;
+    t.push_back(std::move(top.node));
+    stack.pop_back();
   }
-  node->seen = ScalarNS::SeenMark::PERM;
-  t.push_back(node);
 }
 
 // outputs is a collection of all compute nodes that are not used in further computation
-template <typename T>
-TopoType<T> topological_sort(std::initializer_list<ScalarNS::Scalar<T>> outputs)
+template <typename Node>
+std::vector<std::shared_ptr<Node>>
+topological_sort(const std::vector<std::shared_ptr<Node>> &outputs)
 {
-  TopoType<T> ret;
+  HUGEGRAD_PROFILE_SCOPE("topological_sort");
+  std::vector<std::shared_ptr<Node>> ret;
+  const auto gen = ScalarNS::next_generation();
   for (const auto& o : outputs) {
-    topo_visit(o, ret);
+    topo_visit(o, ret, gen);
   }
   return ret;
 }
 
+template <typename Node>
+std::vector<std::shared_ptr<Node>>
+topological_sort(std::initializer_list<std::shared_ptr<Node>> outputs)
+{
+  return topological_sort(std::vector<std::shared_ptr<Node>>(outputs));
+}
+
 template <typename T>
-void backpropagate(std::initializer_list<ScalarNS::Scalar<T>> outputs)
+void backpropagate(const std::vector<ScalarNS::Scalar<T>> &outputs)
 {
+  HUGEGRAD_PROFILE_SCOPE("backward");
   auto sorted = topological_sort(outputs);
+  // interior gradients belong to this pass only, leaves accumulate across
+  // passes like parameters should
+  for (const auto &i : sorted) {
+    if (i->num_children() != 0) {
+      i->grad = 0;
+    }
+  }
   // initialize all the outputs' gradient as 1
   for (const auto &i : outputs) {
     i->grad = 1;
@@ -58,3 +94,131 @@ void backpropagate(std::initializer_list<ScalarNS::Scalar<T>> outputs)
   }
 }
 
+template <typename T>
+void backpropagate(std::initializer_list<ScalarNS::Scalar<T>> outputs)
+{
+  backpropagate(std::vector<ScalarNS::Scalar<T>>(outputs));
+}
+
+// like backpropagate({output}) with output's gradient seeded with seed
+// instead of 1
+template <typename T>
+void backpropagate(const ScalarNS::Scalar<T> &output, T seed)
+{
+  HUGEGRAD_PROFILE_SCOPE("backward");
+  auto sorted = topological_sort({output});
+  for (const auto &i : sorted) {
+    if (i->num_children() != 0) {
+      i->grad = 0;
+    }
+  }
+  output->grad = seed;
+  for (auto i = sorted.rbegin(); i != sorted.rend(); ++i) {
+    (*i)->propagate_gradient();
+  }
+}
+
+// same result as backpropagate, bit for bit, with independent nodes on
+// several threads. nodes are grouped into levels by their longest distance
+// from an output; a node only feeds nodes of deeper levels, so each level
+// runs in parallel once the previous one is done. instead of adding into
+// its children, every node writes what it sends each child to a slot of
+// that edge, and sums the slots of its own consumers in the order the
+// serial sweep would have added them, so nodes with fan-out are written
+// by one thread only and the sums don't depend on scheduling.
+template <typename T>
+void backpropagate(const std::vector<ScalarNS::Scalar<T>> &outputs, ThreadPool &pool)
+{
+  if (pool.size() == 1) {
+    // the scheduling only pays off with other threads to hand work to
+    return backpropagate(outputs);
+  }
+  HUGEGRAD_PROFILE_SCOPE("backward");
+  auto sorted = topological_sort(outputs);
+  const std::size_t n = sorted.size();
+  // number the nodes by their position in sorted
+  const auto base = ScalarNS::reserve_generations(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    sorted[i]->seen = base + i;
+  }
+  auto index = [base](const ScalarNS::Scalar<T> &node) {
+    return static_cast<std::size_t>(node->seen - base);
+  };
+
+  // a slot per edge, grouped by child: the edges into node i are slots
+  // first[i] ... first[i + 1] - 1, in the order the serial reverse sweep
+  // visits them
+  std::vector<std::size_t> first(n + 1, 0);
+  for (const auto &node : sorted) {
+    if (node->code == Operation::OpCode::CHECKPOINT) {
+      // segments write to shared leaves while they run
+      return backpropagate(outputs);
+    }
+    for (std::size_t k = 0; k < node->num_children(); ++k) {
+      ++first[index(node->child(k)) + 1];
+    }
+  }
+  for (std::size_t i = 0; i < n; ++i) {
+    first[i + 1] += first[i];
+  }
+  std::vector<T> contributions(first[n]);
+  // slot of the edge from node u to its child k at edge[2 * u + k]
+  std::vector<std::size_t> edge(2 * n);
+  std::vector<std::size_t> fill(first.begin(), first.end() - 1);
+  std::vector<std::size_t> level(n, 0);
+  std::size_t depth = 0;
+  for (std::size_t u = n; u-- > 0;) {
+    const auto &node = sorted[u];
+    for (std::size_t k = 0; k < node->num_children(); ++k) {
+      const auto c = index(node->child(k));
+      edge[2 * u + k] = fill[c]++;
+      level[c] = std::max(level[c], level[u] + 1);
+      depth = std::max(depth, level[c]);
+    }
+  }
+  std::vector<std::size_t> level_first(depth + 2, 0);
+  for (auto l : level) {
+    ++level_first[l + 1];
+  }
+  for (std::size_t l = 0; l <= depth; ++l) {
+    level_first[l + 1] += level_first[l];
+  }
+  std::vector<std::size_t> by_level(n);
+  {
+    std::vector<std::size_t> pos(level_first.begin(), level_first.end() - 1);
+    for (std::size_t i = 0; i < n; ++i) {
+      by_level[pos[level[i]]++] = i;
+    }
+  }
+
+  for (const auto &i : sorted) {
+    if (i->num_children() != 0) {
+      i->grad = 0;
+    }
+  }
+  for (const auto &i : outputs) {
+    i->grad = 1;
+  }
+  for (std::size_t l = 0; l <= depth; ++l) {
+    pool.parallel_for(level_first[l], level_first[l + 1], 256, [&](std::size_t j) {
+      const auto i = by_level[j];
+      auto &node = *sorted[i];
+      T g = node.grad;
+      for (std::size_t e = first[i]; e < first[i + 1]; ++e) {
+        g += contributions[e];
+      }
+      node.grad = g;
+      // once per node, as propagate_gradient in the serial sweep
+      HUGEGRAD_PROFILE_OP(ProfileNS::Pass::BACKWARD, node.code, node.label);
+      for (std::size_t k = 0; k < node.num_children(); ++k) {
+        contributions[edge[2 * i + k]] = node.grad_contribution(k);
+      }
+    });
+  }
+}
+
+template <typename T>
+void backpropagate(std::initializer_list<ScalarNS::Scalar<T>> outputs, ThreadPool &pool)
+{
+  backpropagate(std::vector<ScalarNS::Scalar<T>>(outputs), pool);
+}
@@ -0,0 +1,141 @@
+#include "archive.hpp"
+#include "expr.hpp"
+#include "plan.hpp"
+#include "scalar.hpp"
+#include <gtest/gtest.h>
+#include <array>
+#include <fstream>
+#include <string>
+using namespace ScalarNS;
+
+struct Model {
+  std::array<Scalar<double>, 2> x;
+  std::array<Scalar<double>, 6> w;
+  Scalar<double> loss;
+
+  Model() {
+    for (std::size_t i = 0; i < 2; ++i) x[i] = make_scalar<double>(0.3 * i - 0.2, fmt::format("x{}", i));
+    for (std::size_t i = 0; i < 6; ++i) w[i] = make_scalar<double>(0.1 * i - 0.25, fmt::format("w{}", i));
+    Scalar<double> out;
+    for (std::size_t j = 0; j < 2; ++j) {
+      auto h = tanh(x[0] * w[3 * j] + x[1] * w[3 * j + 1]);
+      out = j == 0 ? h * w[3 * j + 2] : out + h * w[3 * j + 2];
+    }
+    loss = pow(out - 0.5, 2.0) + exp(out * 0.1);
+    loss->label = "loss";
+  }
+};
+
+static std::string temp(const char *name) { return ::testing::TempDir() + name; }
+
+TEST(ArchiveTest, round_trip) {
+  Model model;
+  auto plan = PlanNS::capture({model.loss});
+  const auto path = temp("hugegrad-model.hg");
+  ArchiveNS::save(path, plan);
+
+  ArchiveNS::Mapped<double> mapped(path);
+  mapped.verify();
+  ASSERT_EQ(mapped.size(), plan.size());
+  EXPECT_EQ(mapped.label(mapped.outputs[0]), "loss");
+  EXPECT_EQ(mapped.output(), plan.output()->data);
+  // the parameters are read in place
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(mapped.values.data()) % ArchiveNS::alignment, 0u);
+
+  for (int step = 0; step < 3; ++step) {
+    for (std::size_t i = 0; i < 6; ++i) {
+      mapped.value(fmt::format("w{}", i)) = plan.var(model.w[i])->data += 0.05;
+    }
+    plan.forward();
+    plan.backward();
+    mapped.forward();
+    mapped.backward();
+    EXPECT_EQ(mapped.output(), plan.output()->data);
+    for (std::size_t i = 0; i < 6; ++i) {
+      EXPECT_EQ(mapped.grad(fmt::format("w{}", i)), plan.var(model.w[i])->grad);
+    }
+  }
+
+  // changes stay in memory, the file keeps the saved values
+  ArchiveNS::Mapped<double> again(path);
+  EXPECT_EQ(again.value("w0"), model.w[0]->data);
+  EXPECT_THROW(again.find("nothing"), std::runtime_error *);
+}
+
+TEST(ArchiveTest, rejects_bad_files) {
+  auto a = make_scalar<float>(2.0f);
+  auto plan = PlanNS::capture({a * a + a});
+  const auto path = temp("hugegrad-float.hg");
+  ArchiveNS::save(path, plan, false);
+  ArchiveNS::Mapped<float> mapped(path);
+  EXPECT_EQ(mapped.label(0), "");
+  EXPECT_THROW(mapped.find("a"), std::runtime_error *);
+  EXPECT_THROW(ArchiveNS::Mapped<double>{path}, std::runtime_error *);
+  EXPECT_THROW(ArchiveNS::Mapped<float>{temp("hugegrad-missing.hg")}, std::runtime_error *);
+
+  {
+    std::ofstream out(temp("hugegrad-short.hg"), std::ios::binary);
+    out << "HUGEGRAD but too short";
+  }
+  EXPECT_THROW(ArchiveNS::Mapped<float>{temp("hugegrad-short.hg")}, std::runtime_error *);
+
+  // counts whose byte size wraps around to the real section's
+  auto damaged = [&](auto edit) {
+    const auto copy = temp("hugegrad-damaged.hg");
+    ArchiveNS::save(copy, plan, false);
+    std::fstream f(copy, std::ios::binary | std::ios::in | std::ios::out);
+    ArchiveNS::Header h;
+    f.read(reinterpret_cast<char *>(&h), sizeof h);
+    edit(h);
+    f.seekp(0);
+    f.write(reinterpret_cast<const char *>(&h), sizeof h);
+    f.close();
+    return copy;
+  };
+  const std::uint64_t wrap = std::uint64_t(1) << 62;
+  EXPECT_THROW(ArchiveNS::Mapped<float>{damaged([&](auto &h) { h.entries += wrap; })},
+               std::runtime_error *);
+  EXPECT_THROW(ArchiveNS::Mapped<float>{damaged([&](auto &h) { h.outputs += wrap; })},
+               std::runtime_error *);
+
+  // an operand that comes after its use
+  std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+  ArchiveNS::Header header;
+  file.read(reinterpret_cast<char *>(&header), sizeof header);
+  const std::uint32_t bad = 7;
+  file.seekp(static_cast<std::streamoff>(header.lhs.offset + sizeof bad));
+  file.write(reinterpret_cast<const char *>(&bad), sizeof bad);
+  file.close();
+  ArchiveNS::Mapped<float> broken(path);
+  EXPECT_THROW(broken.verify(), std::runtime_error *);
+}
+
+// materialized nodes can't be saved; the formula built from graph ops
+// runs like the graph rebuilt at the new input
+TEST(ArchiveTest, rebound_inputs) {
+  auto x = make_scalar<double>(2.0, "x");
+  auto w = make_scalar<double>(3.0, "w");
+  auto y = ExprNS::materialize(ExprNS::var<0>(x) * ExprNS::var<1>(w) + 1.0, x, w);
+  EXPECT_THROW(PlanNS::capture({y}), std::runtime_error *);
+
+  const auto path = temp("hugegrad-rebound.hg");
+  ArchiveNS::save(path, PlanNS::capture({tanh(x * w + 1.0)}));
+  ArchiveNS::Mapped<double> mapped(path);
+  mapped.verify();
+  mapped.value("x") = 2.5;
+  mapped.forward();
+  x->data = 2.5;
+  EXPECT_EQ(mapped.output(), tanh(x * w + 1.0)->data);
+}
+
+// a model with no entries saves, loads and runs as a no-op
+TEST(ArchiveTest, empty_model) {
+  const auto path = temp("hugegrad-empty.hg");
+  ArchiveNS::save(path, PlanNS::capture(std::vector<Scalar<float>>{}));
+  ArchiveNS::Mapped<float> mapped(path);
+  mapped.verify();
+  EXPECT_EQ(mapped.size(), 0u);
+  mapped.forward();
+  mapped.backward();
+  EXPECT_TRUE(mapped.grads.empty());
+}
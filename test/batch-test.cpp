@@ -0,0 +1,86 @@
+#include "batch.hpp"
+#include "fusion.hpp"
+#include "plan.hpp"
+#include "scalar.hpp"
+#include <gtest/gtest.h>
+#include <array>
+using namespace ScalarNS;
+
+// two inputs, a hidden layer of three tanh neurons, squared error
+struct Model {
+  std::array<Scalar<double>, 2> x;
+  std::array<Scalar<double>, 9> w;
+  Scalar<double> loss;
+
+  Model() {
+    for (std::size_t i = 0; i < 2; ++i) x[i] = make_scalar<double>(0.0);
+    for (std::size_t i = 0; i < 9; ++i) w[i] = make_scalar<double>(0.1 * double(i) - 0.4);
+    Scalar<double> out;
+    for (std::size_t j = 0; j < 3; ++j) {
+      auto h = tanh(x[0] * w[3 * j] + x[1] * w[3 * j + 1] + 0.1);
+      out = j == 0 ? h * w[3 * j + 2] : out + h * w[3 * j + 2];
+    }
+    auto err = out / w[0] - 0.5;
+    loss = pow(err, 2.0) + exp(err * 0.01);
+  }
+};
+
+// every lane against the plan run on its sample alone, the odd lane count
+// leaves a tail for the scalar loop of the kernels
+TEST(BatchTest, lanes_match_plan) {
+  Model model;
+  auto plan = PlanNS::capture({model.loss});
+  for (bool fused : {false, true}) {
+    if (fused) {
+      EXPECT_GT(PlanNS::fuse(plan, {model.x[0], model.x[1]}), 0u);
+    }
+    const std::size_t lanes = 37;
+    PlanNS::Batch<double> batch(plan, lanes);
+    auto x0 = batch.value(model.x[0]);
+    auto x1 = batch.value(model.x[1]);
+    for (std::size_t i = 0; i < lanes; ++i) {
+      x0[i] = 0.05 * double(i) - 0.9;
+      x1[i] = 0.3 - 0.02 * double(i);
+    }
+    batch.forward();
+    batch.backward();
+
+    std::array<double, 9> sums{};
+    for (std::size_t i = 0; i < lanes; ++i) {
+      plan.var(model.x[0])->data = x0[i];
+      plan.var(model.x[1])->data = x1[i];
+      plan.forward();
+      plan.backward();
+      EXPECT_EQ(batch.output()[i], plan.output()->data) << i;
+      EXPECT_EQ(batch.grad(model.x[0])[i], plan.var(model.x[0])->grad) << i;
+      EXPECT_EQ(batch.grad(model.x[1])[i], plan.var(model.x[1])->grad) << i;
+      for (std::size_t k = 0; k < 9; ++k) {
+        EXPECT_EQ(batch.grad(model.w[k])[i], plan.var(model.w[k])->grad) << i;
+        sums[k] += plan.var(model.w[k])->grad;
+      }
+    }
+    for (std::size_t k = 0; k < 9; ++k) {
+      EXPECT_EQ(batch.grad_sum(model.w[k]), sums[k]) << k;
+    }
+  }
+}
+
+TEST(BatchTest, leaves_start_captured) {
+  auto a = make_scalar<float>(1.5f);
+  auto b = make_scalar<float>(2.0f);
+  auto plan = PlanNS::capture({a * b});
+  PlanNS::Batch<float> batch(plan, 4);
+  batch.value(a)[2] = 3.0f;
+  batch.forward();
+  EXPECT_EQ(batch.output()[0], 3.0f);
+  EXPECT_EQ(batch.output()[2], 6.0f);
+  EXPECT_THROW(batch.value(make_scalar<float>(1.0f)), std::runtime_error *);
+  EXPECT_THROW(PlanNS::Batch<float>(plan, 0), std::runtime_error *);
+
+  PlanNS::Batch<float> inference(plan, 4, PlanNS::Mode::INFERENCE);
+  inference.value(a)[2] = 3.0f;
+  inference.forward();
+  EXPECT_EQ(inference.output()[2], 6.0f);
+  EXPECT_TRUE(inference.grads.empty());
+  EXPECT_THROW(inference.backward(), std::runtime_error *);
+}
@@ -0,0 +1,62 @@
+#include "checkpoint.hpp"
+#include "plan.hpp"
+#include "scalar.hpp"
+#include "thread-pool.hpp"
+#include "topo.hpp"
+#include <gtest/gtest.h>
+using namespace ScalarNS;
+
+class CheckpointTest : public ::testing::Test {
+protected:
+  static constexpr std::size_t steps = 1000;
+  Scalar<double> x = make_scalar<double>(0.3, "x");
+  Scalar<double> w = make_scalar<double>(0.8, "w");
+  Scalar<double> b = make_scalar<double>(0.1, "b");
+  double gx = 0, gw = 0, gb = 0, out = 0;
+  std::size_t nodes = 0;
+
+  Scalar<double> step(Scalar<double> y) const { return tanh(y * w + b); }
+
+  void SetUp() override {
+    auto y = x;
+    for (std::size_t i = 0; i < steps; ++i) {
+      y = step(y);
+    }
+    backpropagate({y});
+    gx = x->grad, gw = w->grad, gb = b->grad, out = y->data;
+    nodes = topological_sort({y}).size();
+    x->grad = w->grad = b->grad = 0;
+  }
+};
+
+TEST_F(CheckpointTest, matches_full_graph) {
+  auto y = checkpoint_sequence(x, steps, 32, [this](Scalar<double> y) { return step(y); });
+  EXPECT_EQ(y->data, out);
+  // 32 checkpoints and x, the parameters are only read inside the segments
+  EXPECT_EQ(topological_sort({y}).size(), 33);
+  EXPECT_LT(33 * 10, nodes);
+  backpropagate({y});
+  EXPECT_DOUBLE_EQ(x->grad, gx);
+  EXPECT_DOUBLE_EQ(w->grad, gw);
+  EXPECT_DOUBLE_EQ(b->grad, gb);
+}
+
+TEST_F(CheckpointTest, under_scopes) {
+  GraphContext<double> ctx;
+  CseTable<double> table;
+  {
+    GraphScope<double> graph(ctx);
+    CseScope<double> cse(table);
+    auto y = checkpoint_sequence(x, steps, 100, [this](Scalar<double> y) { return step(y); });
+    // checkpoints own their segment and stay on the heap, so nothing
+    // lands in the arena
+    EXPECT_EQ(ctx.size(), 0);
+    ThreadPool pool(2);
+    backpropagate({y}, pool);
+    EXPECT_DOUBLE_EQ(x->grad, gx);
+    EXPECT_DOUBLE_EQ(w->grad, gw);
+    EXPECT_THROW(PlanNS::capture({y}), std::runtime_error *);
+  }
+  table.clear();
+  ctx.reset();
+}
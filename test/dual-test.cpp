@@ -0,0 +1,47 @@
+#include "derivative.hpp"
+#include "dual.hpp"
+#include "scalar.hpp"
+#include "topo.hpp"
+#include <gtest/gtest.h>
+#include <array>
+#include <functional>
+
+TEST(DualTest, derivative_like_finite_difference) {
+  std::function<float(float)> cube = [](float x) { return x * x * x; };
+  auto cube_fd = derivative<float>(cube);
+  std::function<float(float)> cube_p =
+      DualNS::derivative<float>([](auto x) { return x * x * x; });
+  for (float x : {-2.0f, -1.0f, 0.0f, 0.5f, 2.0f}) {
+    EXPECT_EQ(cube_p(x), 3 * x * x) << x;
+    EXPECT_NEAR(cube_p(x), cube_fd(x), 0.001) << x;
+  }
+}
+
+// the same formula in both modes
+template <typename V>
+V model(const V &x, const V &y) {
+  return tanh_exp(x * y) + pow(x - y, 3.0) / y + exp(x * 0.5) * tanh(y) - 2.0;
+}
+
+TEST(DualTest, gradient_matches_reverse_mode) {
+  auto x = ScalarNS::make_scalar<double>(0.7);
+  auto y = ScalarNS::make_scalar<double>(-1.3);
+  auto out = model(x, y);
+  backpropagate({out});
+
+  auto d = DualNS::gradient<double, 2>(
+      [](const auto &in) { return model(in[0], in[1]); }, {0.7, -1.3});
+  EXPECT_EQ(d.value, out->data);
+  EXPECT_NEAR(d.tangent[0], x->grad, 1e-12);
+  EXPECT_NEAR(d.tangent[1], y->grad, 1e-12);
+}
+
+// one input, many outputs: a single pass gives every derivative
+TEST(DualTest, many_outputs) {
+  const auto t = DualNS::Dual<double>::input(0.3);
+  std::array<DualNS::Dual<double>, 4> outs{t * t, tanh(t), exp(t * 2.0), 1.0 / t};
+  EXPECT_DOUBLE_EQ(outs[0].tangent[0], 0.6);
+  EXPECT_DOUBLE_EQ(outs[1].tangent[0], 1 - std::pow(std::tanh(0.3), 2));
+  EXPECT_DOUBLE_EQ(outs[2].tangent[0], 2 * std::exp(0.6));
+  EXPECT_DOUBLE_EQ(outs[3].tangent[0], -1 / (0.3 * 0.3));
+}
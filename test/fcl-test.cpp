@@ -0,0 +1,104 @@
+#include "fcl.hpp"
+#include "gemm.hpp"
+#include <gtest/gtest.h>
+#include <vector>
+
+class FclTest : public ::testing::Test {
+protected:
+  void TearDown() override { Kernels::set_isa(Kernels::detected_isa); }
+
+  template <typename T>
+  std::vector<T> filled(std::size_t n, T scale) {
+    std::vector<T> v(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      v[i] = scale * static_cast<T>((i * 37) % 17) - T(0.5);
+    }
+    return v;
+  }
+
+  // C += op(A) * op(B) against a triple loop
+  template <typename T>
+  void check_gemm(std::size_t m, std::size_t n, std::size_t k, bool ta, bool tb) {
+    auto a = filled<T>(m * k, T(0.1));
+    auto b = filled<T>(k * n, T(0.07));
+    auto c = filled<T>(m * n, T(0.01));
+    auto ref = c;
+    auto av = Gemm::row_major(a.data(), ta ? m : k, ta);
+    auto bv = Gemm::row_major(b.data(), tb ? k : n, tb);
+    for (std::size_t i = 0; i < m; ++i) {
+      for (std::size_t j = 0; j < n; ++j) {
+        T sum = 0;
+        for (std::size_t p = 0; p < k; ++p) {
+          sum += av(i, p) * bv(p, j);
+        }
+        ref[i * n + j] += sum;
+      }
+    }
+    Gemm::gemm(m, n, k, av, bv, c.data(), n);
+    for (std::size_t i = 0; i < m * n; ++i) {
+      ASSERT_NEAR(c[i], ref[i], 1e-3 * (1 + std::abs(ref[i]))) << i;
+    }
+  }
+};
+
+TEST_F(FclTest, gemm_shapes) {
+  for (auto isa : {Kernels::Isa::SCALAR, Kernels::detected_isa}) {
+    Kernels::set_isa(isa);
+    check_gemm<float>(1, 1, 1, false, false);
+    check_gemm<float>(7, 13, 5, false, false);
+    check_gemm<float>(130, 70, 300, true, false);
+    check_gemm<double>(61, 35, 270, false, true);
+    check_gemm<double>(9, 3100, 4, true, true);
+    check_gemm<int>(5, 6, 7, false, false);
+  }
+}
+
+TEST_F(FclTest, dense_forward_backward) {
+  constexpr std::size_t batch = 5, in = 7, out = 3;
+  Dense<double> layer(in, out, Operation::tanh_ptr<double>);
+  auto xs = filled<double>(batch * in, 0.2);
+  auto x = TensorNS::make_tensor<double>({batch, in}, xs, "x");
+  auto y = layer(x);
+  ASSERT_EQ(y->data.shape, (TensorNS::Shape{batch, out}));
+  TensorNS::backpropagate({y});
+
+  const auto &w = layer.weight->data;
+  const auto &b = layer.bias->data;
+  std::vector<double> dx(batch * in, 0), dw(in * out, 0), db(out, 0);
+  for (std::size_t r = 0; r < batch; ++r) {
+    for (std::size_t j = 0; j < out; ++j) {
+      double pre = b.at({j});
+      for (std::size_t i = 0; i < in; ++i) {
+        pre += xs[r * in + i] * w.at({i, j});
+      }
+      EXPECT_NEAR(y->data.at({r, j}), std::tanh(pre), 1e-12);
+      const double dpre = 1 - std::tanh(pre) * std::tanh(pre);
+      db[j] += dpre;
+      for (std::size_t i = 0; i < in; ++i) {
+        dw[i * out + j] += xs[r * in + i] * dpre;
+        dx[r * in + i] += w.at({i, j}) * dpre;
+      }
+    }
+  }
+  for (std::size_t i = 0; i < dx.size(); ++i) {
+    EXPECT_NEAR((*x->grad.storage)[i], dx[i], 1e-12);
+  }
+  for (std::size_t i = 0; i < dw.size(); ++i) {
+    EXPECT_NEAR((*layer.weight->grad.storage)[i], dw[i], 1e-12);
+  }
+  for (std::size_t i = 0; i < db.size(); ++i) {
+    EXPECT_NEAR((*layer.bias->grad.storage)[i], db[i], 1e-12);
+  }
+}
+
+TEST_F(FclTest, dense_strided_input) {
+  Dense<float> layer(4, 2, UniformFloatInit<float>(-1, 1));
+  auto x = TensorNS::make_tensor<float>({4, 3}, filled<float>(12, 0.3f));
+  auto xt = TensorNS::transpose(x, 0, 1);
+  auto y = layer(xt);
+  auto y2 = layer(TensorNS::make_tensor(xt->data.clone()));
+  EXPECT_EQ(y->data.to_vector(), y2->data.to_vector());
+  TensorNS::backpropagate({y});
+  EXPECT_EQ(x->grad.shape, (TensorNS::Shape{4, 3}));
+  EXPECT_THROW(layer(x), std::runtime_error *);
+}
@@ -0,0 +1,75 @@
+#include "fusion.hpp"
+#include "plan.hpp"
+#include "scalar.hpp"
+#include <gtest/gtest.h>
+using namespace ScalarNS;
+
+struct Graph {
+  Scalar<double> x = make_scalar<double>(0.4);
+  Scalar<double> y = make_scalar<double>(-1.3);
+  Scalar<double> z = make_scalar<double>(2.1);
+  Scalar<double> out;
+  Graph() {
+    auto t = tanh_exp(x * y);
+    auto q = (x + z) / y;
+    auto f = x * z + t;
+    auto p = pow(pow(z, 2.0), 3.0);
+    out = f * q + p * 0.01 + tanh_exp(z);
+  }
+};
+
+TEST(FusionTest, gradients_unchanged) {
+  Graph g;
+  auto plain = PlanNS::capture({g.out});
+  auto fused = PlanNS::capture({g.out});
+  const auto removed = PlanNS::fuse(fused, {g.x, g.y, g.z});
+  // 2 x 11 for tanh_exp, 1 for the division, 1 per fma, 1 for the pow chain
+  EXPECT_EQ(removed, 22 + 1 + 2 + 1);
+  EXPECT_EQ(fused.size() + removed, plain.size());
+
+  auto px = plain.var(g.x), py = plain.var(g.y), pz = plain.var(g.z);
+  auto fx = fused.var(g.x), fy = fused.var(g.y), fz = fused.var(g.z);
+  for (double shift : {0.0, 0.25, -0.6}) {
+    px->data = fx->data = 0.4 + shift;
+    py->data = fy->data = -1.3 - shift;
+    pz->data = fz->data = 2.1 * (1 + shift);
+    plain.forward();
+    plain.backward();
+    fused.forward();
+    fused.backward();
+    const auto scale = std::abs(plain.output()->data) + 1;
+    EXPECT_NEAR(fused.output()->data, plain.output()->data, 1e-12 * scale);
+    EXPECT_NEAR(fx->grad, px->grad, 1e-12 * (std::abs(px->grad) + 1));
+    EXPECT_NEAR(fy->grad, py->grad, 1e-12 * (std::abs(py->grad) + 1));
+    EXPECT_NEAR(fz->grad, pz->grad, 1e-12 * (std::abs(pz->grad) + 1));
+  }
+}
+
+TEST(FusionTest, keeps_shared_and_pinned) {
+  auto a = make_scalar<float>(1.5f);
+  auto b = make_scalar<float>(2.0f);
+  auto c = make_scalar<float>(-0.5f);
+  auto m = a * b;
+  // m is read twice, so neither add may absorb it
+  auto out = (m + c) * (m + a);
+  auto plan = PlanNS::capture({out});
+  EXPECT_EQ(PlanNS::fuse(plan, {a, b, c}), 0);
+
+  // b is an input, so 2 * b isn't the constant of tanh_exp's pattern
+  auto t = (exp(b * a) - 1.0f) / (exp(b * a) + 1.0f);
+  auto plan2 = PlanNS::capture({t});
+  EXPECT_EQ(PlanNS::fuse(plan2, {a, b}), 1);  // just the division
+}
+
+// integer pow(y, -1) truncates, so x * pow(y, -1) is left alone
+TEST(FusionTest, integer_division_unfused) {
+  auto x = make_scalar<int>(7);
+  auto y = make_scalar<int>(1);
+  auto plan = PlanNS::capture({x * pow(y, -1)});
+  const int before = plan.output()->data;
+  EXPECT_EQ(PlanNS::fuse(plan, {x, y}), 0);
+  plan.var(y)->data = 2;
+  plan.forward();
+  EXPECT_EQ(plan.output()->data, 0);
+  EXPECT_EQ(before, 7);
+}
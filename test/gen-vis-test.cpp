@@ -0,0 +1,72 @@
+#include "gen-vis.hpp"
+#include "scalar.hpp"
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+using namespace ScalarNS;
+
+static std::size_t count(const std::string &text, const std::string &what) {
+  std::size_t n = 0;
+  for (auto at = text.find(what); at != std::string::npos; at = text.find(what, at + 1)) {
+    ++n;
+  }
+  return n;
+}
+
+TEST(GenVisTest, shared_nodes_once) {
+  // 2^64 paths from the root to x
+  auto x = make_scalar<double>(1.0, "x");
+  auto y = x;
+  for (int i = 0; i < 64; ++i) {
+    y = y + y;
+  }
+  std::ostringstream out;
+  EXPECT_EQ(write_dot(out, y), 65u);
+  const auto dot = out.str();
+  EXPECT_EQ(dot.rfind("digraph G {", 0), 0u);
+  EXPECT_EQ(count(dot, "shape=ellipse"), 64u);
+  // op -> value, and both operands -> op
+  EXPECT_EQ(count(dot, " -> "), 3 * 64u);
+  EXPECT_EQ(count(dot, "x(data="), 1u);
+  // the old entry point goes through the same exporter
+  EXPECT_EQ(gen_vis(y), dot);
+}
+
+TEST(GenVisTest, max_depth) {
+  auto c = make_scalar<float>(2.0f, "c");
+  auto d = make_scalar<float>(3.0f, "d");
+  auto b = c * d;
+  auto a = tanh(tanh(tanh(b)));
+  auto root = a + b;
+  std::ostringstream out;
+  // through a, b is 4 deep and would be cut off; breadth first reaches it
+  // from the root at depth 1 first, so it is drawn once and expanded
+  write_dot(out, root, {.max_depth = 4});
+  const auto dot = out.str();
+  EXPECT_EQ(count(dot, "style=dashed"), 0u);
+  EXPECT_EQ(count(dot, "c(data="), 1u);
+  EXPECT_EQ(count(dot, "d(data="), 1u);
+
+  std::ostringstream shallow;
+  EXPECT_EQ(write_dot(shallow, tanh(a), {.max_depth = 2}), 3u);
+  EXPECT_EQ(count(shallow.str(), "c(data="), 0u);
+}
+
+TEST(GenVisTest, collapse_and_cluster) {
+  Scalar<float> sum;
+  for (int i = 0; i < 10; ++i) {
+    auto w = make_scalar<float>(float(i), fmt::format("layer1.w{}", i));
+    sum = i == 0 ? w : sum + w;
+  }
+  auto out_node = tanh(sum);
+  out_node->label = "out \"final\"";
+  std::ostringstream out;
+  EXPECT_EQ(write_dot(out, out_node, {.collapse = true, .cluster_separator = '.'}), 20u);
+  const auto dot = out.str();
+  // tanh, and the nine additions as one
+  EXPECT_EQ(count(dot, "shape=ellipse"), 2u);
+  EXPECT_EQ(count(dot, "label=\"+ x9\""), 1u);
+  EXPECT_EQ(count(dot, " -> "), 2u + 1u + 10u);
+  EXPECT_EQ(count(dot, "subgraph \"cluster_layer1\""), 10u);
+  EXPECT_EQ(count(dot, "out \\\"final\\\""), 1u);
+}
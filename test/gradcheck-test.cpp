@@ -0,0 +1,71 @@
+#include "gradcheck.hpp"
+#include "scalar.hpp"
+#include "thread-pool.hpp"
+#include <gtest/gtest.h>
+#include <vector>
+using namespace ScalarNS;
+
+// a hidden layer of tanh neurons over two inputs, squared error plus a
+// few other ops
+struct Model {
+  std::vector<Scalar<double>> params;
+  Scalar<double> loss;
+
+  explicit Model(std::size_t hidden) {
+    auto x0 = make_scalar<double>(0.3);
+    auto x1 = make_scalar<double>(-0.8);
+    params = {x0, x1};
+    Scalar<double> out;
+    for (std::size_t j = 0; j < hidden; ++j) {
+      auto w0 = make_scalar<double>(0.1 * double(j % 7) - 0.3);
+      auto w1 = make_scalar<double>(0.05 * double(j % 5) + 0.1);
+      auto v = make_scalar<double>(j % 2 ? 0.4 : -0.6);
+      params.insert(params.end(), {w0, w1, v});
+      auto h = tanh(x0 * w0 + x1 * w1 + 0.1);
+      out = j == 0 ? h * v : out + h * v;
+    }
+    auto err = out - 0.5;
+    loss = pow(err, 2.0) + exp(err * 0.5) + err / (x0 * x0 + 1.0);
+  }
+};
+
+TEST(GradCheckTest, matches_backprop) {
+  Model model(8);
+  model.params[0]->grad = 5.0;
+  auto check = gradcheck(model.loss, model.params);
+  ASSERT_EQ(check.numeric.size(), model.params.size());
+  EXPECT_LT(check.max_rel_error, 1e-5);
+  // leaf grads are left alone and don't leak into the analytic side
+  EXPECT_EQ(model.params[0]->grad, 5.0);
+  EXPECT_EQ(model.params[1]->grad, 0.0);
+  model.params[0]->grad = 0.0;
+  backpropagate({model.loss});
+  for (std::size_t j = 0; j < model.params.size(); ++j) {
+    EXPECT_EQ(check.analytic[j], model.params[j]->grad) << j;
+  }
+
+  // richardson is much closer for the same h
+  auto rich = gradcheck(model.loss, model.params, {.richardson = true});
+  EXPECT_LT(rich.max_abs_error, check.max_abs_error / 100);
+  EXPECT_EQ(rich.analytic, check.analytic);
+}
+
+TEST(GradCheckTest, threads_agree) {
+  Model model(100);
+  ThreadPool pool(4);
+  auto serial = gradcheck(model.loss, model.params);
+  auto threaded = gradcheck(model.loss, model.params, {.pool = &pool});
+  EXPECT_EQ(serial.numeric, threaded.numeric);
+  EXPECT_EQ(serial.max_rel_error, threaded.max_rel_error);
+  EXPECT_LT(threaded.max_rel_error, 1e-5);
+}
+
+TEST(GradCheckTest, leaves_only) {
+  auto a = make_scalar<float>(1.5f);
+  auto b = a * a;
+  auto c = b + a;
+  EXPECT_THROW(gradcheck(c, {b}), std::runtime_error *);
+  EXPECT_THROW(gradcheck(c, {make_scalar<float>(1.0f)}), std::runtime_error *);
+  auto check = gradcheck(c, {a});
+  EXPECT_NEAR(check.numeric[0], 4.0f, 1e-2f);
+}
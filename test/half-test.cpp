@@ -0,0 +1,152 @@
+#include "half.hpp"
+#include <gtest/gtest.h>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// conversions are constant expressions over the whole range
+static_assert(fp16(1.0f).bits == 0x3c00);
+static_assert(fp16(65504.0f).bits == 0x7bff);
+static_assert(fp16(0x1p-24f).bits == 0x0001);
+static_assert(fp16(-0.0f).bits == 0x8000);
+static_assert(bf16(1.0f).bits == 0x3f80);
+static_assert(float(fp16::from_bits(0x0001)) == 0x1p-24f);
+
+template <typename H>
+class HalfTest : public ::testing::Test {
+protected:
+  void TearDown() override { Kernels::set_isa(Kernels::detected_isa); }
+
+  // the nearest finite 16 bit value to f, ties to even, from the two
+  // around it; positive bit patterns are ordered like their values
+  static std::uint16_t nearest(float f) {
+    const double x = std::abs(double(f));
+    const std::uint32_t top = std::is_same_v<H, bf16> ? 0x7f7f : 0x7bff;
+    std::uint32_t lo = 0;
+    std::uint32_t hi = top;
+    while (lo < hi) {
+      const std::uint32_t mid = (lo + hi + 1) / 2;
+      if (double(float(H::from_bits(static_cast<std::uint16_t>(mid)))) <= x) {
+        lo = mid;
+      } else {
+        hi = mid - 1;
+      }
+    }
+    std::uint32_t best = lo;
+    if (lo < top) {
+      const double below = x - double(float(H::from_bits(static_cast<std::uint16_t>(lo))));
+      const double above = double(float(H::from_bits(static_cast<std::uint16_t>(lo + 1)))) - x;
+      if (above < below || (above == below && (lo & 1) != 0)) {
+        best = lo + 1;
+      }
+    }
+    return static_cast<std::uint16_t>(best | (std::signbit(f) ? 0x8000u : 0u));
+  }
+};
+
+using HalfTypes = ::testing::Types<bf16, fp16>;
+TYPED_TEST_SUITE(HalfTest, HalfTypes);
+
+// every bit pattern survives the trip through float, NaNs as NaNs
+TYPED_TEST(HalfTest, round_trip) {
+  for (std::uint32_t b = 0; b <= 0xffff; ++b) {
+    const auto h = TypeParam::from_bits(static_cast<std::uint16_t>(b));
+    const float f = h;
+    if (std::isnan(f)) {
+      EXPECT_TRUE(std::isnan(float(TypeParam(f)))) << b;
+      EXPECT_FALSE(HalfNS::isfinite(h)) << b;
+      continue;
+    }
+    EXPECT_EQ(TypeParam(f).bits, h.bits) << b;
+    EXPECT_EQ(HalfNS::isfinite(h), std::isfinite(f)) << b;
+  }
+}
+
+// rounding to nearest even against a search over the representable values,
+// including halfway cases, subnormals and overflow to inf
+TYPED_TEST(HalfTest, rounds_to_nearest_even) {
+  std::vector<float> cases = {0.0f, -0.0f, 1.0f, 1.0f / 3, -2.5e-3f, 65504.0f, 65519.0f,
+                              65520.0f, 1e5f, 3e38f, 6e-8f, 2.9e-8f, 3e-8f, 1e-40f};
+  for (std::uint32_t u = 0x33000000u; u < 0x47800000u; u += 0x1357u) {
+    cases.push_back(std::bit_cast<float>(u));
+  }
+  // exactly between two bf16 or two fp16 values
+  for (std::uint32_t b = 0x3f80; b < 0x3f90; ++b) {
+    cases.push_back(std::bit_cast<float>((b << 16) | 0x8000u));
+  }
+  for (std::uint32_t b = 0x3c00; b < 0x3c10; ++b) {
+    cases.push_back((float(fp16::from_bits(b)) + float(fp16::from_bits(b + 1))) / 2);
+  }
+  for (float f : cases) {
+    for (float x : {f, -f}) {
+      const TypeParam h = x;
+      const float max = float(TypeParam::from_bits(std::is_same_v<TypeParam, bf16> ? 0x7f7f : 0x7bff));
+      // beyond the largest value plus half an ulp is inf
+      if (std::abs(x) >= max + (max - float(TypeParam::from_bits(
+                                           std::is_same_v<TypeParam, bf16> ? 0x7f7e : 0x7bfe))) / 2) {
+        EXPECT_TRUE(std::isinf(float(h))) << x;
+        continue;
+      }
+      EXPECT_EQ(h.bits, this->nearest(x)) << x;
+    }
+  }
+  EXPECT_TRUE(std::isnan(float(TypeParam(std::numeric_limits<float>::quiet_NaN()))));
+  EXPECT_TRUE(std::isinf(float(TypeParam(std::numeric_limits<float>::infinity()))));
+}
+
+#ifdef __FLT16_MAX__
+// the compiler's own conversion, on every 7th float
+TEST(HalfTest, fp16_matches_float16) {
+  for (std::uint64_t u = 0; u <= 0xffffffffu; u += 7 * 4099) {
+    const float f = std::bit_cast<float>(static_cast<std::uint32_t>(u));
+    if (std::isnan(f)) {
+      continue;
+    }
+    const auto ref = std::bit_cast<std::uint16_t>(static_cast<_Float16>(f));
+    EXPECT_EQ(fp16(f).bits, ref) << f;
+  }
+}
+#endif
+
+// the array conversions give the bits of the per element ones on every
+// instruction set, odd length for the tails
+TYPED_TEST(HalfTest, arrays_match_elements) {
+  const std::size_t size = 1037;
+  std::vector<float> floats(size);
+  std::vector<TypeParam> ref(size);
+  for (std::size_t i = 0; i < size; ++i) {
+    floats[i] = std::ldexp(0.37f * float(i) - 190.1f, int(i % 41) - 30);
+    ref[i] = floats[i];
+  }
+  for (auto isa : {Kernels::Isa::SCALAR, Kernels::Isa::SSE, Kernels::Isa::AVX2,
+                   Kernels::Isa::AVX512}) {
+    if (Kernels::set_isa(isa) != isa) {
+      continue;
+    }
+    std::vector<TypeParam> narrowed(size);
+    std::vector<float> widened(size);
+    HalfNS::narrow<TypeParam>(floats, narrowed);
+    HalfNS::widen<TypeParam>(narrowed, widened);
+    for (std::size_t i = 0; i < size; ++i) {
+      ASSERT_EQ(narrowed[i].bits, ref[i].bits) << i << ", isa " << static_cast<int>(isa);
+      ASSERT_EQ(std::bit_cast<std::uint32_t>(widened[i]),
+                std::bit_cast<std::uint32_t>(float(ref[i])))
+          << i << ", isa " << static_cast<int>(isa);
+    }
+  }
+  std::vector<float> shorter(size - 1);
+  EXPECT_THROW(HalfNS::widen<TypeParam>(ref, shorter), std::runtime_error *);
+}
+
+// arithmetic runs in float and rounds once on the way back
+TYPED_TEST(HalfTest, computes_in_float) {
+  const TypeParam a = 1.0f;
+  const TypeParam b = std::is_same_v<TypeParam, bf16> ? 0x1p-8f : 0x1p-11f;
+  // a + b is a tie, back to 1; a + b + b in float is exact and rounds up
+  EXPECT_EQ(TypeParam(a + b).bits, a.bits);
+  EXPECT_EQ(float(TypeParam(a + b + b)), 1.0f + 2 * float(b));
+  auto square = derivative<TypeParam>([](TypeParam x) -> TypeParam { return x * x; });
+  EXPECT_NEAR(float(square(1.5f)), 3.0f, 0.02f);
+}
@@ -1,5 +1,11 @@
 #include "initialization.hpp"
+#include "thread-pool.hpp"
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <vector>
 
 class InitTest : public ::testing::Test {
 protected:
@@ -36,3 +42,104 @@ TEST_F(InitTest, uniform_int) {
     EXPECT_LE(test_vector[i], 0);
   }
 }
+
+// the whole range of T, wider than its positive half
+TEST_F(InitTest, uniform_int_full_range) {
+  UniformIntInit<std::int32_t> myinit(std::numeric_limits<std::int32_t>::min(),
+                                      std::numeric_limits<std::int32_t>::max());
+  std::int64_t low = 0, high = 0;
+  for (int i = 0; i < 1000; ++i) {
+    const std::int32_t v = myinit();
+    low = std::min<std::int64_t>(low, v);
+    high = std::max<std::int64_t>(high, v);
+  }
+  EXPECT_LT(low, std::int64_t(-1) << 30);
+  EXPECT_GT(high, std::int64_t(1) << 30);
+
+  std::array<bool, 256> seen{};
+  UniformIntInit<std::int8_t> bytes(-128, 127);
+  for (int i = 0; i < 10000; ++i) {
+    seen[static_cast<std::uint8_t>(bytes())] = true;
+  }
+  EXPECT_TRUE(std::all_of(seen.begin(), seen.end(), [](bool s) { return s; }));
+}
+
+// ranges past 2^32 and the whole of int64_t, where the range wraps to 0
+TEST_F(InitTest, uniform_int64_wide_range) {
+  UniformIntInit<std::int64_t> wide(0, std::int64_t(1) << 40);
+  std::int64_t high = 0;
+  for (int i = 0; i < 1000; ++i) {
+    const std::int64_t v = wide();
+    EXPECT_GE(v, 0);
+    EXPECT_LE(v, std::int64_t(1) << 40);
+    high = std::max(high, v);
+  }
+  EXPECT_GT(high, std::int64_t(1) << 38);
+
+  UniformIntInit<std::int64_t> full(std::numeric_limits<std::int64_t>::min(),
+                                    std::numeric_limits<std::int64_t>::max());
+  std::int64_t low = 0;
+  high = 0;
+  for (int i = 0; i < 1000; ++i) {
+    const std::int64_t v = full();
+    low = std::min(low, v);
+    high = std::max(high, v);
+  }
+  EXPECT_LT(low, std::int64_t(-1) << 60);
+  EXPECT_GT(high, std::int64_t(1) << 60);
+}
+
+// known answer from the Random123 reference for counter 0, key 0
+TEST_F(InitTest, philox_known_answer) {
+  auto w = Philox(0)(0);
+  EXPECT_EQ(w[0], 0x6627e8d5u);
+  EXPECT_EQ(w[1], 0xe169c58du);
+  EXPECT_EQ(w[2], 0xbc57ac4cu);
+  EXPECT_EQ(w[3], 0x9b00dbd8u);
+}
+
+// bulk, one at a time, sliced and threaded draws are the same stream
+TEST_F(InitTest, counter_streams_agree) {
+  constexpr std::size_t size = 300007;
+  std::vector<double> bulk(size), single(size), sliced(size), threaded(size);
+  auto init = kaiming_normal<double>(64, 7);
+  init.init_range(bulk.data(), size);
+  auto one = kaiming_normal<double>(64, 7);
+  for (auto &v : single) v = one();
+  auto parts = kaiming_normal<double>(64, 7);
+  parts.init_range_at(sliced.data() + 5, size - 5, 5);
+  parts.init_range_at(sliced.data(), 5, 0);
+  ThreadPool pool(3);
+  auto par = kaiming_normal<double>(64, 7);
+  parallel_init_range(pool, par, threaded.data(), size);
+  EXPECT_EQ(bulk, single);
+  EXPECT_EQ(bulk, sliced);
+  EXPECT_EQ(bulk, threaded);
+  EXPECT_EQ(par.next, size);
+
+  // and the moments are about right
+  double mean = 0, sq = 0;
+  for (double v : bulk) {
+    mean += v;
+    sq += v * v;
+  }
+  mean /= size;
+  EXPECT_NEAR(mean, 0.0, 0.01);
+  EXPECT_NEAR(sq / size, 2.0 / 64, 0.001);
+  EXPECT_NE(bulk[0], kaiming_normal<double>(64, 8)());
+}
+
+TEST_F(InitTest, xavier_bounds) {
+  std::vector<float> w(1001);
+  auto init = xavier_uniform<float>(30, 20, 3);
+  init.init_range(w.data(), w.size());
+  const float limit = std::sqrt(6.0f / 50);
+  for (float v : w) {
+    EXPECT_GE(v, -limit);
+    EXPECT_LE(v, limit);
+  }
+  std::vector<float> n(1001);
+  auto normal = xavier_normal<float>(30, 20, 3);
+  normal.init_range(n.data(), n.size());
+  EXPECT_NE(n[0], n[1]);
+}
@@ -0,0 +1,63 @@
+#include "kernels.hpp"
+#include "operation.hpp"
+#include <gtest/gtest.h>
+#include <cstring>
+#include <vector>
+
+template <typename T>
+class KernelsTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    // odd length so every path has a tail
+    for (std::size_t i = 0; i < size; ++i) {
+      first.push_back(static_cast<T>(0.37 * i - 11.3));
+      second.push_back(static_cast<T>(1.0 / (i + 1.7)));
+      grad.push_back(static_cast<T>(0.013 * i + 0.5));
+    }
+  }
+  void TearDown() override { Kernels::set_isa(Kernels::detected_isa); }
+
+  // runs forward_n and backward_n on every instruction set the cpu has and
+  // compares the bits against the per element virtual calls
+  void check(Operation::Operation<T> &op) {
+    std::vector<T> out_ref(size), grad_ref(size, T(1));
+    for (std::size_t i = 0; i < size; ++i) {
+      out_ref[i] = op.forward(first[i], second[i]);
+      grad_ref[i] += op.backward(grad[i], first[i], second[i]);
+    }
+    for (auto isa : {Kernels::Isa::SCALAR, Kernels::Isa::SSE, Kernels::Isa::AVX2,
+                     Kernels::Isa::AVX512}) {
+      if (Kernels::set_isa(isa) != isa) {
+        continue;
+      }
+      std::vector<T> out(size), grad_out(size, T(1));
+      op.forward_n(first, second, out);
+      op.backward_n(grad, first, second, grad_out);
+      EXPECT_EQ(std::memcmp(out.data(), out_ref.data(), size * sizeof(T)), 0)
+          << op.get_symbol() << " forward, isa " << static_cast<int>(isa);
+      EXPECT_EQ(std::memcmp(grad_out.data(), grad_ref.data(), size * sizeof(T)), 0)
+          << op.get_symbol() << " backward, isa " << static_cast<int>(isa);
+    }
+  }
+
+  static constexpr std::size_t size = 1037;
+  std::vector<T> first, second, grad;
+};
+
+using KernelTypes = ::testing::Types<float, double>;
+TYPED_TEST_SUITE(KernelsTest, KernelTypes);
+
+TYPED_TEST(KernelsTest, add) { this->check(Operation::add_singleton<TypeParam>); }
+TYPED_TEST(KernelsTest, mul) { this->check(Operation::mul_singleton<TypeParam>); }
+TYPED_TEST(KernelsTest, pow) {
+  Operation::Pow<TypeParam> op(3);
+  this->check(op);
+}
+TYPED_TEST(KernelsTest, tanh) { this->check(Operation::tanh_singleton<TypeParam>); }
+TYPED_TEST(KernelsTest, exp) { this->check(Operation::exp_singleton<TypeParam>); }
+
+TEST(KernelsIntTest, add) {
+  std::vector<int> a{1, 2, 3}, b{4, 5, 6}, out(3);
+  Operation::add_singleton<int>.forward_n(a, b, out);
+  EXPECT_EQ(out, (std::vector<int>{5, 7, 9}));
+}
@@ -0,0 +1,108 @@
+#include "fusion.hpp"
+#include "memory-plan.hpp"
+#include "plan.hpp"
+#include "scalar.hpp"
+#include <gtest/gtest.h>
+#include <array>
+using namespace ScalarNS;
+
+// two inputs, a hidden layer of three tanh neurons, squared error
+struct Model {
+  std::array<Scalar<double>, 2> x;
+  std::array<Scalar<double>, 9> w;
+  Scalar<double> loss;
+
+  Model() {
+    for (auto &xi : x) xi = make_scalar<double>(0.0);
+    for (auto &wi : w) wi = make_scalar<double>(0.0);
+    Scalar<double> out;
+    for (std::size_t j = 0; j < 3; ++j) {
+      auto h = tanh(x[0] * w[3 * j] + x[1] * w[3 * j + 1] + 0.1);
+      out = j == 0 ? h * w[3 * j + 2] : out + h * w[3 * j + 2];
+    }
+    auto err = out - 0.5;
+    loss = pow(err, 2.0) + exp(err * 0.01) + err * err;
+  }
+};
+
+TEST(MemoryPlanTest, matches_plan) {
+  Model model;
+  auto plan = PlanNS::capture({model.loss});
+  std::vector<Scalar<double>> inputs(model.x.begin(), model.x.end());
+  inputs.insert(inputs.end(), model.w.begin(), model.w.end());
+  auto mem = PlanNS::plan_memory(PlanNS::capture({model.loss}), inputs);
+  EXPECT_EQ(mem.size(), plan.size());
+  EXPECT_LT(mem.planned_bytes(), mem.naive_bytes());
+
+  std::array<double, 2> xv{0.3, -0.8};
+  std::array<double, 9> wv{0.1, -0.2, 0.3, 0.4, -0.5, 0.6, 0.7, 0.8, -0.9};
+  for (int step = 0; step < 4; ++step) {
+    for (std::size_t i = 0; i < 2; ++i) {
+      plan.var(model.x[i])->data = mem.value(model.x[i]) = xv[i];
+    }
+    for (std::size_t i = 0; i < 9; ++i) {
+      plan.var(model.w[i])->data = mem.value(model.w[i]) = wv[i];
+    }
+    plan.forward();
+    plan.backward();
+    mem.forward();
+    mem.backward();
+    EXPECT_EQ(mem.output(), plan.output()->data);
+    EXPECT_EQ(mem.grad(model.loss), 1.0);
+    for (std::size_t i = 0; i < 9; ++i) {
+      EXPECT_EQ(mem.grad(model.w[i]), plan.var(model.w[i])->grad) << step << " " << i;
+    }
+    for (std::size_t i = 0; i < 2; ++i) {
+      EXPECT_EQ(mem.grad(model.x[i]), plan.var(model.x[i])->grad) << step << " " << i;
+    }
+    for (std::size_t i = 0; i < 9; ++i) wv[i] -= 0.1 * mem.grad(model.w[i]);
+    xv = {xv[1], xv[0] + 0.1};
+  }
+}
+
+TEST(MemoryPlanTest, long_chain) {
+  auto x = make_scalar<float>(0.5f);
+  auto w = make_scalar<float>(0.9f);
+  auto b = make_scalar<float>(0.1f);
+  auto y = x;
+  for (int i = 0; i < 1000; ++i) {
+    y = tanh(y * w + b);
+  }
+  auto plan = PlanNS::capture({y});
+  auto training = PlanNS::plan_memory(PlanNS::capture({y}), {x, w, b});
+  auto inference =
+      PlanNS::plan_memory(PlanNS::capture({y}), {x, w, b}, PlanNS::Mode::INFERENCE);
+  plan.forward();
+  plan.backward();
+  training.forward();
+  training.backward();
+  inference.forward();
+  EXPECT_EQ(training.output(), plan.output()->data);
+  EXPECT_EQ(inference.output(), plan.output()->data);
+  EXPECT_EQ(training.grad(x), plan.var(x)->grad);
+  EXPECT_EQ(training.grad(w), plan.var(w)->grad);
+
+  // backward needs y and the sum of every step again, the products and
+  // all gradients but a few are dead
+  EXPECT_LT(training.planned_bytes(), training.naive_bytes() / 2);
+  // a forward pass alone only ever has a couple of values in flight.
+  // constants are leaves and keep their slots, hence b instead of 0.1f
+  EXPECT_LT(inference.buffer.size(), 16u);
+  EXPECT_THROW(inference.backward(), std::runtime_error *);
+  EXPECT_THROW(inference.grad(x), std::runtime_error *);
+  EXPECT_THROW(training.value(make_scalar<float>(1.0f)), std::runtime_error *);
+
+  // the same chain as fma and tanh
+  auto fused_plan = PlanNS::capture({y});
+  auto fused_mem = PlanNS::capture({y});
+  PlanNS::fuse(fused_plan, {x, w, b});
+  PlanNS::fuse(fused_mem, {x, w, b});
+  auto fused = PlanNS::plan_memory(std::move(fused_mem), {x, w, b});
+  fused_plan.forward();
+  fused_plan.backward();
+  fused.forward();
+  fused.backward();
+  EXPECT_EQ(fused.output(), fused_plan.output()->data);
+  EXPECT_EQ(fused.grad(w), fused_plan.var(w)->grad);
+  EXPECT_EQ(fused.grad(b), fused_plan.var(b)->grad);
+}
@@ -0,0 +1,166 @@
+#include "batch.hpp"
+#include "mixed.hpp"
+#include "plan.hpp"
+#include "scalar.hpp"
+#include <gtest/gtest.h>
+#include <array>
+#include <cmath>
+#include <vector>
+using namespace ScalarNS;
+
+// four inputs, two tanh layers of four neurons, squared error
+struct Model {
+  std::array<Scalar<float>, 4> x;
+  std::vector<Scalar<float>> w;
+  Scalar<float> loss;
+
+  Model() {
+    for (auto &v : x) v = make_scalar<float>(0.0f);
+    std::vector<Scalar<float>> layer(x.begin(), x.end());
+    for (int l = 0; l < 2; ++l) {
+      std::vector<Scalar<float>> next;
+      for (std::size_t j = 0; j < 4; ++j) {
+        Scalar<float> acc;
+        for (std::size_t i = 0; i < 4; ++i) {
+          w.push_back(make_scalar<float>(0.3f * std::sin(float(w.size()) + 1.0f)));
+          acc = i == 0 ? layer[i] * w.back() : acc + layer[i] * w.back();
+        }
+        next.push_back(tanh(acc));
+      }
+      layer = std::move(next);
+    }
+    auto out = layer[0] + layer[1] + layer[2] + layer[3];
+    loss = pow(out - 0.5f, 2.0f);
+  }
+};
+
+template <typename H>
+class MixedTest : public ::testing::Test {};
+using HalfTypes = ::testing::Types<bf16, fp16>;
+TYPED_TEST_SUITE(MixedTest, HalfTypes);
+
+// outputs and gradients against Batch<float>, within the precision of the
+// storage type; lanes not a multiple of the block
+TYPED_TEST(MixedTest, matches_float_batch) {
+  Model model;
+  auto plan = PlanNS::capture({model.loss});
+  const std::size_t lanes = 300;
+  PlanNS::Batch<float> ref(plan, lanes);
+  PlanNS::MixedBatch<TypeParam> mixed(plan, lanes);
+  for (std::size_t k = 0; k < 4; ++k) {
+    for (std::size_t i = 0; i < lanes; ++i) {
+      // representable in both, so both batches see the same inputs
+      const TypeParam v = std::cos(0.1f * float(i) + float(k));
+      ref.value(model.x[k])[i] = v;
+      mixed.value(model.x[k])[i] = v;
+    }
+  }
+  for (auto &w : model.w) {
+    for (std::size_t i = 0; i < lanes; ++i) {
+      ref.value(w)[i] = float(TypeParam(w->data));
+    }
+  }
+  ref.forward();
+  ref.backward();
+  mixed.forward();
+  mixed.backward();
+
+  const float tol = std::is_same_v<TypeParam, bf16> ? 0.05f : 0.01f;
+  for (std::size_t i = 0; i < lanes; ++i) {
+    EXPECT_NEAR(float(mixed.output()[i]), ref.output()[i],
+                tol * std::max(1.0f, std::abs(ref.output()[i])));
+  }
+  for (auto &w : model.w) {
+    const float expected = ref.grad_sum(w);
+    EXPECT_NEAR(mixed.grad_sum(w), expected, tol * std::max(1.0f, std::abs(expected)));
+  }
+  EXPECT_TRUE(mixed.finite());
+  // half the bytes of the float batch
+  EXPECT_EQ(mixed.values.size() * sizeof(TypeParam) * 2, ref.values.size() * sizeof(float));
+}
+
+// a node read by many ops adds its gradient up in fp32 and rounds once:
+// the result is the float batch's gradient rounded to 16 bits
+TYPED_TEST(MixedTest, accumulates_in_fp32) {
+  auto x = make_scalar<float>(1.0f);
+  Scalar<float> y;
+  for (int k = 0; k < 64; ++k) {
+    // 1 + k / 128 is exact in both types, so every contribution is
+    auto term = x * make_scalar<float>(1.0f + float(k) / 128);
+    y = k == 0 ? term : y + term;
+  }
+  auto plan = PlanNS::capture({y});
+  PlanNS::Batch<float> ref(plan, 3);
+  PlanNS::MixedBatch<TypeParam> mixed(plan, 3);
+  ref.backward();
+  mixed.backward();
+  for (std::size_t i = 0; i < 3; ++i) {
+    EXPECT_EQ(ref.grad(x)[i], 79.75f);
+    EXPECT_EQ(mixed.grad(x)[i].bits, TypeParam(79.75f).bits);
+  }
+}
+
+// gradients below the fp16 range vanish unscaled and come back with a
+// loss scale
+TEST(MixedTest, loss_scale_recovers_underflow) {
+  auto x = make_scalar<float>(0.3f);
+  auto w = make_scalar<float>(0.7f);
+  auto loss = x * w * 0x1p-12f * 0x1p-12f;
+  auto plan = PlanNS::capture({loss});
+  PlanNS::MixedBatch<fp16> batch(plan, 8);
+  batch.forward();
+  batch.backward();
+  EXPECT_EQ(batch.grad_sum(w), 0.0f);
+  batch.backward(65536.0f);
+  const float expected = 8 * float(fp16(0.3f)) * 0x1p-24f;
+  EXPECT_NEAR(batch.grad_sum(w), expected, 1e-3f * expected);
+  EXPECT_TRUE(batch.finite());
+}
+
+// overflowing steps are skipped and lower the scale until one fits, and
+// it grows again after interval good steps
+TEST(MixedTest, loss_scale_backs_off) {
+  auto x = make_scalar<float>(3.0f);
+  auto w = make_scalar<float>(2.0f);
+  auto loss = x * w * 100.0f;
+  auto plan = PlanNS::capture({loss});
+  PlanNS::MixedBatch<fp16> batch(plan, 4);
+  PlanNS::LossScale scaler{.interval = 3};
+  batch.forward();
+  int skipped = 0;
+  while (true) {
+    batch.backward(scaler.scale);
+    if (scaler.update(batch.finite())) {
+      break;
+    }
+    ++skipped;
+  }
+  // 300 * scale has to stay below 65504
+  EXPECT_EQ(scaler.scale, 128.0f);
+  EXPECT_EQ(skipped, 9);
+  EXPECT_NEAR(batch.grad_sum(w), 4 * 300.0f, 1.0f);
+  scaler.update(true);
+  scaler.update(true);
+  EXPECT_EQ(scaler.scale, 256.0f);
+}
+
+TEST(MixedTest, inference_has_no_gradients) {
+  auto x = make_scalar<float>(0.5f);
+  auto plan = PlanNS::capture({tanh(x) * x});
+  PlanNS::MixedBatch<bf16> batch(plan, 5, PlanNS::Mode::INFERENCE);
+  batch.forward();
+  EXPECT_EQ(batch.grads.size(), 0u);
+  EXPECT_NEAR(float(batch.output()[4]), std::tanh(0.5f) * 0.5f, 1e-2f);
+  EXPECT_THROW(batch.backward(), std::runtime_error *);
+  EXPECT_THROW(batch.grad(x), std::runtime_error *);
+  EXPECT_THROW(batch.finite(), std::runtime_error *);
+}
+
+// nothing captured, nothing to sweep
+TEST(MixedTest, empty_plan) {
+  auto plan = PlanNS::capture(std::vector<Scalar<float>>{});
+  PlanNS::MixedBatch<fp16> batch(plan, 4);
+  batch.forward();
+  batch.backward(1024.0f);
+  EXPECT_TRUE(batch.finite());
+}
@@ -0,0 +1,104 @@
+#include "optimizer.hpp"
+#include "parameters.hpp"
+#include "scalar.hpp"
+#include "thread-pool.hpp"
+#include "topo.hpp"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <vector>
+using namespace ScalarNS;
+
+// one element by hand against the optimizers
+TEST(OptimizerTest, single_steps) {
+  std::vector<double> p{1.0};
+  std::vector<double> g{0.5};
+
+  OptimNS::Sgd<double> sgd(1, {.lr = 0.1, .momentum = 0.9});
+  sgd.step(p, g);
+  EXPECT_DOUBLE_EQ(p[0], 1.0 - 0.1 * 0.5);
+  sgd.step(p, g);
+  EXPECT_DOUBLE_EQ(p[0], 0.95 - 0.1 * (0.9 * 0.5 + 0.5));
+
+  // momentum turned on after construction
+  p = {1.0};
+  OptimNS::Sgd<double> late(1, {.lr = 0.1});
+  late.options.momentum = 0.9;
+  late.step(p, g);
+  late.step(p, g);
+  EXPECT_DOUBLE_EQ(p[0], 0.95 - 0.1 * (0.9 * 0.5 + 0.5));
+
+  p = {1.0};
+  OptimNS::Adam<double> adam(1, {.lr = 0.01});
+  adam.step(p, g);
+  // the first bias corrected step is lr * sign(g)
+  EXPECT_NEAR(p[0], 1.0 - 0.01, 1e-9);
+
+  p = {1.0};
+  OptimNS::AdamW<double> adamw(1, {.lr = 0.01, .weight_decay = 0.1});
+  adamw.step(p, g);
+  EXPECT_NEAR(p[0], 1.0 * (1 - 0.01 * 0.1) - 0.01, 1e-9);
+
+  EXPECT_THROW(adam.step(std::span<double>(p), std::span<const double>()),
+               std::runtime_error *);
+}
+
+// blocks stepped on a pool give the same result as one pass
+TEST(OptimizerTest, threads_match_serial) {
+  const std::size_t n = 3 * OptimNS::block + 17;
+  std::vector<float> a(n), b(n), g(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    a[i] = b[i] = std::sin(float(i));
+    g[i] = std::cos(float(i) * 0.5f);
+  }
+  ThreadPool pool(3);
+  OptimNS::Adam<float> serial(n, {});
+  OptimNS::Adam<float> parallel(n, {});
+  parallel.pool = &pool;
+  for (int s = 0; s < 3; ++s) {
+    serial.step(a, g);
+    parallel.step(b, g);
+  }
+  EXPECT_EQ(a, b);
+}
+
+// a small regression fitted through the registry and through loose leaves
+TEST(OptimizerTest, fits_a_line) {
+  ParameterRegistry<double> params;
+  auto w = params.add(0.0);
+  auto c = params.add(0.0);
+  auto w2 = make_scalar<double>(0.0);
+  auto c2 = make_scalar<double>(0.0);
+  OptimNS::Adam<double> adam(params.size(), {.lr = 0.1});
+  OptimNS::Sgd<double> sgd(2, {.lr = 0.02, .momentum = 0.5});
+  for (int step = 0; step < 300; ++step) {
+    Scalar<double> loss = make_scalar<double>(0.0);
+    Scalar<double> loss2 = make_scalar<double>(0.0);
+    for (double x : {-1.0, 0.0, 1.0, 2.0}) {
+      loss = loss + pow(w * x + c - (3 * x + 1), 2.0);
+      loss2 = loss2 + pow(w2 * x + c2 - (3 * x + 1), 2.0);
+    }
+    params.zero_grad();
+    w2->grad = c2->grad = 0;
+    backpropagate({loss});
+    backpropagate({loss2});
+    adam.step(params);
+    sgd.step({w2, c2});
+  }
+  EXPECT_NEAR(w->data, 3.0, 1e-2);
+  EXPECT_NEAR(c->data, 1.0, 1e-2);
+  EXPECT_NEAR(w2->data, 3.0, 1e-2);
+  EXPECT_NEAR(c2->data, 1.0, 1e-2);
+}
+
+// data set on a registered node between steps is what the next step updates
+TEST(OptimizerTest, registry_sees_edited_values) {
+  ParameterRegistry<double> params;
+  auto w = params.add(1.0);
+  OptimNS::Sgd<double> sgd(params.size(), {.lr = 0.5});
+  w->grad = 1;
+  sgd.step(params);
+  EXPECT_EQ(w->data, 0.5);
+  w->data = 4.0;
+  sgd.step(params);
+  EXPECT_EQ(w->data, 3.5);
+}
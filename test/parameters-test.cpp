@@ -0,0 +1,85 @@
+#include "initialization.hpp"
+#include "parameters.hpp"
+#include "scalar.hpp"
+#include "topo.hpp"
+#include <gtest/gtest.h>
+using namespace ScalarNS;
+
+TEST(ParameterRegistryTest, registration) {
+  ParameterRegistry<float> params(4);
+  auto a = params.add(1.0f, "a");
+  auto rest = params.add_n(9, UniformFloatInit<float>(-1.0f, 1.0f));
+  EXPECT_EQ(params.size(), 10u);
+  EXPECT_EQ(params[0], a);
+  EXPECT_EQ(a->label, "a");
+  // back to back inside a chunk
+  EXPECT_EQ(params[1].get() + 1, params[2].get());
+  EXPECT_EQ(params.values[0], 1.0f);
+  EXPECT_EQ(params.values[5], rest[4]->data);
+}
+
+TEST(ParameterRegistryTest, gather_scatter_and_zero) {
+  ParameterRegistry<double> params(3);
+  auto w = params.add_n(7, [] { return 0.5; });
+  Scalar<double> loss = w[0] * w[0];
+  for (std::size_t i = 1; i < w.size(); ++i) {
+    loss = loss + w[i] * double(i);
+  }
+  backpropagate({loss});
+
+  auto g = params.gather_grads();
+  EXPECT_EQ(g[0], 1.0);
+  for (std::size_t i = 1; i < w.size(); ++i) {
+    EXPECT_EQ(g[i], double(i));
+  }
+  // moved off the nodes, so a second gather doesn't count them twice
+  EXPECT_EQ(w[0]->grad, 0.0);
+  EXPECT_EQ(params.gather_grads()[0], 1.0);
+  for (std::size_t i = 0; i < g.size(); ++i) {
+    params.values[i] -= 0.1 * g[i];
+  }
+  params.scatter_values();
+  EXPECT_EQ(w[0]->data, 0.4);
+  EXPECT_EQ(w[6]->data, 0.5 - 0.1 * 6);
+
+  params.zero_grad();
+  for (std::size_t i = 0; i < w.size(); ++i) {
+    EXPECT_EQ(w[i]->grad, 0.0);
+    EXPECT_EQ(params.grads[i], 0.0);
+  }
+  // nothing else in the graph is touched
+  EXPECT_EQ(loss->grad, 1.0);
+
+  w[3]->data = 2.0;
+  EXPECT_EQ(params.gather_values()[3], 2.0);
+  params.grads[2] = 5.0;
+  params.scatter_grads();
+  EXPECT_EQ(w[2]->grad, 5.0);
+  EXPECT_EQ(params.grads[2], 0.0);
+}
+
+// parameters outlive per step graphs built in an arena
+TEST(ParameterRegistryTest, training_loop) {
+  ParameterRegistry<double> params;
+  auto w = params.add(0.1);
+  auto b = params.add(0.0);
+  GraphContext<double> step;
+  double first = 0, last = 0;
+  for (int i = 0; i < 50; ++i) {
+    {
+      GraphScope<double> scope(step);
+      Scalar<double> loss = make_scalar<double>(0.0);
+      for (double x : {-1.0, 0.0, 1.0, 2.0}) {
+        loss = loss + pow(w * x + b - (3 * x + 1), 2.0);
+      }
+      backpropagate({loss});
+      (i == 0 ? first : last) = loss->data;
+    }
+    auto g = params.gather_grads();
+    for (std::size_t k = 0; k < g.size(); ++k) params.values[k] -= 0.05 * g[k];
+    params.scatter_values();
+    params.zero_grad();
+    step.reset();
+  }
+  EXPECT_LT(last, first * 0.01);
+}
@@ -0,0 +1,104 @@
+#include "batch.hpp"
+#include "expr.hpp"
+#include "plan.hpp"
+#include "scalar.hpp"
+#include "topo.hpp"
+#include <gtest/gtest.h>
+#include <array>
+using namespace ScalarNS;
+
+// two inputs, a hidden layer of three tanh neurons, squared error
+template <typename T>
+struct Model {
+  std::array<Scalar<T>, 2> x;
+  std::array<Scalar<T>, 9> w;
+  Scalar<T> loss;
+
+  Model(const std::array<T, 2> &xv, const std::array<T, 9> &wv) {
+    for (std::size_t i = 0; i < 2; ++i) x[i] = make_scalar<T>(xv[i]);
+    for (std::size_t i = 0; i < 9; ++i) w[i] = make_scalar<T>(wv[i]);
+    Scalar<T> out;
+    for (std::size_t j = 0; j < 3; ++j) {
+      auto h = tanh(x[0] * w[3 * j] + x[1] * w[3 * j + 1] + 0.1);
+      out = j == 0 ? h * w[3 * j + 2] : out + h * w[3 * j + 2];
+    }
+    auto err = out - 0.5;
+    loss = pow(err, T(2)) + exp(err * 0.01);
+  }
+};
+
+TEST(PlanTest, replay_matches_rebuild) {
+  std::array<double, 2> xv{0.3, -0.8};
+  std::array<double, 9> wv{0.1, -0.2, 0.3, 0.4, -0.5, 0.6, 0.7, 0.8, -0.9};
+  Model<double> traced(xv, wv);
+  auto plan = PlanNS::capture({traced.loss});
+  EXPECT_EQ(plan.size(), topological_sort({traced.loss}).size());
+  std::vector<TapeNS::Var<double>> xs, ws;
+  for (auto &x : traced.x) xs.push_back(plan.var(x));
+  for (auto &w : traced.w) ws.push_back(plan.var(w));
+
+  for (int step = 0; step < 5; ++step) {
+    for (std::size_t i = 0; i < 2; ++i) xs[i]->data = xv[i];
+    for (std::size_t i = 0; i < 9; ++i) ws[i]->data = wv[i];
+    plan.forward();
+    plan.backward();
+
+    Model<double> fresh(xv, wv);
+    backpropagate({fresh.loss});
+    EXPECT_EQ(plan.output()->data, fresh.loss->data);
+    for (std::size_t i = 0; i < 9; ++i) {
+      EXPECT_EQ(ws[i]->grad, fresh.w[i]->grad) << step << " " << i;
+    }
+    for (std::size_t i = 0; i < 2; ++i) {
+      EXPECT_EQ(xs[i]->grad, fresh.x[i]->grad) << step << " " << i;
+    }
+    // a plain sgd step and a new input
+    for (std::size_t i = 0; i < 9; ++i) wv[i] -= 0.1 * ws[i]->grad;
+    xv = {xv[1], xv[0] + 0.1};
+  }
+}
+
+TEST(PlanTest, unknown_node) {
+  auto a = make_scalar<float>(1.0f);
+  auto b = make_scalar<float>(2.0f);
+  auto plan = PlanNS::capture({a * b});
+  EXPECT_THROW(plan.var(make_scalar<float>(3.0f)), std::runtime_error *);
+  EXPECT_EQ(plan.var(b)->data, 2.0f);
+}
+
+// nothing captured, nothing to sweep
+TEST(PlanTest, empty_plan) {
+  auto plan = PlanNS::capture(std::vector<Scalar<double>>{});
+  plan.forward();
+  plan.backward();
+  EXPECT_EQ(plan.size(), 0u);
+  PlanNS::Batch<double> batch(plan, 4);
+  batch.forward();
+  batch.backward();
+}
+
+// a materialized node only holds its value at the point it was built, a
+// replay with other inputs couldn't match rebuilding the graph
+TEST(PlanTest, rejects_materialized_nodes) {
+  auto x = make_scalar<double>(1.5);
+  auto y = ExprNS::materialize(ExprNS::tanh_exp(ExprNS::var<0>(x)), x) * 2.0;
+  EXPECT_THROW(PlanNS::capture({y}), std::runtime_error *);
+
+  // the same formula from graph ops replays like a rebuilt graph, per
+  // sample as well
+  auto z = tanh(x) * 2.0;
+  auto plan = PlanNS::capture({z});
+  PlanNS::Batch<double> batch(plan, 3);
+  for (std::size_t i = 0; i < 3; ++i) {
+    batch.value(x)[i] = 1.5 + 0.25 * double(i);
+  }
+  batch.forward();
+  for (std::size_t i = 0; i < 3; ++i) {
+    x->data = 1.5 + 0.25 * double(i);
+    auto rebuilt = tanh(x) * 2.0;
+    plan.var(x)->data = x->data;
+    plan.forward();
+    EXPECT_EQ(plan.output()->data, rebuilt->data);
+    EXPECT_EQ(batch.output()[i], rebuilt->data);
+  }
+}
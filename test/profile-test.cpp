@@ -0,0 +1,108 @@
+// the hooks are compiled in for this test whatever the build option says
+#ifndef HUGEGRAD_PROFILE
+#define HUGEGRAD_PROFILE 1
+#endif
+#include "formatting.hpp"
+#include "plan.hpp"
+#include "profile.hpp"
+#include "scalar.hpp"
+#include "thread-pool.hpp"
+#include "topo.hpp"
+#include <gtest/gtest.h>
+#include <fstream>
+#include <sstream>
+using namespace ScalarNS;
+
+static ProfileNS::OpStats op_stats(const ProfileNS::Report &report, ProfileNS::Pass pass,
+                                   Operation::OpCode code) {
+  for (const auto &op : report.ops) {
+    if (op.pass == pass && op.code == code) return op.stats;
+  }
+  return {};
+}
+
+TEST(ProfileTest, counts_ops_and_labels) {
+  ProfileNS::reset();
+  auto x = make_scalar<double>(0.5, "x");
+  auto w = make_scalar<double>(-2.0, "w");
+  Scalar<double> h;
+  {
+    HUGEGRAD_PROFILE_SCOPE("forward");
+    h = tanh(x * w + x);
+    h->label = "h";
+  }
+  backpropagate({h});
+  backpropagate({h});
+
+  auto report = ProfileNS::report();
+  using ProfileNS::Pass;
+  using Operation::OpCode;
+  EXPECT_EQ(op_stats(report, Pass::FORWARD, OpCode::MUL).calls, 1u);
+  EXPECT_EQ(op_stats(report, Pass::FORWARD, OpCode::TANH).calls, 1u);
+  EXPECT_EQ(op_stats(report, Pass::BACKWARD, OpCode::TANH).calls, 2u);
+  EXPECT_EQ(op_stats(report, Pass::BACKWARD, OpCode::ADD).calls, 2u);
+  // leaves run nothing
+  EXPECT_EQ(op_stats(report, Pass::BACKWARD, OpCode::NONE).calls, 0u);
+  ASSERT_EQ(report.labels.size(), 1u);
+  EXPECT_EQ(report.labels[0].label, "h");
+  EXPECT_EQ(report.labels[0].stats.calls, 2u);
+
+  std::size_t sorts = 0, backwards = 0, forwards = 0;
+  for (const auto &p : report.passes) {
+    if (p.name == "topological_sort") sorts = p.stats.calls;
+    if (p.name == "backward") backwards = p.stats.calls;
+    if (p.name == "forward") forwards = p.stats.calls;
+  }
+  EXPECT_EQ(sorts, 2u);
+  EXPECT_EQ(backwards, 2u);
+  EXPECT_EQ(forwards, 1u);
+
+  const auto table = fmt::format("{}", report);
+  EXPECT_NE(table.find("TANH"), std::string::npos);
+  EXPECT_NE(table.find("topological_sort"), std::string::npos);
+
+  ProfileNS::reset();
+  EXPECT_TRUE(ProfileNS::report().ops.empty());
+}
+
+// the parallel pass times every node once, like the serial sweep
+TEST(ProfileTest, parallel_backward_counts) {
+  auto x = make_scalar<double>(0.5, "x");
+  auto w = make_scalar<double>(-2.0, "w");
+  auto h = tanh(x * w + x) * w;
+  using ProfileNS::Pass;
+  using Operation::OpCode;
+  ProfileNS::reset();
+  backpropagate({h});
+  auto serial = ProfileNS::report();
+  ThreadPool pool(2);
+  ProfileNS::reset();
+  backpropagate({h}, pool);
+  auto parallel = ProfileNS::report();
+  for (auto code : {OpCode::MUL, OpCode::ADD, OpCode::TANH}) {
+    EXPECT_EQ(op_stats(parallel, Pass::BACKWARD, code).calls,
+              op_stats(serial, Pass::BACKWARD, code).calls);
+  }
+  EXPECT_EQ(op_stats(parallel, Pass::BACKWARD, OpCode::MUL).calls, 2u);
+}
+
+TEST(ProfileTest, plan_trace) {
+  auto x = make_scalar<float>(0.5f);
+  auto y = exp(x * x);
+  auto plan = PlanNS::capture({y});
+  ProfileNS::reset();
+  plan.forward();
+  plan.backward();
+  auto report = ProfileNS::report();
+  EXPECT_EQ(op_stats(report, ProfileNS::Pass::FORWARD, Operation::OpCode::EXP).calls, 1u);
+  EXPECT_EQ(op_stats(report, ProfileNS::Pass::BACKWARD, Operation::OpCode::MUL).calls, 1u);
+
+  const auto path = ::testing::TempDir() + "hugegrad-trace.json";
+  ProfileNS::write_trace(path);
+  std::ifstream in(path);
+  std::stringstream trace;
+  trace << in.rdbuf();
+  EXPECT_EQ(trace.str().rfind("{\"traceEvents\": [", 0), 0u);
+  EXPECT_NE(trace.str().find("\"name\": \"forward\", \"ph\": \"X\""), std::string::npos);
+  EXPECT_NE(trace.str().find("\"name\": \"backward\""), std::string::npos);
+}
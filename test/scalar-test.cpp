@@ -196,3 +196,185 @@ TEST_F(ScalarTest, backprop3) {
 }
 // TODO multiple output test
 // TODO exp backprop test
+
+TEST_F(ScalarTest, arena_graph) {
+  GraphContext<float> ctx;
+  {
+    GraphScope<float> scope(ctx);
+    auto a = make_scalar<float>(2.0, "a");
+    auto b = make_scalar<float>(-3.0, "b");
+    auto c = make_scalar<float>(10.0, "c");
+    auto L = (a * b + c) * 2.0f;
+    EXPECT_EQ(ctx.size(), 7);
+    EXPECT_EQ(L.use_count(), 0);
+    EXPECT_FLOAT_EQ(L->data, 8.0);
+    backpropagate({L});
+    EXPECT_FLOAT_EQ(a->grad, -6.0);
+    EXPECT_FLOAT_EQ(b->grad, 4.0);
+    EXPECT_FLOAT_EQ(c->grad, 2.0);
+  }
+  // outside the scope nodes go back to the heap
+  auto heap = make_scalar<float>(1.0);
+  EXPECT_EQ(heap.use_count(), 1);
+  EXPECT_EQ(ctx.size(), 7);
+  ctx.reset();
+  EXPECT_EQ(ctx.size(), 0);
+}
+
+TEST_F(ScalarTest, arena_nested_scopes) {
+  GraphContext<float> outer;
+  GraphContext<float> inner(16);
+  GraphScope<float> outer_scope(outer);
+  make_scalar<float>(1.0);
+  {
+    GraphScope<float> inner_scope(inner);
+    for (int i = 0; i < 100; ++i) {
+      make_scalar<float>(i);
+    }
+  }
+  make_scalar<float>(2.0);
+  EXPECT_EQ(outer.size(), 2);
+  EXPECT_EQ(inner.size(), 100);
+  inner.reset();
+  for (int i = 0; i < 10; ++i) {
+    GraphScope<float> inner_scope(inner);
+    make_scalar<float>(i);
+  }
+  EXPECT_EQ(inner.size(), 10);
+}
+
+TEST_F(ScalarTest, backprop_twice) {
+  auto a = make_scalar<float>(2.0, "a");
+  auto b = make_scalar<float>(-3.0, "b");
+  auto c = make_scalar<float>(0.5, "c");
+  auto e = a * b;
+  auto L = e * c;
+  backpropagate({L});
+  float a_grad = a->grad;
+  float e_grad = e->grad;
+  backpropagate({L});
+  EXPECT_FLOAT_EQ(e->grad, e_grad);
+  EXPECT_FLOAT_EQ(a->grad, 2 * a_grad);
+  L->clear_gradient();
+  EXPECT_FLOAT_EQ(a->grad, 0.0);
+  EXPECT_FLOAT_EQ(L->grad, 0.0);
+  L->compute_grad();
+  EXPECT_FLOAT_EQ(a->grad, a_grad);
+  EXPECT_FLOAT_EQ(e->grad, e_grad);
+}
+
+TEST_F(ScalarTest, long_chain) {
+  constexpr int depth = 200000;
+  GraphContext<double> ctx;
+  GraphScope<double> scope(ctx);
+  auto x = make_scalar<double>(1.0, "x");
+  auto y = x;
+  for (int i = 0; i < depth; ++i) {
+    y = y * 1.0;
+  }
+  EXPECT_EQ(topological_sort({y}).size(), 2 * depth + 1);
+  backpropagate({y});
+  EXPECT_DOUBLE_EQ(x->grad, 1.0);
+  y->clear_gradient();
+  y->compute_grad();
+  EXPECT_DOUBLE_EQ(x->grad, 1.0);
+}
+
+// the same on the heap, freeing the chain mustn't recurse per node either
+TEST_F(ScalarTest, long_heap_chain) {
+  constexpr int depth = 1000000;
+  auto x = make_scalar<double>(1.0, "x");
+  auto y = x;
+  for (int i = 0; i < depth; ++i) {
+    y = y * 1.0;
+  }
+  backpropagate({y});
+  EXPECT_DOUBLE_EQ(x->grad, 1.0);
+  y.reset();
+  EXPECT_EQ(x.use_count(), 1);
+}
+
+TEST_F(ScalarTest, cycle) {
+  auto a = make_scalar<float>(2.0, "a");
+  auto b = make_scalar<float>(-3.0, "b");
+  auto e = a * b;
+  auto L = tanh(e);
+  e->child1 = L;
+  EXPECT_THROW(topological_sort({L}), std::runtime_error *);
+  // break the cycle so the nodes can be freed
+  e->child1 = a;
+}
+
+TEST_F(ScalarTest, same_children) {
+  auto x = make_scalar<double>(3.0, "x");
+  auto y = x * x + x;
+  backpropagate({y});
+  EXPECT_DOUBLE_EQ(y->data, 12.0);
+  EXPECT_DOUBLE_EQ(x->grad, 7.0);
+}
+
+TEST_F(ScalarTest, cse_shares_nodes) {
+  auto x = make_scalar<double>(1.5, "x");
+  auto w = make_scalar<double>(-2.0, "w");
+  CseTable<double> table;
+  Scalar<double> y;
+  {
+    CseScope<double> scope(table);
+    auto a = tanh(x * w) * 2.0;
+    auto b = tanh(w * x) * 2.0;
+    EXPECT_EQ(a.get(), b.get());
+    y = a + b;
+  }
+  // w * x, its tanh, the 2 and the product
+  EXPECT_EQ(table.hits, 4);
+  // x, w, x * w, tanh, the 2, the product, the sum
+  EXPECT_EQ(topological_sort({y}).size(), 7);
+  backpropagate({y});
+  const double t = std::tanh(-3.0);
+  EXPECT_DOUBLE_EQ(x->grad, 4 * (1 - t * t) * -2.0);
+  EXPECT_DOUBLE_EQ(w->grad, 4 * (1 - t * t) * 1.5);
+  // outside the scope nothing is shared
+  EXPECT_NE((x * w).get(), (x * w).get());
+}
+
+// a leaf changed between builds, as by an optimizer step, gets new nodes
+TEST_F(ScalarTest, cse_sees_changed_leaves) {
+  auto x = make_scalar<double>(2.0, "x");
+  auto w = make_scalar<double>(3.0, "w");
+  CseTable<double> table;
+  CseScope<double> scope(table);
+  auto before = x * w + 1.0;
+  EXPECT_EQ((x * w + 1.0).get(), before.get());
+  w->data = 5.0;
+  auto after = x * w + 1.0;
+  EXPECT_NE(after.get(), before.get());
+  EXPECT_DOUBLE_EQ(after->data, 11.0);
+  EXPECT_DOUBLE_EQ(before->data, 7.0);
+  // the new nodes are the ones shared from now on
+  EXPECT_EQ((w * x + 1.0).get(), after.get());
+}
+
+TEST_F(ScalarTest, cse_repeated_model) {
+  auto x = make_scalar<float>(0.5f, "x");
+  auto w = make_scalar<float>(0.25f, "w");
+  // the same neuron written out in every term
+  auto model = [&] {
+    auto y = tanh(x * w + 1.0f);
+    for (int i = 0; i < 50; ++i) {
+      y = y + tanh(x * w + 1.0f) * pow(x, 2.0f);
+    }
+    return y;
+  };
+  auto plain = model();
+  backpropagate({plain});
+  const float gx = x->grad, gw = w->grad;
+  CseTable<float> table;
+  CseScope<float> scope(table);
+  auto shared = model();
+  x->grad = w->grad = 0;
+  backpropagate({shared});
+  EXPECT_LT(topological_sort({shared}).size(), topological_sort({plain}).size() / 2);
+  EXPECT_EQ(shared->data, plain->data);
+  EXPECT_FLOAT_EQ(x->grad, gx);
+  EXPECT_FLOAT_EQ(w->grad, gw);
+}
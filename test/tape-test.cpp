@@ -0,0 +1,77 @@
+#include "scalar.hpp"
+#include "tape.hpp"
+#include "topo.hpp"
+#include <gtest/gtest.h>
+
+class TapeTest : public ::testing::Test {
+protected:
+  TapeNS::Tape<float> tape;
+};
+
+TEST_F(TapeTest, backprop1) {
+  using namespace TapeNS;
+  auto a = make_scalar<float>(tape, 2.0, "a");
+  auto b = make_scalar<float>(tape, -3.0, "b");
+  auto c = make_scalar<float>(tape, 10.0, "c");
+  auto e = a * b;
+  auto d = e + c;
+  auto f = make_scalar<float>(tape, -2.0, "f");
+  auto L = d * f;
+  EXPECT_FLOAT_EQ(L->data, -8.0);
+  backpropagate({L});
+  EXPECT_EQ(tape.size(), 7);
+  EXPECT_FLOAT_EQ(L->grad, 1.0);
+  EXPECT_FLOAT_EQ(d->grad, -2.0);
+  EXPECT_FLOAT_EQ(f->grad, 4.0);
+  EXPECT_FLOAT_EQ(c->grad, -2.0);
+  EXPECT_FLOAT_EQ(e->grad, -2.0);
+  EXPECT_FLOAT_EQ(b->grad, -4.0);
+  EXPECT_FLOAT_EQ(a->grad, 6.0);
+}
+
+// builds the same formula on either representation
+template <typename Make>
+auto neuron(Make make) {
+  auto x1 = make(2.0f);
+  auto x2 = make(0.0f);
+  auto w1 = make(-3.0f);
+  auto w2 = make(1.0f);
+  auto b = make(0.5f);
+  auto n = x1 * w1 + x2 * w2 + b;
+  auto o = tanh(n) * exp(n * 0.1f) + pow(x1 - w2, 3.0f) / (w1 * w2 + 4.5f);
+  return std::make_tuple(o, x1, x2, w1, w2, b);
+}
+
+TEST_F(TapeTest, matches_graph) {
+  auto [o, x1, x2, w1, w2, b] = neuron([](float v) {
+    return ScalarNS::make_scalar<float>(v);
+  });
+  backpropagate({o});
+  auto [to, tx1, tx2, tw1, tw2, tb] = neuron([this](float v) {
+    return TapeNS::make_scalar<float>(tape, v);
+  });
+  TapeNS::backpropagate({to});
+  EXPECT_FLOAT_EQ(to->data, o->data);
+  EXPECT_FLOAT_EQ(tx1->grad, x1->grad);
+  EXPECT_FLOAT_EQ(tx2->grad, x2->grad);
+  EXPECT_FLOAT_EQ(tw1->grad, w1->grad);
+  EXPECT_FLOAT_EQ(tw2->grad, w2->grad);
+  EXPECT_FLOAT_EQ(tb->grad, b->grad);
+}
+
+TEST_F(TapeTest, shared_operands) {
+  using namespace TapeNS;
+  auto x = make_scalar<float>(tape, 3.0);
+  auto y = x * x + tanh_exp(x);
+  backpropagate({y});
+  float t = std::tanh(3.0f);
+  EXPECT_NEAR(x->grad, 6.0f + (1 - t * t), 1e-4);
+  // a second sweep starts from fresh gradients
+  backpropagate({y});
+  EXPECT_NEAR(x->grad, 6.0f + (1 - t * t), 1e-4);
+}
+
+TEST_F(TapeTest, empty_backward) {
+  tape.backward({});
+  EXPECT_EQ(tape.size(), 0u);
+}
@@ -0,0 +1,80 @@
+#include "scalar.hpp"
+#include "tensor.hpp"
+#include "topo.hpp"
+#include <gtest/gtest.h>
+using namespace TensorNS;
+
+class TensorTest : public ::testing::Test {
+protected:
+  void SetUp() override {
+    m = Tensor<float>({2, 3}, {1, 2, 3, 4, 5, 6});
+  }
+  Tensor<float> m;
+};
+
+TEST_F(TensorTest, layout) {
+  EXPECT_EQ(m.size(), 6);
+  EXPECT_EQ(m.strides, (Strides{3, 1}));
+  EXPECT_TRUE(m.is_contiguous());
+  EXPECT_FLOAT_EQ(m.at({1, 2}), 6);
+  EXPECT_THROW(m.at({2, 0}), std::runtime_error *);
+  EXPECT_THROW(Tensor<float>({2, 2}, {1, 2, 3}), std::runtime_error *);
+}
+
+TEST_F(TensorTest, views_share_storage) {
+  auto t = m.transpose(0, 1);
+  EXPECT_EQ(t.shape, (Shape{3, 2}));
+  EXPECT_FALSE(t.is_contiguous());
+  EXPECT_FLOAT_EQ(t.at({2, 0}), 3);
+  EXPECT_EQ(t.to_vector(), (std::vector<float>{1, 4, 2, 5, 3, 6}));
+  EXPECT_THROW(t.reshape({6}), std::runtime_error *);
+
+  auto r = m.reshape({3, 2});
+  EXPECT_FLOAT_EQ(r.at({1, 0}), 3);
+
+  auto s = m.slice(1, 1, 3);
+  EXPECT_EQ(s.to_vector(), (std::vector<float>{2, 3, 5, 6}));
+  s.fill(0);
+  EXPECT_EQ(m.to_vector(), (std::vector<float>{1, 0, 0, 4, 0, 0}));
+  EXPECT_EQ(r.storage, m.storage);
+
+  auto c = t.contiguous();
+  EXPECT_TRUE(c.is_contiguous());
+  EXPECT_NE(c.storage, m.storage);
+}
+
+// each element of a tensor expression has to match the scalar graph
+TEST_F(TensorTest, matches_scalar_graph) {
+  std::vector<float> xs{0.5f, -1.0f, 2.0f, 0.25f};
+  std::vector<float> ws{1.5f, 0.5f, -0.75f, 2.0f};
+  auto x = make_tensor<float>({2, 2}, xs, "x");
+  auto w = make_tensor<float>({2, 2}, ws, "w");
+  auto o = tanh(x * w + 1.0f) * exp(x) - pow(w, 2.0f) / (x + 3.0f);
+  backpropagate({o});
+  for (std::size_t i = 0; i < xs.size(); ++i) {
+    auto sx = ScalarNS::make_scalar<float>(xs[i]);
+    auto sw = ScalarNS::make_scalar<float>(ws[i]);
+    auto so = tanh(sx * sw + 1.0f) * exp(sx) - pow(sw, 2.0f) / (sx + 3.0f);
+    ::backpropagate({so});
+    EXPECT_FLOAT_EQ((*o->data.storage)[i], so->data);
+    EXPECT_FLOAT_EQ((*x->grad.storage)[i], sx->grad);
+    EXPECT_FLOAT_EQ((*w->grad.storage)[i], sw->grad);
+  }
+}
+
+TEST_F(TensorTest, grad_through_views) {
+  auto x = make_tensor<float>({2, 3}, {1, 2, 3, 4, 5, 6}, "x");
+  auto t = transpose(x, 0, 1);
+  auto s = slice(t, 0, 1, 3);
+  auto o = s * s;
+  auto flat = reshape(o, {4});
+  backpropagate({flat});
+  EXPECT_EQ(s->data.storage, x->data.storage);
+  EXPECT_EQ(x->grad.to_vector(), (std::vector<float>{0, 4, 6, 0, 10, 12}));
+}
+
+TEST_F(TensorTest, shape_mismatch) {
+  auto a = make_tensor<float>({2}, {1, 2});
+  auto b = make_tensor<float>({3}, {1, 2, 3});
+  EXPECT_THROW(a + b, std::runtime_error *);
+}
@@ -0,0 +1,92 @@
+#include "thread-pool.hpp"
+#include "scalar.hpp"
+#include "topo.hpp"
+#include <gtest/gtest.h>
+using namespace ScalarNS;
+
+TEST(ThreadPoolTest, parallel_for_covers_range) {
+  ThreadPool pool(4);
+  std::vector<std::atomic<int>> hits(10000);
+  pool.parallel_for(0, hits.size(), 16, [&](std::size_t i) { hits[i]++; });
+  for (auto &h : hits) {
+    EXPECT_EQ(h.load(), 1);
+  }
+  // empty and single-chunk ranges run inline
+  pool.parallel_for(5, 5, 1, [&](std::size_t i) { hits[i]++; });
+  pool.parallel_for(0, 3, 16, [&](std::size_t i) { hits[i]++; });
+  EXPECT_EQ(hits[0].load(), 2);
+  EXPECT_EQ(hits[5].load(), 1);
+}
+
+// an error in any chunk reaches the caller and the pool keeps working
+TEST(ThreadPoolTest, parallel_for_rethrows) {
+  ThreadPool pool(4);
+  std::atomic<int> ran{0};
+  EXPECT_THROW(pool.parallel_for(0, 10000, 16,
+                                 [&](std::size_t i) {
+                                   ++ran;
+                                   if (i == 7777) {
+                                     throw new std::runtime_error("bad op");
+                                   }
+                                 }),
+               std::runtime_error *);
+  ran = 0;
+  pool.parallel_for(0, 10000, 16, [&](std::size_t) { ++ran; });
+  EXPECT_EQ(ran.load(), 10000);
+}
+
+// a layer of independent neurons feeding one sum, with shared inputs so
+// the inputs have fan-out
+template <typename T>
+Scalar<T> wide_graph(std::vector<Scalar<T>> &leaves, int inputs, int width) {
+  for (int i = 0; i < inputs; ++i) {
+    leaves.push_back(make_scalar<T>(T(0.1) * (i + 1)));
+  }
+  Scalar<T> total;
+  for (int j = 0; j < width; ++j) {
+    auto w = make_scalar<T>(T(0.01) * (j % 17 - 8));
+    leaves.push_back(w);
+    auto acc = leaves[j % inputs] * w;
+    for (int i = 1; i < inputs; ++i) {
+      acc = acc + leaves[(i + j) % inputs] * w;
+    }
+    auto out = tanh(acc);
+    total = j == 0 ? out : total + out;
+  }
+  return total;
+}
+
+TEST(ThreadPoolTest, backpropagate_matches_serial) {
+  std::vector<Scalar<double>> leaves;
+  auto out = wide_graph<double>(leaves, 8, 500);
+  backpropagate({out});
+  std::vector<double> serial;
+  for (auto &l : leaves) {
+    serial.push_back(l->grad);
+    l->grad = 0;
+  }
+  ThreadPool pool(4);
+  for (int run = 0; run < 3; ++run) {
+    backpropagate({out}, pool);
+    for (std::size_t i = 0; i < leaves.size(); ++i) {
+      // the same additions in the same order
+      EXPECT_EQ(leaves[i]->grad, serial[i]) << i;
+      leaves[i]->grad = 0;
+    }
+  }
+}
+
+TEST(ThreadPoolTest, backpropagate_several_outputs) {
+  auto a = make_scalar<float>(2.0, "a");
+  auto b = make_scalar<float>(-3.0, "b");
+  auto e = a * b;
+  auto f = e + a;
+  ThreadPool pool(2);
+  backpropagate({f, e}, pool);
+  EXPECT_EQ(e->grad, 2.0f);
+  EXPECT_EQ(a->grad, -5.0f);
+  EXPECT_EQ(b->grad, 4.0f);
+  // a traversal after the numbered pass still works
+  e->clear_gradient();
+  EXPECT_EQ(a->grad, 0.0f);
+}